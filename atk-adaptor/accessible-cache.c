@@ -29,6 +29,47 @@
 
 SpiCache *spi_global_cache = NULL;
 
+/*
+ * Default work budget for one slice of the add traversal. These can be
+ * overridden with the AT_SPI_CACHE_SLICE_NODES and AT_SPI_CACHE_SLICE_US
+ * environment variables, where 0 removes the limit. Other values are
+ * held to the ceilings below.
+ */
+#define SPI_CACHE_SLICE_MAX_NODES 1000
+#define SPI_CACHE_SLICE_MAX_US    10000
+
+#define SPI_CACHE_SLICE_NODES_CEILING 1000000
+#define SPI_CACHE_SLICE_US_CEILING    1000000
+
+/* Removals remembered for clients that page through the cache */
+#define SPI_CACHE_REMOVED_MAX 1024
+
+/*
+ * Each cached object carries the cache generation at which it was last
+ * added or updated. The entries are kept in generation order so that
+ * clients can page through the cache, or fetch only what has changed
+ * since a generation they have already seen.
+ *
+ * An entry may also hold a snapshot of the object's cache item, owned
+ * by the cache adaptor, which is dropped whenever the object changes.
+ */
+typedef struct _SpiCacheEntry
+{
+  GObject *object;
+  guint generation;
+  gpointer snapshot;
+} SpiCacheEntry;
+
+/*
+ * A removed object, by its register reference and the generation at
+ * which it was removed.
+ */
+typedef struct _SpiCacheRemoval
+{
+  guint generation;
+  guint ref;
+} SpiCacheRemoval;
+
 static gboolean
 child_added_listener (GSignalInvocationHint * signal_hint,
                       guint n_param_values,
@@ -47,6 +88,9 @@ add_object (SpiCache * cache, GObject * gobj);
 static void
 add_subtree (SpiCache *cache, AtkObject * accessible);
 
+static gboolean
+add_pending_slice (SpiCache * cache);
+
 static gboolean
 add_pending_items (gpointer data);
 
@@ -55,6 +99,12 @@ add_pending_items (gpointer data);
 static void
 spi_cache_finalize (GObject * object);
 
+static void
+free_entry (gpointer data);
+
+static void
+clear_snapshot (SpiCache * cache, SpiCacheEntry * entry);
+
 static void
 spi_cache_dispose (GObject * object);
 
@@ -106,12 +156,47 @@ static void spi_cache_class_init (SpiCacheClass * klass)
                     G_TYPE_OBJECT);
 }
 
+/*
+ * Reads a slice budget from the environment. Values that are not numbers
+ * or are negative leave the default, larger ones are cut to the ceiling.
+ */
+static guint
+budget_from_env (const gchar * name, guint fallback, guint ceiling)
+{
+  const gchar *value = g_getenv (name);
+  gchar *end;
+  gint64 budget;
+
+  if (!value)
+    return fallback;
+
+  budget = g_ascii_strtoll (value, &end, 10);
+  if (end == value || budget < 0)
+    return fallback;
+  return MIN (budget, ceiling);
+}
+
 static void
 spi_cache_init (SpiCache * cache)
 {
   cache->objects = g_hash_table_new (g_direct_hash, g_direct_equal);
+  cache->order = g_sequence_new (free_entry);
+  cache->members = spi_cache_set_new ();
+  cache->generation = 0;
+  cache->removed = g_array_new (FALSE, FALSE, sizeof (SpiCacheRemoval));
+  cache->removed_floor = 0;
   cache->add_traversal = g_queue_new ();
 
+  cache->slice_max_nodes = budget_from_env ("AT_SPI_CACHE_SLICE_NODES",
+                                            SPI_CACHE_SLICE_MAX_NODES,
+                                            SPI_CACHE_SLICE_NODES_CEILING);
+  cache->slice_max_us = budget_from_env ("AT_SPI_CACHE_SLICE_US",
+                                         SPI_CACHE_SLICE_MAX_US,
+                                         SPI_CACHE_SLICE_US_CEILING);
+
+  cache->lazy = spi_atk_lazy_cache;
+  cache->populated = g_hash_table_new (g_direct_hash, g_direct_equal);
+
 #ifdef SPI_ATK_DEBUG
   if (g_thread_supported ())
     g_message ("AT-SPI: Threads enabled");
@@ -123,7 +208,14 @@ spi_cache_init (SpiCache * cache)
                     "object-deregistered",
                     (GCallback) remove_object, cache);
 
-  add_subtree (cache, spi_global_app_data->root);
+  /*
+   * In lazy mode the tree below the root is only walked once a client
+   * asks for it, see spi_cache_populate.
+   */
+  if (cache->lazy)
+    add_object (cache, G_OBJECT (spi_global_app_data->root));
+  else
+    add_subtree (cache, spi_global_app_data->root);
 
   atk_add_global_event_listener (child_added_listener,
                                  "Gtk:AtkObject:children-changed");
@@ -133,15 +225,44 @@ spi_cache_init (SpiCache * cache)
                     (GCallback) toplevel_added_listener, NULL);
 }
 
+/*
+ * Objects leave the populated set when they are destroyed, whether or
+ * not they were ever in the cache, so that a new object at the same
+ * address is not taken to be populated already.
+ */
+static void
+populated_object_gone (gpointer data, GObject * where_the_object_was)
+{
+  SpiCache *cache = SPI_CACHE (data);
+
+  g_hash_table_remove (cache->populated, where_the_object_was);
+}
+
+static void
+populated_weak_unref (gpointer key, gpointer value, gpointer data)
+{
+  g_object_weak_unref (G_OBJECT (key), populated_object_gone, data);
+}
+
 static void
 spi_cache_finalize (GObject * object)
 {
   SpiCache *cache = SPI_CACHE (object);
+  GSequenceIter *iter;
 
   while (!g_queue_is_empty (cache->add_traversal))
     g_object_unref (G_OBJECT (g_queue_pop_head (cache->add_traversal)));
   g_queue_free (cache->add_traversal);
   g_free (cache->objects);
+  for (iter = g_sequence_get_begin_iter (cache->order);
+       !g_sequence_iter_is_end (iter);
+       iter = g_sequence_iter_next (iter))
+    clear_snapshot (cache, g_sequence_get (iter));
+  g_sequence_free (cache->order);
+  g_array_free (cache->removed, TRUE);
+  spi_cache_set_free (cache->members);
+  g_hash_table_foreach (cache->populated, populated_weak_unref, cache);
+  g_hash_table_destroy (cache->populated);
 
   G_OBJECT_CLASS (spi_cache_parent_class)->finalize (object);
 }
@@ -156,29 +277,118 @@ spi_cache_dispose (GObject * object)
 
 /*---------------------------------------------------------------------------*/
 
+static void
+free_entry (gpointer data)
+{
+  g_slice_free (SpiCacheEntry, data);
+}
+
+static void
+clear_snapshot (SpiCache * cache, SpiCacheEntry * entry)
+{
+  if (entry->snapshot && cache->snapshot_free)
+    (cache->snapshot_free) (entry->snapshot);
+  entry->snapshot = NULL;
+}
+
+static SpiCacheEntry *
+lookup_entry (SpiCache * cache, GObject * gobj)
+{
+  GSequenceIter *iter;
+
+  if (!g_hash_table_lookup_extended (cache->objects, gobj, NULL, (gpointer *) &iter))
+    return NULL;
+  return g_sequence_get (iter);
+}
+
+/*
+ * Moves an entry to a new generation, so that clients paging through
+ * the cache see it again.
+ */
+static void
+touch_entry (SpiCache * cache, GSequenceIter * iter)
+{
+  SpiCacheEntry *entry = g_sequence_get (iter);
+
+  entry->generation = ++cache->generation;
+  g_sequence_move (iter, g_sequence_get_end_iter (cache->order));
+}
+
+/*
+ * Records the removal of an object. Once the log is full the oldest
+ * half is dropped, and clients asking for removals from before that
+ * point are told to start again.
+ */
+static void
+log_removal (SpiCache * cache, GObject * gobj)
+{
+  SpiCacheRemoval removal;
+  guint drop;
+
+  removal.ref = spi_register_object_to_ref (gobj);
+  if (!removal.ref)
+    return;
+  removal.generation = ++cache->generation;
+
+  if (cache->removed->len >= SPI_CACHE_REMOVED_MAX)
+    {
+      drop = cache->removed->len / 2;
+      cache->removed_floor = g_array_index (cache->removed, SpiCacheRemoval,
+                                            drop - 1).generation;
+      g_array_remove_range (cache->removed, 0, drop);
+    }
+  g_array_append_val (cache->removed, removal);
+}
+
 static void
 remove_object (GObject * source, GObject * gobj, gpointer data)
 {
   SpiCache *cache = SPI_CACHE (data);
+  GSequenceIter *iter;
   
-  if (spi_cache_in (cache, gobj))
+  if (g_hash_table_lookup_extended (cache->objects, gobj, NULL, (gpointer *) &iter))
     {
 #ifdef SPI_ATK_DEBUG
   g_debug ("CACHE REM - %s - %d - %s\n", atk_object_get_name (ATK_OBJECT (gobj)),
             atk_object_get_role (ATK_OBJECT (gobj)),
             spi_register_object_to_path (spi_global_register, gobj));
 #endif
+      log_removal (cache, gobj);
       g_signal_emit (cache, cache_signals [OBJECT_REMOVED], 0, gobj);
+      clear_snapshot (cache, g_sequence_get (iter));
       g_hash_table_remove (cache->objects, gobj);
+      spi_cache_set_remove (cache->members, gobj);
+      g_sequence_remove (iter);
     }
 }
 
+/*
+ * Adds an object to the cache, or marks it as updated if it is
+ * already present, by moving it to the current generation.
+ */
 static void
 add_object (SpiCache * cache, GObject * gobj)
 {
+  SpiCacheEntry *entry;
+  GSequenceIter *iter;
+
   g_return_if_fail (G_IS_OBJECT (gobj));
 
-  g_hash_table_insert (cache->objects, gobj, NULL);
+  if (g_hash_table_lookup_extended (cache->objects, gobj, NULL, (gpointer *) &iter))
+    {
+      touch_entry (cache, iter);
+    }
+  else
+    {
+      entry = g_slice_new (SpiCacheEntry);
+      entry->object = gobj;
+      entry->generation = ++cache->generation;
+      entry->snapshot = NULL;
+
+      iter = g_sequence_append (cache->order, entry);
+      g_hash_table_insert (cache->objects, gobj, iter);
+      spi_cache_set_add (cache->members, gobj);
+    }
 
 #ifdef SPI_ATK_DEBUG
   g_debug ("CACHE ADD - %s - %d - %s\n", atk_object_get_name (ATK_OBJECT (gobj)),
@@ -252,24 +462,68 @@ add_subtree (SpiCache *cache, AtkObject * accessible)
 
   g_object_ref (accessible);
   g_queue_push_tail (cache->add_traversal, accessible);
-  add_pending_items (cache);
+  if (add_pending_slice (cache) && cache->add_pending_idle == 0)
+    cache->add_pending_idle = g_idle_add (add_pending_items, cache);
 }
 
+static gulong
+elapsed_us (gint64 start)
+{
+  return g_get_monotonic_time () - start;
+}
+
+static void
+record_slice (SpiCache * cache, gulong slice_us, guint nodes)
+{
+  cache->slice_count++;
+  cache->slice_last_us = slice_us;
+  cache->slice_total_us += slice_us;
+  if (slice_us > cache->slice_max_seen_us)
+    cache->slice_max_seen_us = slice_us;
+
+#ifdef SPI_ATK_DEBUG
+  g_debug ("AT-SPI: Cache slice %u - %u nodes in %lu us (max %lu us)",
+           cache->slice_count, nodes, slice_us, cache->slice_max_seen_us);
+#endif
+}
+
+/*
+ * Processes one slice of the add traversal.
+ *
+ * At most slice_max_nodes nodes are visited, and the slice ends early
+ * once slice_max_us has elapsed, though at least one node is always
+ * visited so that the traversal makes progress. The objects visited
+ * are added to the cache at the end of the slice, so parents are always
+ * added before their children.
+ *
+ * Returns TRUE if there is traversal work remaining.
+ */
 static gboolean
-add_pending_items (gpointer data)
+add_pending_slice (SpiCache * cache)
 {
-  SpiCache *cache = SPI_CACHE (data);
   AtkObject *current;
   GQueue *to_add;
+  gint64 start;
+  guint nodes = 0;
 
+  start = g_get_monotonic_time ();
   to_add = g_queue_new ();
 
   while (!g_queue_is_empty (cache->add_traversal))
     {
       AtkStateSet *set;
+
+      if (nodes > 0)
+        {
+          if (cache->slice_max_nodes && nodes >= cache->slice_max_nodes)
+            break;
+          if (cache->slice_max_us && elapsed_us (start) >= cache->slice_max_us)
+            break;
+        }
       
       current = g_queue_pop_head (cache->add_traversal);
       set = atk_object_ref_state_set (current);
+      nodes++;
 
       if (!atk_state_set_contains_state (set, ATK_STATE_TRANSIENT))
         {
@@ -292,6 +546,25 @@ add_pending_items (gpointer data)
     }
 
   g_queue_free (to_add);
+
+  record_slice (cache, elapsed_us (start), nodes);
+
+  return !g_queue_is_empty (cache->add_traversal);
+}
+
+/*
+ * Runs one slice of the add traversal from the idle source. Slices run
+ * directly by add_subtree and spi_cache_populate leave the source alone,
+ * so only this clears it, and there is never more than one.
+ */
+static gboolean
+add_pending_items (gpointer data)
+{
+  SpiCache *cache = SPI_CACHE (data);
+
+  if (add_pending_slice (cache))
+    return TRUE;
+
   cache->add_pending_idle = 0;
   return FALSE;
 }
@@ -403,16 +676,221 @@ spi_cache_foreach (SpiCache * cache, GHFunc func, gpointer data)
   g_hash_table_foreach (cache->objects, func, data);
 }
 
+/*
+ * Calls func for up to max_items cached objects that have been added or
+ * updated after the given generation, oldest first. A generation of 0
+ * visits the whole cache.
+ *
+ * Objects that func moves to a newer generation, for example by
+ * invalidating them, are not visited again by the same call.
+ *
+ * Returns the generation to pass in to continue from where this call
+ * stopped, or 0 if there are no more objects to visit.
+ *
+ * Objects removed since the given generation are reported by
+ * spi_cache_foreach_removed_since.
+ */
+guint
+spi_cache_foreach_since (SpiCache * cache,
+                         guint generation,
+                         guint max_items,
+                         GHFunc func,
+                         gpointer data)
+{
+  SpiCacheEntry *entry;
+  GSequenceIter *iter, *next;
+  gint lo, hi, mid;
+  guint count = 0;
+  guint last = 0;
+  guint newest = cache->generation;
+
+  /* Binary search for the first entry newer than generation */
+  lo = 0;
+  hi = g_sequence_get_length (cache->order);
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      entry = g_sequence_get (g_sequence_get_iter_at_pos (cache->order, mid));
+      if (entry->generation <= generation)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  iter = g_sequence_get_iter_at_pos (cache->order, lo);
+  while (!g_sequence_iter_is_end (iter) && count < max_items)
+    {
+      entry = g_sequence_get (iter);
+      if (entry->generation > newest)
+        return 0;
+      next = g_sequence_iter_next (iter);
+      last = entry->generation;
+      (func) (entry->object, iter, data);
+      count++;
+      iter = next;
+    }
+
+  if (g_sequence_iter_is_end (iter) ||
+      ((SpiCacheEntry *) g_sequence_get (iter))->generation > newest)
+    return 0;
+  return last;
+}
+
+/*
+ * Calls func with the register reference of each object removed from
+ * the cache after the given generation, oldest first.
+ *
+ * Returns FALSE, without calling func, if the removals from that far
+ * back are no longer known. The client must then fetch the whole cache
+ * again.
+ */
 gboolean
-spi_cache_in (SpiCache * cache, GObject * object)
+spi_cache_foreach_removed_since (SpiCache * cache,
+                                 guint generation,
+                                 GFunc func,
+                                 gpointer data)
 {
-  if (g_hash_table_lookup_extended (cache->objects,
-                                    object,
-                                    NULL,
-                                    NULL))
-    return TRUE;
-  else
+  SpiCacheRemoval *removal;
+  guint i;
+
+  if (generation < cache->removed_floor)
+    return FALSE;
+
+  for (i = 0; i < cache->removed->len; i++)
+    {
+      removal = &g_array_index (cache->removed, SpiCacheRemoval, i);
+      if (removal->generation > generation)
+        (func) (GUINT_TO_POINTER (removal->ref), data);
+    }
+  return TRUE;
+}
+
+guint
+spi_cache_get_generation (SpiCache * cache)
+{
+  return cache->generation;
+}
+
+/*
+ * Makes sure that the subtree at the given object is in the cache.
+ *
+ * This does nothing unless the cache is in lazy mode, where it is
+ * called when a client first asks for the object's children or for
+ * the cache contents. The traversal is time sliced in the same way
+ * as for any other subtree addition, so the objects may not all be
+ * in the cache when this returns.
+ */
+void
+spi_cache_populate (SpiCache * cache, GObject * object)
+{
+  AtkObject *accessible;
+  AtkStateSet *set;
+
+  if (!cache->lazy)
+    return;
+
+  g_return_if_fail (ATK_IS_OBJECT (object));
+  accessible = ATK_OBJECT (object);
+
+  if (g_hash_table_lookup_extended (cache->populated, object, NULL, NULL))
+    return;
+  g_hash_table_insert (cache->populated, object, NULL);
+  g_object_weak_ref (object, populated_object_gone, cache);
+
+  g_object_ref (accessible);
+  g_queue_push_tail (cache->add_traversal, accessible);
+
+  /*
+   * The traversal treats objects already in the cache as leaves,
+   * so their children must be queued here.
+   */
+  if (spi_cache_in (cache, object))
+    {
+      set = atk_object_ref_state_set (accessible);
+      if (!atk_state_set_contains_state (set, ATK_STATE_MANAGES_DESCENDANTS))
+        append_children (accessible, cache->add_traversal);
+      g_object_unref (set);
+    }
+
+  if (add_pending_slice (cache) && cache->add_pending_idle == 0)
+    cache->add_pending_idle = g_idle_add (add_pending_items, cache);
+}
+
+/*
+ * Returns the snapshot stored for a cached object, or NULL if there
+ * is none or the object has changed since it was stored.
+ */
+gpointer
+spi_cache_get_snapshot (SpiCache * cache, GObject * object)
+{
+  SpiCacheEntry *entry = lookup_entry (cache, object);
+
+  return entry ? entry->snapshot : NULL;
+}
+
+/*
+ * Stores a snapshot for a cached object, replacing any previous one.
+ * The cache frees it with snapshot_free when it is no longer valid.
+ *
+ * Returns FALSE, leaving the snapshot with the caller, if the object
+ * is not in the cache.
+ */
+gboolean
+spi_cache_store_snapshot (SpiCache * cache, GObject * object,
+                          gpointer snapshot)
+{
+  SpiCacheEntry *entry = lookup_entry (cache, object);
+
+  if (!entry)
     return FALSE;
+  clear_snapshot (cache, entry);
+  entry->snapshot = snapshot;
+  return TRUE;
+}
+
+/*
+ * Drops the snapshot of an object and moves it to a new generation,
+ * called when any of the object's cached data may have changed.
+ */
+void
+spi_cache_invalidate (SpiCache * cache, GObject * object)
+{
+  GSequenceIter *iter;
+
+  if (!g_hash_table_lookup_extended (cache->objects, object, NULL, (gpointer *) &iter))
+    return;
+  clear_snapshot (cache, g_sequence_get (iter));
+  touch_entry (cache, iter);
+}
+
+/* Fills in the durations of the add traversal slices run so far */
+void
+spi_cache_get_slice_stats (SpiCache * cache, SpiCacheSliceStats * stats)
+{
+  stats->count = cache->slice_count;
+  stats->last_us = cache->slice_last_us;
+  stats->max_us = cache->slice_max_seen_us;
+  stats->total_us = cache->slice_total_us;
+}
+
+void
+spi_cache_reset_slice_stats (SpiCache * cache)
+{
+  cache->slice_count = 0;
+  cache->slice_last_us = 0;
+  cache->slice_max_seen_us = 0;
+  cache->slice_total_us = 0;
+}
+
+/*
+ * Checks whether the object is in the cache. This takes no lock, so it
+ * may be used from other threads provided they do so within a read
+ * section on cache->members.
+ */
+gboolean
+spi_cache_in (SpiCache * cache, GObject * object)
+{
+  return spi_cache_set_contains (cache->members, object);
 }
 
 #ifdef SPI_ATK_DEBUG
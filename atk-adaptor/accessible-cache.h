@@ -26,8 +26,11 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "cache-set.h"
+
 typedef struct _SpiCache SpiCache;
 typedef struct _SpiCacheClass SpiCacheClass;
+typedef struct _SpiCacheSliceStats SpiCacheSliceStats;
 
 G_BEGIN_DECLS
 
@@ -42,8 +45,45 @@ struct _SpiCache
   GObject parent;
 
   GHashTable * objects;
+  GSequence * order;
+
+  /*
+   * The same objects, in a set that other threads may read without
+   * taking any lock, see cache-set.h.
+   */
+  SpiCacheSet *members;
+
+  /* Frees the per-object snapshots, see spi_cache_store_snapshot */
+  GDestroyNotify snapshot_free;
+  guint generation;
+
+  /* Recent removals, see spi_cache_foreach_removed_since */
+  GArray *removed;
+  guint removed_floor;
+
   GQueue *add_traversal;
   gint add_pending_idle;
+
+  /*
+   * In lazy mode only subtrees that a client has shown interest in
+   * are added to the cache. These are the roots of those subtrees,
+   * each held until the object is destroyed.
+   */
+  gboolean lazy;
+  GHashTable *populated;
+
+  /*
+   * Work budget for a single slice of the add traversal.
+   * A value of 0 means no limit.
+   */
+  guint slice_max_nodes;
+  guint slice_max_us;
+
+  /* Slice durations observed, in microseconds */
+  guint slice_count;
+  gulong slice_last_us;
+  gulong slice_max_seen_us;
+  guint64 slice_total_us;
 };
 
 struct _SpiCacheClass
@@ -51,6 +91,14 @@ struct _SpiCacheClass
   GObjectClass parent_class;
 };
 
+struct _SpiCacheSliceStats
+{
+  guint count;
+  gulong last_us;
+  gulong max_us;
+  guint64 total_us;
+};
+
 GType spi_cache_get_type (void);
 
 extern SpiCache *spi_global_cache;
@@ -58,8 +106,43 @@ extern SpiCache *spi_global_cache;
 void
 spi_cache_foreach (SpiCache * cache, GHFunc func, gpointer data);
 
+guint
+spi_cache_foreach_since (SpiCache * cache,
+                         guint generation,
+                         guint max_items,
+                         GHFunc func,
+                         gpointer data);
+
+gboolean
+spi_cache_foreach_removed_since (SpiCache * cache,
+                                 guint generation,
+                                 GFunc func,
+                                 gpointer data);
+
+guint
+spi_cache_get_generation (SpiCache * cache);
+
 gboolean
 spi_cache_in (SpiCache * cache, GObject * object);
 
+gpointer
+spi_cache_get_snapshot (SpiCache * cache, GObject * object);
+
+gboolean
+spi_cache_store_snapshot (SpiCache * cache, GObject * object,
+                          gpointer snapshot);
+
+void
+spi_cache_invalidate (SpiCache * cache, GObject * object);
+
+void
+spi_cache_populate (SpiCache * cache, GObject * object);
+
+void
+spi_cache_get_slice_stats (SpiCache * cache, SpiCacheSliceStats * stats);
+
+void
+spi_cache_reset_slice_stats (SpiCache * cache);
+
 G_END_DECLS
 #endif /* ACCESSIBLE_CACHE_H */
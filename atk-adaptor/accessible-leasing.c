@@ -34,17 +34,17 @@
 
 SpiLeasing *spi_global_leasing;
 
-typedef struct _ExpiryElement
+typedef struct _LeaseEntry
 {
-  guint expiry_s;
+  glong expiry_s;
   GObject *object;
-} ExpiryElement;
+} LeaseEntry;
 
 static void spi_leasing_dispose (GObject * object);
 
 static void spi_leasing_finalize (GObject * object);
 
-static void add_expiry_timeout (SpiLeasing * leasing);
+static gboolean expiry_func (gpointer data);
 
 /*---------------------------------------------------------------------------*/
 
@@ -60,11 +60,26 @@ static void spi_leasing_class_init (SpiLeasingClass * klass)
   object_class->dispose = spi_leasing_dispose;
 }
 
+static void
+free_lease (gpointer data)
+{
+  LeaseEntry *entry = data;
+
+  g_object_unref (entry->object);
+  g_slice_free (LeaseEntry, entry);
+}
+
 static void
 spi_leasing_init (SpiLeasing * leasing)
 {
-  leasing->expiry_queue = g_queue_new ();
+  GTimeVal t;
+
+  leasing->leases = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                           NULL, free_lease);
   leasing->expiry_func_id = 0;
+
+  g_get_current_time (&t);
+  leasing->rate_time_s = t.tv_sec;
 }
 
 static void
@@ -72,7 +87,7 @@ spi_leasing_finalize (GObject * object)
 {
   SpiLeasing *leasing = SPI_LEASING (object);
 
-  g_free (leasing->expiry_queue);
+  g_hash_table_destroy (leasing->leases);
   G_OBJECT_CLASS (spi_leasing_parent_class)->finalize (object);
 }
 
@@ -80,87 +95,117 @@ static void
 spi_leasing_dispose (GObject * object)
 {
   SpiLeasing *leasing = SPI_LEASING (object);
+  guint i;
+
+  if (leasing->expiry_func_id)
+    {
+      g_source_remove (leasing->expiry_func_id);
+      leasing->expiry_func_id = 0;
+    }
 
-  ExpiryElement *head;
-  while (head = g_queue_pop_head (leasing->expiry_queue))
+  for (i = 0; i < SPI_LEASING_WHEEL_SLOTS; i++)
     {
-      g_object_unref (head->object);
-      g_slice_free (ExpiryElement, head);
+      g_slist_free (leasing->wheel[i]);
+      leasing->wheel[i] = NULL;
     }
+  g_hash_table_remove_all (leasing->leases);
+
   G_OBJECT_CLASS (spi_leasing_parent_class)->dispose (object);
 }
 
 /*---------------------------------------------------------------------------*/
 
 /*
-  End the lease on all objects whose expiry time has passed.
- 
-  Check when the next event is and set the next expiry func.
+  Leases are kept on a wheel of one second slots, each lease sitting in
+  the slot for the second of its expiry time. A slot is visited once per
+  turn of the wheel, so every lease it holds is either due or has been
+  renewed since it was placed there.
+
+  Renewing a lease only updates its expiry time. The lease is moved to
+  its new slot when its old slot comes round.
 */
-static gboolean
-expiry_func (gpointer data)
+static void
+wheel_insert (SpiLeasing * leasing, LeaseEntry * entry)
 {
-  SpiLeasing *leasing = SPI_LEASING (data);
-
-  ExpiryElement *head, *current;
-  GTimeVal t;
+  guint slot = entry->expiry_s & (SPI_LEASING_WHEEL_SLOTS - 1);
 
-  g_get_current_time (&t);
-
-  head = g_queue_peek_head (leasing->expiry_queue);
-  while (head != NULL && head->expiry_s <= t.tv_sec)
-    {
-      current = g_queue_pop_head (leasing->expiry_queue);
-
-#ifdef SPI_ATK_DEBUG
-      g_debug ("REVOKE - ");
-      spi_cache_print_info (current->object);
-#endif
+  leasing->wheel[slot] = g_slist_prepend (leasing->wheel[slot], entry);
+}
 
-      g_object_unref (current->object);
-      g_slice_free (ExpiryElement, current);
+static void
+update_rates (SpiLeasing * leasing, glong now_s)
+{
+  glong elapsed = now_s - leasing->rate_time_s;
 
-      head = g_queue_peek_head (leasing->expiry_queue);
-    }
+  if (elapsed <= 0)
+    return;
 
-  leasing->expiry_func_id = 0;
-  add_expiry_timeout (leasing);
+  leasing->renewals_per_s =
+    (leasing->n_renewals - leasing->rate_renewals) / elapsed;
+  leasing->expirations_per_s =
+    (leasing->n_expirations - leasing->rate_expirations) / elapsed;
 
-  return FALSE;
+  leasing->rate_time_s = now_s;
+  leasing->rate_renewals = leasing->n_renewals;
+  leasing->rate_expirations = leasing->n_expirations;
 }
 
-/*---------------------------------------------------------------------------*/
-
 /*
-  Checks if an expiry timeout is already scheduled, if so returns.
-  This is becasue events will always be added to the end of the queue.
-  Events are always later in time to previoulsy added events.
-
-  Otherwise calculate the next wake time using the top of the queue
-  and add the next expiry function.
+  End the lease on all objects whose expiry time has passed, turning
+  the wheel on by one slot for every second since it was last run.
 
-  This function is called when a lease is added or at the end of the
-  expiry function to add the next expiry timeout.
+  Runs once a second for as long as there are leased objects.
 */
-static void
-add_expiry_timeout (SpiLeasing * leasing)
+static gboolean
+expiry_func (gpointer data)
 {
-  ExpiryElement *elem;
+  SpiLeasing *leasing = SPI_LEASING (data);
   GTimeVal t;
-  guint next_expiry;
 
-  if (leasing->expiry_func_id != 0)
-    return;
+  g_get_current_time (&t);
 
-  elem = (ExpiryElement *) g_queue_peek_head (leasing->expiry_queue);
-  if (elem == NULL)
-    return;
+  /* After a long stall each slot only needs to be visited once */
+  if (t.tv_sec - leasing->wheel_time_s > SPI_LEASING_WHEEL_SLOTS)
+    leasing->wheel_time_s = t.tv_sec - SPI_LEASING_WHEEL_SLOTS;
 
-  /* The current time is implicitly rounded down here by ignoring the us */
-  g_get_current_time (&t);
-  next_expiry = elem->expiry_s - t.tv_sec;
-  leasing->expiry_func_id = g_timeout_add_seconds (next_expiry,
-                                                   expiry_func, leasing);
+  while (leasing->wheel_time_s < t.tv_sec)
+    {
+      GSList *due, *l;
+      guint slot;
+
+      leasing->wheel_time_s++;
+      slot = leasing->wheel_time_s & (SPI_LEASING_WHEEL_SLOTS - 1);
+      due = leasing->wheel[slot];
+      leasing->wheel[slot] = NULL;
+
+      for (l = due; l; l = l->next)
+        {
+          LeaseEntry *entry = l->data;
+
+          if (entry->expiry_s > leasing->wheel_time_s)
+            {
+              wheel_insert (leasing, entry);
+              continue;
+            }
+
+#ifdef SPI_ATK_DEBUG
+          g_debug ("REVOKE - ");
+          spi_cache_print_info (entry->object);
+#endif
+          leasing->n_expirations++;
+          g_hash_table_remove (leasing->leases, entry->object);
+        }
+      g_slist_free (due);
+    }
+
+  update_rates (leasing, t.tv_sec);
+
+  if (g_hash_table_size (leasing->leases) == 0)
+    {
+      leasing->expiry_func_id = 0;
+      return FALSE;
+    }
+  return TRUE;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -175,31 +220,42 @@ add_expiry_timeout (SpiLeasing * leasing)
 #define LEASE_TIME_S 15
 #define EXPIRY_TIME_S (LEASE_TIME_S + 1)
 
+#if EXPIRY_TIME_S >= SPI_LEASING_WHEEL_SLOTS
+#error "The lease expiry wheel is shorter than the lease time"
+#endif
+
+/*
+  Leases the object, or extends its lease if it already holds one.
+*/
 GObject *
 spi_leasing_take (SpiLeasing * leasing, GObject * object)
 {
-  /*
-     Get the current time.
-     Quantize the time.
-     Add the release event to the queue.
-     Check the next expiry.
-   */
-
   GTimeVal t;
-  guint expiry_s;
-
-  ExpiryElement *elem;
+  LeaseEntry *entry;
 
   g_get_current_time (&t);
-  expiry_s = t.tv_sec + EXPIRY_TIME_S;
 
-  elem = g_slice_new (ExpiryElement);
-  elem->expiry_s = expiry_s;
-  elem->object = g_object_ref (object);
+  entry = g_hash_table_lookup (leasing->leases, object);
+  if (entry)
+    {
+      entry->expiry_s = t.tv_sec + EXPIRY_TIME_S;
+      leasing->n_renewals++;
+      return object;
+    }
+
+  /* The wheel is idle when there are no leases, so bring it up to date */
+  if (leasing->expiry_func_id == 0)
+    leasing->wheel_time_s = t.tv_sec;
+
+  entry = g_slice_new (LeaseEntry);
+  entry->expiry_s = t.tv_sec + EXPIRY_TIME_S;
+  entry->object = g_object_ref (object);
 
-  g_queue_push_tail (leasing->expiry_queue, elem);
+  g_hash_table_insert (leasing->leases, object, entry);
+  wheel_insert (leasing, entry);
 
-  add_expiry_timeout (leasing);
+  if (leasing->expiry_func_id == 0)
+    leasing->expiry_func_id = g_timeout_add_seconds (1, expiry_func, leasing);
 
 #ifdef SPI_ATK_DEBUG
   g_debug ("LEASE - ");
@@ -209,4 +265,36 @@ spi_leasing_take (SpiLeasing * leasing, GObject * object)
   return object;
 }
 
+/*
+  Fills in the lease counters. The rates are averaged over the time
+  since they were last computed, which is at most a second while any
+  objects are leased.
+*/
+void
+spi_leasing_get_stats (SpiLeasing * leasing, SpiLeasingStats * stats)
+{
+  GTimeVal t;
+
+  g_get_current_time (&t);
+  update_rates (leasing, t.tv_sec);
+
+  stats->active = g_hash_table_size (leasing->leases);
+  stats->renewals = leasing->n_renewals;
+  stats->expirations = leasing->n_expirations;
+  stats->renewals_per_s = leasing->renewals_per_s;
+  stats->expirations_per_s = leasing->expirations_per_s;
+}
+
+/* Zeroes the renewal and expiry totals, and the rates with them */
+void
+spi_leasing_reset_stats (SpiLeasing * leasing)
+{
+  leasing->n_renewals = 0;
+  leasing->n_expirations = 0;
+  leasing->rate_renewals = 0;
+  leasing->rate_expirations = 0;
+  leasing->renewals_per_s = 0;
+  leasing->expirations_per_s = 0;
+}
+
 /*END------------------------------------------------------------------------*/
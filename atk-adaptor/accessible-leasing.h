@@ -38,12 +38,41 @@ G_BEGIN_DECLS
 #define SPI_IS_LEASING(o)       (G_TYPE_CHECK__INSTANCE_TYPE ((o), SPI_LEASING_TYPE))
 #define SPI_IS_LEASING_CLASS(k) (G_TYPE_CHECK_CLASS_TYPE ((k), SPI_LEASING_TYPE))
 
+/*
+ * Number of one second slots in the expiry wheel. This must be a
+ * power of two and longer than the lease time.
+ */
+#define SPI_LEASING_WHEEL_SLOTS 32
+
+typedef struct _SpiLeasingStats SpiLeasingStats;
+
 struct _SpiLeasing
 {
   GObject parent;
 
-  GQueue *expiry_queue;
+  /* Leased objects and their expiry times, one entry per object */
+  GHashTable *leases;
+  GSList *wheel[SPI_LEASING_WHEEL_SLOTS];
+  glong wheel_time_s;
   guint expiry_func_id;
+
+  guint n_renewals;
+  guint n_expirations;
+
+  glong rate_time_s;
+  guint rate_renewals;
+  guint rate_expirations;
+  guint renewals_per_s;
+  guint expirations_per_s;
+};
+
+struct _SpiLeasingStats
+{
+  guint active;
+  guint renewals;
+  guint expirations;
+  guint renewals_per_s;
+  guint expirations_per_s;
 };
 
 struct _SpiLeasingClass
@@ -57,5 +86,9 @@ extern SpiLeasing *spi_global_leasing;
 
 GObject *spi_leasing_take (SpiLeasing * leasing, GObject * object);
 
+void spi_leasing_get_stats (SpiLeasing * leasing, SpiLeasingStats * stats);
+
+void spi_leasing_reset_stats (SpiLeasing * leasing);
+
 G_END_DECLS
 #endif /* ACCESSIBLE_LEASING_H */
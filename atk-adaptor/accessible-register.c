@@ -37,13 +37,13 @@
  * path for it. The D-Bus object paths used have a standard prefix
  * (SPI_ATK_OBJECT_PATH_PREFIX). Appended to this prefix is a string
  * representation of an integer reference. So to access an AtkObject 
- * remotely we keep a Hashtable that maps the given reference to 
- * the AtkObject pointer. An object in this hash table is said to be 'registered'.
+ * remotely we keep a table that maps the given reference to 
+ * the AtkObject pointer. An object in this table is said to be 'registered'.
  *
  * The architecture of AT-SPI dbus is such that AtkObjects are not
  * remotely reference counted. This means that we need to keep track of
  * object destruction. When an object is destroyed it must be 'deregistered'
- * To do this lookup we keep a dbus-id attribute on each AtkObject.
+ * To do this lookup the same table maps each AtkObject back to its reference.
  *
  */
 
@@ -51,10 +51,6 @@
 #define SPI_ATK_OBJECT_PATH_PREFIX  "/org/a11y/atspi/accessible/"
 #define SPI_ATK_OBJECT_PATH_ROOT "root"
 
-#define SPI_ATK_OBJECT_REFERENCE_TEMPLATE SPI_ATK_OBJECT_PATH_PREFIX "%d"
-
-#define SPI_DBUS_ID "spi-dbus-id"
-
 SpiRegister *spi_global_register = NULL;
 
 static const gchar * spi_register_root_path = SPI_ATK_OBJECT_PATH_PREFIX SPI_ATK_OBJECT_PATH_ROOT;
@@ -116,8 +112,7 @@ static void spi_register_class_init (SpiRegisterClass * klass)
 static void
 spi_register_init (SpiRegister * reg)
 {
-  reg->ref2ptr = g_hash_table_new (g_direct_hash, g_direct_equal);
-  reg->reference_counter = 0;
+  reg->table = spi_ref_table_new ();
 }
 
 static void
@@ -125,7 +120,7 @@ spi_register_finalize (GObject * object)
 {
   SpiRegister *reg = SPI_REGISTER (object);
 
-  g_free (reg->ref2ptr);
+  spi_ref_table_free (reg->table);
 
   G_OBJECT_CLASS (spi_register_parent_class)->finalize (object);
 }
@@ -141,41 +136,69 @@ spi_register_dispose (GObject * object)
 /*---------------------------------------------------------------------------*/
 
 /*
- * Each AtkObject must be asssigned a D-Bus path (Reference)
- *
- * This function provides an integer reference for a new
- * AtkObject.
- *
- * TODO: Make this reference a little more unique, this is shoddy.
+ * Returns the reference of the object, or 0 if it is not registered.
  */
 static guint
-assign_reference (SpiRegister * reg)
+object_to_ref (SpiRegister * reg, GObject * gobj)
 {
-  reg->reference_counter++;
-  /* Reference of 0 not allowed as used as direct key in hash table */
-  if (reg->reference_counter == 0)
-    reg->reference_counter++;
-  return reg->reference_counter;
+  return spi_ref_table_lookup_ref (reg->table, gobj);
 }
 
-/*---------------------------------------------------------------------------*/
-
 /*
- * Returns the reference of the object, or 0 if it is not registered.
+ * Writes the D-Bus object path for the reference into buf,
+ * without allocating.
  */
-static guint
-object_to_ref (GObject * gobj)
+static const gchar *
+ref_to_path_into (guint ref, gchar * buf)
 {
-  return GPOINTER_TO_INT (g_object_get_data (gobj, SPI_DBUS_ID));
+  gchar digits[10];
+  gchar *p;
+  gint n = 0;
+
+  memcpy (buf, SPI_ATK_OBJECT_PATH_PREFIX, SPI_ATK_PATH_PREFIX_LENGTH);
+  p = buf + SPI_ATK_PATH_PREFIX_LENGTH;
+
+  do
+    {
+      digits[n++] = '0' + (ref % 10);
+      ref /= 10;
+    }
+  while (ref);
+
+  while (n)
+    *p++ = digits[--n];
+  *p = '\0';
+
+  return buf;
 }
 
 /*
- * Converts the Accessible object reference to its D-Bus object path
+ * Parses the reference at the end of an object path.
+ *
+ * Returns 0, which is never a valid reference, if the string is
+ * not entirely made up of decimal digits or does not fit in a guint.
  */
-static gchar *
-ref_to_path (guint ref)
+static guint
+path_to_ref (const gchar * s)
 {
-  return g_strdup_printf (SPI_ATK_OBJECT_REFERENCE_TEMPLATE, ref);
+  guint ref = 0;
+
+  if (*s == '\0')
+    return 0;
+
+  for (; *s; s++)
+    {
+      guint digit;
+
+      if (*s < '0' || *s > '9')
+        return 0;
+      digit = *s - '0';
+      if (ref > G_MAXUINT / 10 ||
+          (ref == G_MAXUINT / 10 && digit > G_MAXUINT % 10))
+        return 0;
+      ref = ref * 10 + digit;
+    }
+  return ref;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -192,14 +215,14 @@ deregister_object (gpointer data, GObject * gobj)
   SpiRegister *reg = SPI_REGISTER (data);
   guint ref;
 
-  ref = object_to_ref (gobj);
+  ref = object_to_ref (reg, gobj);
   if (ref != 0)
     {
       g_signal_emit (reg,
                      register_signals [OBJECT_DEREGISTERED],
                      0,
                      gobj);
-      g_hash_table_remove (reg->ref2ptr, GINT_TO_POINTER (ref));
+      spi_ref_table_remove (reg->table, gobj);
 
 #ifdef SPI_ATK_DEBUG
       g_debug ("DEREG  - %d", ref);
@@ -213,10 +236,13 @@ register_object (SpiRegister * reg, GObject * gobj)
   guint ref;
   g_return_if_fail (G_IS_OBJECT (gobj));
 
-  ref = assign_reference (reg);
+  ref = spi_ref_table_insert (reg->table, gobj);
+  if (!ref)
+    {
+      g_warning ("AT-SPI: Object register is full");
+      return;
+    }
 
-  g_hash_table_insert (reg->ref2ptr, GINT_TO_POINTER (ref), gobj);
-  g_object_set_data (G_OBJECT (gobj), SPI_DBUS_ID, GINT_TO_POINTER (ref));
   g_object_weak_ref (G_OBJECT (gobj), deregister_object, reg);
 
 #ifdef SPI_ATK_DEBUG
@@ -236,8 +262,7 @@ register_object (SpiRegister * reg, GObject * gobj)
 GObject *
 spi_register_path_to_object (SpiRegister * reg, const char *path)
 {
-  guint index;
-  void *data;
+  guint ref;
 
   g_return_val_if_fail (path, NULL);
 
@@ -251,12 +276,8 @@ spi_register_path_to_object (SpiRegister * reg, const char *path)
   if (!g_strcmp0 (SPI_ATK_OBJECT_PATH_ROOT, path))
     return G_OBJECT (spi_global_app_data->root);
 
-  index = atoi (path);
-  data = g_hash_table_lookup (reg->ref2ptr, GINT_TO_POINTER (index));
-  if (data)
-    return G_OBJECT(data);
-  else
-    return NULL;
+  ref = path_to_ref (path);
+  return (GObject *) spi_ref_table_lookup_object (reg->table, ref);
 }
 
 GObject *
@@ -265,6 +286,16 @@ spi_global_register_path_to_object (const char * path)
   return spi_register_path_to_object (spi_global_register, path);
 }
 
+/*
+ * Returns the object for a reference, or NULL if it has since been
+ * deregistered.
+ */
+GObject *
+spi_register_ref_to_object (SpiRegister * reg, guint ref)
+{
+  return (GObject *) spi_ref_table_lookup_object (reg->table, ref);
+}
+
 /*
  * Used to lookup a D-Bus path from the GObject.
  * 
@@ -273,6 +304,23 @@ spi_global_register_path_to_object (const char * path)
  */
 gchar *
 spi_register_object_to_path (SpiRegister * reg, GObject * gobj)
+{
+  gchar buf[SPI_REGISTER_PATH_MAX];
+
+  return g_strdup (spi_register_object_path_into (reg, gobj, buf));
+}
+
+/*
+ * As spi_register_object_to_path, but writes the path into the
+ * caller's buffer rather than allocating.
+ *
+ * Returns either buf or a static string for the root object,
+ * or NULL if the object could not be registered.
+ */
+const gchar *
+spi_register_object_path_into (SpiRegister * reg,
+                               GObject * gobj,
+                               gchar buf[SPI_REGISTER_PATH_MAX])
 {
   guint ref;
 
@@ -281,25 +329,49 @@ spi_register_object_to_path (SpiRegister * reg, GObject * gobj)
 
   /* Map the root object to the root path. */
   if ((void *)gobj == (void *)spi_global_app_data->root)
-    return g_strdup (spi_register_root_path);
+    return spi_register_root_path;
 
-  ref = object_to_ref (gobj);
+  ref = spi_register_object_ensure_ref (reg, gobj);
+  if (!ref)
+    return NULL;
+  else
+    return ref_to_path_into (ref, buf);
+}
+
+/*
+ * Returns the reference for the object, registering it first if it
+ * is not yet registered, or 0 if it could not be registered.
+ *
+ * Unlike the paths, this makes no exception for the root object.
+ */
+guint
+spi_register_object_ensure_ref (SpiRegister * reg, GObject * gobj)
+{
+  guint ref;
+
+  ref = object_to_ref (reg, gobj);
   if (!ref)
     {
       register_object (reg, gobj);
-      ref = object_to_ref (gobj);
+      ref = object_to_ref (reg, gobj);
     }
+  return ref;
+}
 
-  if (!ref)
-    return NULL;
-  else
-    return ref_to_path (ref);
+/*
+ * Writes the object path for a reference previously returned by
+ * spi_register_object_to_ref. The object need no longer exist.
+ */
+const gchar *
+spi_register_ref_path_into (guint ref, gchar buf[SPI_REGISTER_PATH_MAX])
+{
+  return ref_to_path_into (ref, buf);
 }
 
 guint
 spi_register_object_to_ref (GObject * gobj)
 {
-  return object_to_ref (gobj);
+  return object_to_ref (spi_global_register, gobj);
 }
   
 /*
@@ -27,6 +27,8 @@
 #include <glib.h>
 #include <glib-object.h>
 
+#include "reference-table.h"
+
 typedef struct _SpiRegister SpiRegister;
 typedef struct _SpiRegisterClass SpiRegisterClass;
 
@@ -42,8 +44,7 @@ struct _SpiRegister
 {
   GObject parent;
 
-  GHashTable * ref2ptr;
-  guint reference_counter;
+  SpiRefTable * table;
 };
 
 struct _SpiRegisterClass
@@ -57,17 +58,37 @@ extern SpiRegister *spi_global_register;
 
 /*---------------------------------------------------------------------------*/
 
+/*
+ * Size of a buffer large enough to hold any object path
+ * produced by spi_register_object_path_into.
+ */
+#define SPI_REGISTER_PATH_MAX 48
+
 GObject *
 spi_register_path_to_object (SpiRegister * reg, const char *path);
 
 GObject *
 spi_global_register_path_to_object (const char * path);
 
+GObject *
+spi_register_ref_to_object (SpiRegister * reg, guint ref);
+
 gchar *
 spi_register_object_to_path (SpiRegister * reg, GObject * gobj);
 
+const gchar *
+spi_register_object_path_into (SpiRegister * reg,
+                               GObject * gobj,
+                               gchar buf[SPI_REGISTER_PATH_MAX]);
+
+const gchar *
+spi_register_ref_path_into (guint ref, gchar buf[SPI_REGISTER_PATH_MAX]);
+
 guint
 spi_register_object_to_ref (GObject * gobj);
+
+guint
+spi_register_object_ensure_ref (SpiRegister * reg, GObject * gobj);
   
 gchar *
 spi_register_root_object_path ();
@@ -27,6 +27,7 @@
 
 #include "common/spi-dbus.h"
 #include "common/spi-stateset.h"
+#include "accessible-cache.h"
 #include "object.h"
 #include "introspection.h"
 
@@ -212,6 +213,7 @@ impl_GetChildren (DBusConnection * bus,
 
   g_return_val_if_fail (ATK_IS_OBJECT (user_data),
                         droute_not_yet_handled_error (message));
+  spi_cache_populate (spi_global_cache, G_OBJECT (object));
   count = atk_object_get_n_accessible_children (object);
   reply = dbus_message_new_method_return (message);
   if (!reply)
@@ -44,5 +44,11 @@ void spi_initialize_table (DRoutePath * path);
 void spi_initialize_text (DRoutePath * path);
 void spi_initialize_value (DRoutePath * path);
 void spi_initialize_cache (DRoutePath * path);
+void spi_initialize_stats (DRoutePath * path);
+
+void spi_stats_dump (void);
+
+guint spi_cache_adaptor_signals_saved (void);
+void spi_cache_adaptor_reset_signals_saved (void);
 
 #endif /* ADAPTORS_H */
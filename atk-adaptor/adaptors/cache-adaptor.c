@@ -30,7 +30,9 @@
 
 #include "common/spi-dbus.h"
 #include "accessible-cache.h"
+#include "accessible-register.h"
 #include "bridge.h"
+#include "event.h"
 #include "object.h"
 #include "introspection.h"
 
@@ -39,6 +41,9 @@
 #define SPI_CACHE_OBJECT_SUFFIX "/cache"
 #define SPI_CACHE_OBJECT_PATH SPI_OBJECT_PREFIX SPI_CACHE_OBJECT_SUFFIX
 
+#define SPI_CACHE_DEFAULT_PAGE_SIZE 500
+#define SPI_CACHE_MAX_PAGE_SIZE     5000
+
 #define SPI_OBJECT_REFERENCE_SIGNATURE "(" \
                                           DBUS_TYPE_STRING_AS_STRING \
                                           DBUS_TYPE_OBJECT_PATH_AS_STRING \
@@ -59,6 +64,26 @@
                                      DBUS_TYPE_UINT32_AS_STRING \
                                  ")"
 
+/*
+ * The compact cache item. References are to objects in the same
+ * application, see compact_reference, and the name and
+ * description are indices into the string table sent with the items.
+ * The format is (uuauuuuuau), in order the object, parent, children,
+ * interface bitmask, name, role, description and state set.
+ */
+#define SPI_CACHE_COMPACT_ITEM_SIGNATURE "(" \
+                                           DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_ARRAY_AS_STRING \
+                                             DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_UINT32_AS_STRING \
+                                           DBUS_TYPE_ARRAY_AS_STRING \
+                                             DBUS_TYPE_UINT32_AS_STRING \
+                                         ")"
+
 /*---------------------------------------------------------------------------*/
 
 /*
@@ -66,9 +91,12 @@
  *
  * The object is marshalled including all its client side cache data.
  * The format of the structure is (o(so)a(so)assusau).
+ *
+ * This queries everything from ATK, see append_cache_item for the
+ * usual case where a snapshot can be used.
  */
 static void
-append_cache_item (AtkObject * obj, gpointer data)
+append_cache_item_full (AtkObject * obj, gpointer data)
 {
   DBusMessageIter iter_struct, iter_sub_array;
   dbus_uint32_t states[2];
@@ -219,6 +247,230 @@ append_cache_item (AtkObject * obj, gpointer data)
 
 /*---------------------------------------------------------------------------*/
 
+/*
+ * The parts of a cache item that only change along with an ATK
+ * property-change, state-change or children-changed signal. They are
+ * kept with the cache entry, and dropped by the event listeners, so
+ * that resending an unchanged item does not query ATK again.
+ */
+typedef struct _CacheItemSnapshot
+{
+  dbus_uint32_t role;
+  dbus_uint32_t interfaces;
+  dbus_uint32_t states[2];
+  gchar *name;
+  gchar *description;
+  guint n_children;
+  guint *children;              /* Register references, 0 if missing */
+} CacheItemSnapshot;
+
+static void
+snapshot_free (gpointer data)
+{
+  CacheItemSnapshot *snapshot = data;
+
+  g_free (snapshot->name);
+  g_free (snapshot->description);
+  g_free (snapshot->children);
+  g_slice_free (CacheItemSnapshot, snapshot);
+}
+
+static CacheItemSnapshot *
+snapshot_new (AtkObject * obj)
+{
+  CacheItemSnapshot *snapshot = g_slice_new (CacheItemSnapshot);
+  AtkStateSet *set = atk_object_ref_state_set (obj);
+
+  snapshot->role = spi_accessible_role_from_atk_role (atk_object_get_role (obj));
+  snapshot->interfaces = spi_object_get_interface_mask (obj);
+  spi_atk_state_set_to_dbus_array (set, snapshot->states);
+  snapshot->name = g_strdup (atk_object_get_name (obj));
+  snapshot->description = g_strdup (atk_object_get_description (obj));
+
+  snapshot->n_children = 0;
+  snapshot->children = NULL;
+  if (!atk_state_set_contains_state (set, ATK_STATE_MANAGES_DESCENDANTS))
+    {
+      gint childcount, i;
+
+      childcount = atk_object_get_n_accessible_children (obj);
+      if (childcount > 0)
+        {
+          snapshot->children = g_new (guint, childcount);
+          snapshot->n_children = childcount;
+        }
+      for (i = 0; i < childcount; i++)
+        {
+          AtkObject *child = atk_object_ref_accessible_child (obj, i);
+
+          snapshot->children[i] = 0;
+          if (child)
+            {
+              snapshot->children[i] =
+                spi_register_object_ensure_ref (spi_global_register,
+                                                G_OBJECT (child));
+              g_object_unref (child);
+            }
+        }
+    }
+
+  g_object_unref (set);
+  return snapshot;
+}
+
+/*
+ * A child that has gone away without a children-changed signal makes
+ * the snapshot unusable.
+ */
+static gboolean
+snapshot_is_current (CacheItemSnapshot * snapshot)
+{
+  guint i;
+
+  for (i = 0; i < snapshot->n_children; i++)
+    if (snapshot->children[i] &&
+        !spi_register_ref_to_object (spi_global_register, snapshot->children[i]))
+      return FALSE;
+  return TRUE;
+}
+
+/*
+ * Returns the snapshot for the object, making a new one if need be.
+ * If the object is not in the cache the snapshot can not be kept, and
+ * owned is set to tell the caller to free it.
+ */
+static CacheItemSnapshot *
+get_snapshot (AtkObject * obj, gboolean * owned)
+{
+  CacheItemSnapshot *snapshot;
+
+  *owned = FALSE;
+  snapshot = spi_cache_get_snapshot (spi_global_cache, G_OBJECT (obj));
+  if (snapshot)
+    {
+      if (snapshot_is_current (snapshot))
+        return snapshot;
+      /* The item has changed, so paging clients must be sent it again */
+      spi_cache_invalidate (spi_global_cache, G_OBJECT (obj));
+    }
+
+  snapshot = snapshot_new (obj);
+  if (!spi_cache_store_snapshot (spi_global_cache, G_OBJECT (obj), snapshot))
+    *owned = TRUE;
+  return snapshot;
+}
+
+static void
+append_child_reference (DBusMessageIter * iter, guint ref)
+{
+  DBusMessageIter iter_struct;
+  GObject *child = NULL;
+  const gchar *name, *path;
+  gchar buf[SPI_REGISTER_PATH_MAX];
+
+  if (ref)
+    child = spi_register_ref_to_object (spi_global_register, ref);
+  if (!child)
+    {
+      spi_object_append_null_reference (iter);
+      return;
+    }
+
+  spi_object_lease_if_needed (child);
+
+  name = dbus_bus_get_unique_name (spi_global_app_data->bus);
+  path = spi_register_ref_path_into (ref, buf);
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
+  dbus_message_iter_close_container (iter, &iter_struct);
+}
+
+/*
+ * Plugs and sockets refer to objects in other applications. They are
+ * always marshalled in full, and can not be sent as compact references.
+ */
+static gboolean
+needs_full_item (AtkObject * obj)
+{
+  if (ATK_IS_PLUG (obj) && atk_object_get_parent (obj) == NULL)
+    return TRUE;
+  if (ATK_IS_SOCKET (obj) && atk_socket_is_occupied (ATK_SOCKET (obj)))
+    return TRUE;
+  return FALSE;
+}
+
+/*
+ * Marshals the given AtkObject into the provided D-Bus iterator, in the
+ * same format as append_cache_item_full but from the object's snapshot.
+ */
+static void
+append_cache_item (AtkObject * obj, gpointer data)
+{
+  DBusMessageIter iter_struct, iter_sub_array;
+  DBusMessageIter *iter_array = (DBusMessageIter *) data;
+  CacheItemSnapshot *snapshot;
+  AtkObject *parent;
+  const char *str;
+  gboolean owned;
+  guint i;
+
+  if (needs_full_item (obj))
+    {
+      append_cache_item_full (obj, data);
+      return;
+    }
+
+  snapshot = get_snapshot (obj, &owned);
+
+  dbus_message_iter_open_container (iter_array, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+
+  spi_object_append_reference (&iter_struct, obj);
+  spi_object_append_reference (&iter_struct, spi_global_app_data->root);
+
+  parent = atk_object_get_parent (obj);
+  if (parent)
+    spi_object_append_reference (&iter_struct, parent);
+  else if (snapshot->role == Accessibility_ROLE_APPLICATION)
+    spi_object_append_desktop_reference (&iter_struct);
+  else
+    spi_object_append_null_reference (&iter_struct);
+
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "(so)",
+                                    &iter_sub_array);
+  for (i = 0; i < snapshot->n_children; i++)
+    append_child_reference (&iter_sub_array, snapshot->children[i]);
+  dbus_message_iter_close_container (&iter_struct, &iter_sub_array);
+
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "s",
+                                    &iter_sub_array);
+  spi_object_append_interface_mask (&iter_sub_array, snapshot->interfaces);
+  dbus_message_iter_close_container (&iter_struct, &iter_sub_array);
+
+  str = snapshot->name ? snapshot->name : "";
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &str);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &snapshot->role);
+  str = snapshot->description ? snapshot->description : "";
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &str);
+
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "u",
+                                    &iter_sub_array);
+  for (i = 0; i < 2; i++)
+    dbus_message_iter_append_basic (&iter_sub_array, DBUS_TYPE_UINT32,
+                                    &snapshot->states[i]);
+  dbus_message_iter_close_container (&iter_struct, &iter_sub_array);
+
+  dbus_message_iter_close_container (iter_array, &iter_struct);
+
+  if (owned)
+    snapshot_free (snapshot);
+}
+
+/*---------------------------------------------------------------------------*/
+
 /* For use as a GHFunc */
 static void
 append_accessible_hf (gpointer key, gpointer obj_data, gpointer data)
@@ -230,8 +482,155 @@ append_accessible_hf (gpointer key, gpointer obj_data, gpointer data)
 
 /*---------------------------------------------------------------------------*/
 
+typedef struct _CompactContext
+{
+  DBusMessageIter *iter_array;
+
+  /* Interned strings, mapped to their index in the string table */
+  GHashTable *strings;
+  GPtrArray *string_table;
+
+  /* Objects with references to other applications */
+  GSList *full_items;
+} CompactContext;
+
+static dbus_uint32_t
+intern_string (CompactContext * ctx, const gchar * str)
+{
+  gpointer index;
+  gchar *copy;
+
+  if (!str)
+    str = "";
+
+  if (g_hash_table_lookup_extended (ctx->strings, str, NULL, &index))
+    return GPOINTER_TO_UINT (index);
+
+  copy = g_strdup (str);
+  index = GUINT_TO_POINTER (ctx->string_table->len);
+  g_ptr_array_add (ctx->string_table, copy);
+  g_hash_table_insert (ctx->strings, copy, index);
+  return GPOINTER_TO_UINT (index);
+}
+
+static dbus_uint32_t
+compact_reference (AtkObject * obj)
+{
+  if (obj == NULL)
+    return SPI_CACHE_COMPACT_REF_NULL;
+  if (obj == spi_global_app_data->root)
+    return SPI_CACHE_COMPACT_REF_ROOT;
+
+  spi_object_lease_if_needed (G_OBJECT (obj));
+  return spi_register_object_ensure_ref (spi_global_register, G_OBJECT (obj));
+}
+
+/*
+ * Marshals the given AtkObject as a compact cache item, or defers it
+ * to the full items if it can not be.
+ */
 static void
-emit_cache_remove (SpiCache *cache, GObject * obj)
+append_compact_item (AtkObject * obj, CompactContext * ctx)
+{
+  DBusMessageIter iter_struct, iter_sub_array;
+  CacheItemSnapshot *snapshot;
+  dbus_uint32_t value;
+  AtkObject *parent;
+  gboolean owned;
+  guint i;
+
+  if (needs_full_item (obj))
+    {
+      ctx->full_items = g_slist_prepend (ctx->full_items, g_object_ref (obj));
+      return;
+    }
+
+  snapshot = get_snapshot (obj, &owned);
+  dbus_message_iter_open_container (ctx->iter_array, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+
+  value = compact_reference (obj);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &value);
+
+  parent = atk_object_get_parent (obj);
+  if (parent == NULL && snapshot->role == Accessibility_ROLE_APPLICATION)
+    value = SPI_CACHE_COMPACT_REF_DESKTOP;
+  else
+    value = compact_reference (parent);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &value);
+
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "u",
+                                    &iter_sub_array);
+  for (i = 0; i < snapshot->n_children; i++)
+    {
+      GObject *child = NULL;
+
+      value = snapshot->children[i];
+      if (value)
+        child = spi_register_ref_to_object (spi_global_register, value);
+      if (child)
+        spi_object_lease_if_needed (child);
+      else
+        value = SPI_CACHE_COMPACT_REF_NULL;
+      dbus_message_iter_append_basic (&iter_sub_array, DBUS_TYPE_UINT32,
+                                      &value);
+    }
+  dbus_message_iter_close_container (&iter_struct, &iter_sub_array);
+
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32,
+                                  &snapshot->interfaces);
+
+  value = intern_string (ctx, snapshot->name);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &value);
+
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32,
+                                  &snapshot->role);
+
+  value = intern_string (ctx, snapshot->description);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &value);
+
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "u",
+                                    &iter_sub_array);
+  for (i = 0; i < 2; i++)
+    dbus_message_iter_append_basic (&iter_sub_array, DBUS_TYPE_UINT32,
+                                    &snapshot->states[i]);
+  dbus_message_iter_close_container (&iter_struct, &iter_sub_array);
+
+  dbus_message_iter_close_container (ctx->iter_array, &iter_struct);
+
+  if (owned)
+    snapshot_free (snapshot);
+}
+
+/* For use as a GHFunc */
+static void
+append_compact_hf (gpointer key, gpointer obj_data, gpointer data)
+{
+  if (ATK_IS_OBJECT (key))
+    append_compact_item (ATK_OBJECT (key), data);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Cache signals are sent one per object, as AddAccessible and
+ * RemoveAccessible, unless batching has been enabled. Then additions and
+ * removals are queued and flushed from an idle handler as a single
+ * AddAccessibles or RemoveAccessibles signal.
+ *
+ * A queued addition holds a reference on the object until it is sent.
+ * An object that is both added and removed within the same batch is never
+ * announced to clients.
+ */
+static GQueue     *pending_adds     = NULL;
+static GHashTable *pending_add_set  = NULL;
+static GArray     *pending_removes  = NULL;
+static guint       pending_flush_id = 0;
+
+static guint signals_saved = 0;
+
+static void
+emit_cache_remove_single (GObject * obj)
 {
   DBusMessage *message;
 
@@ -240,22 +639,20 @@ emit_cache_remove (SpiCache *cache, GObject * obj)
                                           "RemoveAccessible")))
     {
       DBusMessageIter iter;
-      gchar *path;
 
       dbus_message_iter_init_append (message, &iter);
 
       spi_object_append_reference (&iter, ATK_OBJECT (obj));
 
-      dbus_connection_send (spi_global_app_data->bus, message, NULL);
+      droute_send (spi_global_app_data->droute, message);
 
       dbus_message_unref (message);
     }
 }
 
 static void
-emit_cache_add (SpiCache *cache, GObject * obj)
+emit_cache_add_single (GObject * obj)
 {
-  AtkObject *accessible = ATK_OBJECT (obj);
   DBusMessage *message;
 
   if ((message = dbus_message_new_signal (SPI_CACHE_OBJECT_PATH,
@@ -265,14 +662,184 @@ emit_cache_add (SpiCache *cache, GObject * obj)
       DBusMessageIter iter;
 
       dbus_message_iter_init_append (message, &iter);
-      append_cache_item (accessible, &iter);
+      append_cache_item (ATK_OBJECT (obj), &iter);
+
+      droute_send (spi_global_app_data->droute, message);
+
+      dbus_message_unref (message);
+    }
+}
+
+static void
+flush_pending_removes (void)
+{
+  DBusMessage *message;
+  guint i;
+
+  if (pending_removes->len == 0)
+    return;
+
+  if ((message = dbus_message_new_signal (SPI_CACHE_OBJECT_PATH,
+                                          SPI_DBUS_INTERFACE_CACHE,
+                                          "RemoveAccessibles")))
+    {
+      DBusMessageIter iter, iter_array, iter_struct;
+      const char *name = dbus_bus_get_unique_name (spi_global_app_data->bus);
+
+      dbus_message_iter_init_append (message, &iter);
+      dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                        SPI_OBJECT_REFERENCE_SIGNATURE,
+                                        &iter_array);
+      for (i = 0; i < pending_removes->len; i++)
+        {
+          gchar buf[SPI_REGISTER_PATH_MAX];
+          const char *path;
+
+          path = spi_register_ref_path_into (g_array_index (pending_removes, guint, i),
+                                             buf);
 
-      dbus_connection_send (spi_global_app_data->bus, message, NULL);
+          dbus_message_iter_open_container (&iter_array, DBUS_TYPE_STRUCT, NULL,
+                                            &iter_struct);
+          dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
+          dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
+          dbus_message_iter_close_container (&iter_array, &iter_struct);
+        }
+      dbus_message_iter_close_container (&iter, &iter_array);
 
+      droute_send (spi_global_app_data->droute, message);
       dbus_message_unref (message);
     }
+
+  signals_saved += pending_removes->len - 1;
+
+  g_array_set_size (pending_removes, 0);
+}
+
+static void
+flush_pending_adds (void)
+{
+  DBusMessage *message;
+  guint count = g_queue_get_length (pending_adds);
+
+  if (count == 0)
+    return;
+
+  if ((message = dbus_message_new_signal (SPI_CACHE_OBJECT_PATH,
+                                          SPI_DBUS_INTERFACE_CACHE,
+                                          "AddAccessibles")))
+    {
+      DBusMessageIter iter, iter_array;
+
+      dbus_message_iter_init_append (message, &iter);
+      dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                        SPI_CACHE_ITEM_SIGNATURE, &iter_array);
+      g_queue_foreach (pending_adds, (GFunc) append_cache_item, &iter_array);
+      dbus_message_iter_close_container (&iter, &iter_array);
+
+      droute_send (spi_global_app_data->droute, message);
+      dbus_message_unref (message);
+    }
+
+  signals_saved += count - 1;
+
+  g_queue_foreach (pending_adds, (GFunc) g_object_unref, NULL);
+  g_queue_clear (pending_adds);
+  g_hash_table_remove_all (pending_add_set);
+}
+
+/*
+ * Sends all queued cache changes.
+ *
+ * Removals are sent first. A removed object has been destroyed, so it
+ * can never also be one of the queued additions.
+ */
+static gboolean
+flush_pending_signals (gpointer data)
+{
+  flush_pending_removes ();
+  flush_pending_adds ();
+
+  pending_flush_id = 0;
+  return FALSE;
+}
+
+static void
+schedule_flush (void)
+{
+  if (pending_flush_id == 0)
+    pending_flush_id = g_idle_add (flush_pending_signals, NULL);
+}
+
+static void
+emit_cache_remove (SpiCache *cache, GObject * obj)
+{
+  GList *link;
+  guint ref;
+
+  spi_atk_send_held_events (obj);
+
+  if (!spi_atk_cache_batch_signals)
+    {
+      emit_cache_remove_single (obj);
+      return;
+    }
+
+  /* Cancel out an addition that clients have not yet been told about */
+  link = g_hash_table_lookup (pending_add_set, obj);
+  if (link)
+    {
+      g_queue_delete_link (pending_adds, link);
+      g_hash_table_remove (pending_add_set, obj);
+      g_object_unref (obj);
+      signals_saved += 2;
+      return;
+    }
+
+  /*
+   * The reference must be looked up now, as the object is about to be
+   * removed from the register. Its path is only formatted on flush.
+   */
+  ref = spi_register_object_to_ref (obj);
+  if (!ref)
+    return;
+
+  g_array_append_val (pending_removes, ref);
+  schedule_flush ();
 }
 
+static void
+emit_cache_add (SpiCache *cache, GObject * obj)
+{
+  spi_atk_send_held_events (obj);
+
+  if (!spi_atk_cache_batch_signals)
+    {
+      emit_cache_add_single (obj);
+      return;
+    }
+
+  if (g_hash_table_lookup (pending_add_set, obj))
+    return;
+
+  g_queue_push_tail (pending_adds, g_object_ref (obj));
+  g_hash_table_insert (pending_add_set, obj, g_queue_peek_tail_link (pending_adds));
+  schedule_flush ();
+}
+
+/*
+ * Returns the number of D-Bus signals that batching has avoided sending.
+ */
+guint
+spi_cache_adaptor_signals_saved (void)
+{
+  return signals_saved;
+}
+
+void
+spi_cache_adaptor_reset_signals_saved (void)
+{
+  signals_saved = 0;
+}
 
 /*---------------------------------------------------------------------------*/
 
@@ -290,6 +857,13 @@ impl_GetItems (DBusConnection * bus, DBusMessage * message, void *user_data)
   DBusMessage *reply;
   DBusMessageIter iter, iter_array;
 
+  /*
+   * In lazy mode this starts filling the cache, anything not yet
+   * added will follow in AddAccessibles signals.
+   */
+  spi_cache_populate (spi_global_cache,
+                      G_OBJECT (spi_global_app_data->root));
+
   reply = dbus_message_new_method_return (message);
 
   dbus_message_iter_init_append (reply, &iter);
@@ -300,11 +874,210 @@ impl_GetItems (DBusConnection * bus, DBusMessage * message, void *user_data)
   return reply;
 }
 
+static void
+collect_removed (gpointer ref, gpointer data)
+{
+  g_ptr_array_add ((GPtrArray *) data, ref);
+}
+
+static void
+append_removed_reference (gpointer ref, gpointer data)
+{
+  DBusMessageIter *iter_array = data;
+  DBusMessageIter iter_struct;
+  gchar buf[SPI_REGISTER_PATH_MAX];
+  const char *name = dbus_bus_get_unique_name (spi_global_app_data->bus);
+  const char *path;
+
+  path = spi_register_ref_path_into (GPOINTER_TO_UINT (ref), buf);
+
+  dbus_message_iter_open_container (iter_array, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
+  dbus_message_iter_close_container (iter_array, &iter_struct);
+}
+
+/*
+ * Returns at most max_items cache items that have been added or updated
+ * after the given cursor, which is either 0 or a value returned by a
+ * previous call. Alongside the items the reply holds the cursor for the
+ * next page, 0 once the last page has been sent, the current cache
+ * generation, the objects removed since the cursor and a resync flag.
+ *
+ * A client that stores the generation can later pass it back as the
+ * cursor to download only the items that have changed since. If the
+ * removals since then are no longer known the listing starts again from
+ * the beginning and resync is set, telling the client to drop the items
+ * it already has.
+ */
+static DBusMessage *
+impl_GetItemsPaged (DBusConnection * bus, DBusMessage * message, void *user_data)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array, iter_removed;
+  DBusError error;
+  dbus_uint32_t cursor, max_items, next, generation;
+  dbus_bool_t resync = FALSE;
+  GPtrArray *removed;
+
+  dbus_error_init (&error);
+  if (!dbus_message_get_args (message, &error,
+                              DBUS_TYPE_UINT32, &cursor,
+                              DBUS_TYPE_UINT32, &max_items,
+                              DBUS_TYPE_INVALID))
+    return droute_invalid_arguments_error (message);
+
+  if (max_items == 0)
+    max_items = SPI_CACHE_DEFAULT_PAGE_SIZE;
+  else if (max_items > SPI_CACHE_MAX_PAGE_SIZE)
+    max_items = SPI_CACHE_MAX_PAGE_SIZE;
+
+  spi_cache_populate (spi_global_cache,
+                      G_OBJECT (spi_global_app_data->root));
+
+  reply = dbus_message_new_method_return (message);
+
+  generation = spi_cache_get_generation (spi_global_cache);
+
+  /* The removals are gathered first, as they decide where to start */
+  removed = g_ptr_array_new ();
+  if (cursor != 0 &&
+      !spi_cache_foreach_removed_since (spi_global_cache, cursor,
+                                        collect_removed, removed))
+    {
+      resync = TRUE;
+      cursor = 0;
+    }
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    SPI_CACHE_ITEM_SIGNATURE, &iter_array);
+  next = spi_cache_foreach_since (spi_global_cache, cursor, max_items,
+                                  append_accessible_hf, &iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &next);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &generation);
+
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    SPI_OBJECT_REFERENCE_SIGNATURE,
+                                    &iter_removed);
+  g_ptr_array_foreach (removed, append_removed_reference, &iter_removed);
+  dbus_message_iter_close_container (&iter, &iter_removed);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_BOOLEAN, &resync);
+
+  g_ptr_array_free (removed, TRUE);
+  return reply;
+}
+
+/*
+ * Returns the cache contents in the compact encoding. The reply is:
+ *
+ *   s                 the bus name of the application
+ *   s                 the prefix of object paths, to which references
+ *                     other than the reserved SPI_CACHE_COMPACT_REF_*
+ *                     values are appended in decimal
+ *   as                the interfaces in the order of the bitmask
+ *   a(uuauuuuuau)     the compact items
+ *   a(...)            items in the GetItems format, for objects that
+ *                     refer to other applications
+ *   as                the string table for names and descriptions
+ */
+static DBusMessage *
+impl_GetItemsCompact (DBusConnection * bus, DBusMessage * message,
+                      void *user_data)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array;
+  CompactContext ctx;
+  const char *str;
+  GSList *l;
+  guint i;
+
+  spi_cache_populate (spi_global_cache,
+                      G_OBJECT (spi_global_app_data->root));
+
+  reply = dbus_message_new_method_return (message);
+  dbus_message_iter_init_append (reply, &iter);
+
+  str = dbus_bus_get_unique_name (spi_global_app_data->bus);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &str);
+  str = SPI_DBUS_PATH_ACCESSIBLE_PREFIX;
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &str);
+
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "s", &iter_array);
+  spi_object_append_interface_names (&iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+
+  ctx.iter_array = &iter_array;
+  ctx.strings = g_hash_table_new (g_str_hash, g_str_equal);
+  ctx.string_table = g_ptr_array_new ();
+  ctx.full_items = NULL;
+
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    SPI_CACHE_COMPACT_ITEM_SIGNATURE,
+                                    &iter_array);
+  spi_cache_foreach (spi_global_cache, append_compact_hf, &ctx);
+  dbus_message_iter_close_container (&iter, &iter_array);
+
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    SPI_CACHE_ITEM_SIGNATURE, &iter_array);
+  for (l = ctx.full_items; l; l = l->next)
+    {
+      append_cache_item_full (ATK_OBJECT (l->data), &iter_array);
+      g_object_unref (l->data);
+    }
+  g_slist_free (ctx.full_items);
+  dbus_message_iter_close_container (&iter, &iter_array);
+
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "s", &iter_array);
+  for (i = 0; i < ctx.string_table->len; i++)
+    {
+      str = g_ptr_array_index (ctx.string_table, i);
+      dbus_message_iter_append_basic (&iter_array, DBUS_TYPE_STRING, &str);
+      g_free ((gchar *) str);
+    }
+  dbus_message_iter_close_container (&iter, &iter_array);
+
+  g_ptr_array_free (ctx.string_table, TRUE);
+  g_hash_table_destroy (ctx.strings);
+  return reply;
+}
+
+/*
+ * Asks for the subtree at the given object to be added to the cache.
+ * This only has an effect when the bridge runs with a lazy cache.
+ */
+static DBusMessage *
+impl_PopulateSubtree (DBusConnection * bus, DBusMessage * message,
+                      void *user_data)
+{
+  DBusError error;
+  const char *path;
+  GObject *object;
+
+  dbus_error_init (&error);
+  if (!dbus_message_get_args (message, &error,
+                              DBUS_TYPE_OBJECT_PATH, &path,
+                              DBUS_TYPE_INVALID))
+    return droute_invalid_arguments_error (message);
+
+  object = spi_global_register_path_to_object (path);
+  if (!ATK_IS_OBJECT (object))
+    return droute_invalid_arguments_error (message);
+
+  spi_cache_populate (spi_global_cache, object);
+  return dbus_message_new_method_return (message);
+}
+
 /*---------------------------------------------------------------------------*/
 
 static DRouteMethod methods[] = {
   {impl_GetRoot, "GetRoot"},
   {impl_GetItems, "GetItems"},
+  {impl_GetItemsPaged, "GetItemsPaged"},
+  {impl_GetItemsCompact, "GetItemsCompact"},
+  {impl_PopulateSubtree, "PopulateSubtree"},
   {NULL, NULL}
 };
 
@@ -313,6 +1086,12 @@ spi_initialize_cache (DRoutePath * path)
 {
   droute_path_add_interface (path, SPI_DBUS_INTERFACE_CACHE, spi_org_a11y_atspi_Cache, methods, NULL);
 
+  pending_adds = g_queue_new ();
+  pending_add_set = g_hash_table_new (g_direct_hash, g_direct_equal);
+  pending_removes = g_array_new (FALSE, FALSE, sizeof (guint));
+
+  spi_global_cache->snapshot_free = snapshot_free;
+
   g_signal_connect (spi_global_cache,
                     "object-added",
                     (GCallback) emit_cache_add,
@@ -0,0 +1,388 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Reports how often each method the bridge serves is called and how long
+ * it takes, from the statistics droute gathers while they are enabled,
+ * how many events were sent or dropped for want of a listener or over a
+ * rate limit, how key events fared with the device event controller, and
+ * how the cache and object leases are doing.
+ */
+
+#include <droute/droute.h>
+
+#include "common/spi-dbus.h"
+#include "accessible-cache.h"
+#include "accessible-leasing.h"
+#include "adaptors.h"
+#include "bridge.h"
+#include "event.h"
+#include "event-limit.h"
+#include "introspection.h"
+
+/*---------------------------------------------------------------------------*/
+
+static void
+append_stats (const DRouteStats * stats, void *data)
+{
+  DBusMessageIter *iter_array = (DBusMessageIter *) data;
+  DBusMessageIter iter_struct, iter_buckets;
+  const guint *buckets = stats->buckets;
+
+  dbus_message_iter_open_container (iter_array, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING,
+                                  &stats->interface);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING,
+                                  &stats->member);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32,
+                                  &stats->calls);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32,
+                                  &stats->errors);
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "u",
+                                    &iter_buckets);
+  dbus_message_iter_append_fixed_array (&iter_buckets, DBUS_TYPE_UINT32,
+                                        &buckets, DROUTE_STATS_BUCKETS);
+  dbus_message_iter_close_container (&iter_struct, &iter_buckets);
+  dbus_message_iter_close_container (iter_array, &iter_struct);
+}
+
+/*
+ * Returns an a(ssuuau) of interface, member, calls, errors and the
+ * latency histogram, whose bucket i counts calls taking under 2^i us.
+ */
+static DBusMessage *
+impl_GetStats (DBusConnection * bus, DBusMessage * message, void *user_data)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array;
+
+  reply = dbus_message_new_method_return (message);
+  if (!reply)
+    return NULL;
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(ssuuau)",
+                                    &iter_array);
+  droute_stats_foreach (spi_global_app_data->droute, append_stats,
+                        &iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+/* Returns the number of events emitted and suppressed */
+static DBusMessage *
+impl_GetEventCounts (DBusConnection * bus, DBusMessage * message,
+                     void *user_data)
+{
+  DBusMessage *reply;
+  dbus_uint32_t emitted, suppressed;
+
+  spi_atk_get_event_counts (&emitted, &suppressed);
+  reply = dbus_message_new_method_return (message);
+  if (reply)
+    dbus_message_append_args (reply, DBUS_TYPE_UINT32, &emitted,
+                              DBUS_TYPE_UINT32, &suppressed,
+                              DBUS_TYPE_INVALID);
+  return reply;
+}
+
+static void
+append_rate_limit_counts (const SpiEventLimitCounts * counts, gpointer data)
+{
+  DBusMessageIter *iter_array = (DBusMessageIter *) data;
+  DBusMessageIter iter_struct;
+
+  dbus_message_iter_open_container (iter_array, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING,
+                                  &counts->type);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32,
+                                  &counts->dropped);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32,
+                                  &counts->flushed);
+  dbus_message_iter_close_container (iter_array, &iter_struct);
+}
+
+/*
+ * Returns an a(suu) of event type, events over its rate limit and, of
+ * those, events held and sent later.
+ */
+static DBusMessage *
+impl_GetRateLimitCounts (DBusConnection * bus, DBusMessage * message,
+                         void *user_data)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array;
+
+  reply = dbus_message_new_method_return (message);
+  if (!reply)
+    return NULL;
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(suu)",
+                                    &iter_array);
+  spi_event_limit_foreach (append_rate_limit_counts, &iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  return reply;
+}
+
+/*
+ * Returns the key events waited on, consumed and timed out, sent without
+ * waiting and not sent, and the histogram of how long they were waited on.
+ */
+static DBusMessage *
+impl_GetKeyStats (DBusConnection * bus, DBusMessage * message,
+                  void *user_data)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_buckets;
+  SpiKeyStats stats;
+  const guint *buckets = stats.buckets;
+
+  spi_atk_get_key_stats (&stats);
+  reply = dbus_message_new_method_return (message);
+  if (!reply)
+    return NULL;
+
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.sent);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.consumed);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.timed_out);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.unwaited);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_UINT32, &stats.skipped);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "u",
+                                    &iter_buckets);
+  dbus_message_iter_append_fixed_array (&iter_buckets, DBUS_TYPE_UINT32,
+                                        &buckets, SPI_KEY_STATS_BUCKETS);
+  dbus_message_iter_close_container (&iter, &iter_buckets);
+  return reply;
+}
+
+/*
+ * Returns the cache signals saved by batching, and the number of add
+ * traversal slices run with the last, longest and total time they took.
+ */
+static DBusMessage *
+impl_GetCacheStats (DBusConnection * bus, DBusMessage * message,
+                    void *user_data)
+{
+  DBusMessage *reply;
+  SpiCacheSliceStats slices;
+  dbus_uint32_t saved, last_us, max_us;
+  dbus_uint64_t total_us;
+
+  spi_cache_get_slice_stats (spi_global_cache, &slices);
+  saved = spi_cache_adaptor_signals_saved ();
+  last_us = slices.last_us;
+  max_us = slices.max_us;
+  total_us = slices.total_us;
+
+  reply = dbus_message_new_method_return (message);
+  if (reply)
+    dbus_message_append_args (reply, DBUS_TYPE_UINT32, &saved,
+                              DBUS_TYPE_UINT32, &slices.count,
+                              DBUS_TYPE_UINT32, &last_us,
+                              DBUS_TYPE_UINT32, &max_us,
+                              DBUS_TYPE_UINT64, &total_us,
+                              DBUS_TYPE_INVALID);
+  return reply;
+}
+
+/*
+ * Returns the objects leased now, the lease renewals and expiries, and
+ * their rates a second.
+ */
+static DBusMessage *
+impl_GetLeaseStats (DBusConnection * bus, DBusMessage * message,
+                    void *user_data)
+{
+  DBusMessage *reply;
+  SpiLeasingStats stats;
+
+  spi_leasing_get_stats (spi_global_leasing, &stats);
+  reply = dbus_message_new_method_return (message);
+  if (reply)
+    dbus_message_append_args (reply, DBUS_TYPE_UINT32, &stats.active,
+                              DBUS_TYPE_UINT32, &stats.renewals,
+                              DBUS_TYPE_UINT32, &stats.expirations,
+                              DBUS_TYPE_UINT32, &stats.renewals_per_s,
+                              DBUS_TYPE_UINT32, &stats.expirations_per_s,
+                              DBUS_TYPE_INVALID);
+  return reply;
+}
+
+static DBusMessage *
+impl_Reset (DBusConnection * bus, DBusMessage * message, void *user_data)
+{
+  droute_reset_stats (spi_global_app_data->droute);
+  spi_atk_reset_event_counts ();
+  spi_event_limit_reset_counts ();
+  spi_atk_reset_key_stats ();
+  spi_cache_adaptor_reset_signals_saved ();
+  spi_cache_reset_slice_stats (spi_global_cache);
+  spi_leasing_reset_stats (spi_global_leasing);
+  return dbus_message_new_method_return (message);
+}
+
+static DBusMessage *
+impl_SetEnabled (DBusConnection * bus, DBusMessage * message, void *user_data)
+{
+  dbus_bool_t enabled;
+
+  if (!dbus_message_get_args (message, NULL,
+                              DBUS_TYPE_BOOLEAN, &enabled, DBUS_TYPE_INVALID))
+    return droute_invalid_arguments_error (message);
+
+  droute_set_stats_enabled (spi_global_app_data->droute, enabled);
+  return dbus_message_new_method_return (message);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void
+collect_stats (const DRouteStats * stats, void *data)
+{
+  g_ptr_array_add ((GPtrArray *) data, (gpointer) stats);
+}
+
+static gint
+compare_calls (gconstpointer a, gconstpointer b)
+{
+  const DRouteStats *sa = *(const DRouteStats **) a;
+  const DRouteStats *sb = *(const DRouteStats **) b;
+
+  return (sa->calls < sb->calls) - (sa->calls > sb->calls);
+}
+
+/* The upper bound, in us, of the bucket holding the given fraction of counts */
+static guint
+buckets_quantile (const guint * buckets, guint n_buckets, guint total,
+                  gdouble fraction)
+{
+  guint wanted = (guint) (total * fraction + 0.5);
+  guint seen = 0;
+  guint i;
+
+  for (i = 0; i < n_buckets - 1; i++)
+    {
+      seen += buckets[i];
+      if (seen >= wanted)
+        break;
+    }
+  return 1 << i;
+}
+
+static guint
+stats_quantile (const DRouteStats * stats, gdouble fraction)
+{
+  return buckets_quantile (stats->buckets, DROUTE_STATS_BUCKETS,
+                           stats->calls, fraction);
+}
+
+static void
+print_rate_limit_counts (const SpiEventLimitCounts * counts, gpointer data)
+{
+  g_printerr ("AT-SPI rate limited %s: %u dropped, %u flushed\n",
+              counts->type, counts->dropped, counts->flushed);
+}
+
+/* Prints the statistics gathered so far, busiest methods first */
+void
+spi_stats_dump (void)
+{
+  GPtrArray *all = g_ptr_array_new ();
+  guint emitted, suppressed;
+  SpiKeyStats keys;
+  SpiCacheSliceStats slices;
+  SpiLeasingStats leases;
+  guint i;
+
+  droute_stats_foreach (spi_global_app_data->droute, collect_stats, all);
+  g_ptr_array_sort (all, compare_calls);
+
+  g_printerr ("AT-SPI call statistics:\n");
+  g_printerr ("%10s %8s %10s %10s  %s\n",
+              "calls", "errors", "p50 (us)", "p99 (us)", "method");
+  for (i = 0; i < all->len; i++)
+    {
+      DRouteStats *stats = g_ptr_array_index (all, i);
+
+      g_printerr ("%10u %8u %10u %10u  %s.%s\n",
+                  stats->calls, stats->errors,
+                  stats_quantile (stats, 0.5), stats_quantile (stats, 0.99),
+                  stats->interface, stats->member);
+    }
+  g_ptr_array_free (all, TRUE);
+
+  spi_atk_get_event_counts (&emitted, &suppressed);
+  g_printerr ("AT-SPI events: %u emitted, %u suppressed\n",
+              emitted, suppressed);
+  spi_event_limit_foreach (print_rate_limit_counts, NULL);
+
+  spi_atk_get_key_stats (&keys);
+  g_printerr ("AT-SPI keys: %u sent, %u consumed, %u timed out, "
+              "%u unwaited, %u skipped, p50 %u us, p99 %u us\n",
+              keys.sent, keys.consumed, keys.timed_out, keys.unwaited,
+              keys.skipped,
+              buckets_quantile (keys.buckets, SPI_KEY_STATS_BUCKETS,
+                                keys.sent, 0.5),
+              buckets_quantile (keys.buckets, SPI_KEY_STATS_BUCKETS,
+                                keys.sent, 0.99));
+
+  spi_cache_get_slice_stats (spi_global_cache, &slices);
+  g_printerr ("AT-SPI cache: %u signals saved, %u slices, "
+              "last %lu us, max %lu us, total %" G_GUINT64_FORMAT " us\n",
+              spi_cache_adaptor_signals_saved (), slices.count,
+              slices.last_us, slices.max_us, slices.total_us);
+
+  spi_leasing_get_stats (spi_global_leasing, &leases);
+  g_printerr ("AT-SPI leases: %u active, %u renewals (%u/s), "
+              "%u expirations (%u/s)\n",
+              leases.active, leases.renewals, leases.renewals_per_s,
+              leases.expirations, leases.expirations_per_s);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static DRouteMethod methods[] = {
+  {impl_GetStats, "GetStats"},
+  {impl_GetEventCounts, "GetEventCounts"},
+  {impl_GetRateLimitCounts, "GetRateLimitCounts"},
+  {impl_GetKeyStats, "GetKeyStats"},
+  {impl_GetCacheStats, "GetCacheStats"},
+  {impl_GetLeaseStats, "GetLeaseStats"},
+  {impl_Reset, "Reset"},
+  {impl_SetEnabled, "SetEnabled"},
+  {NULL, NULL}
+};
+
+void
+spi_initialize_stats (DRoutePath * path)
+{
+  droute_path_add_interface (path,
+                             SPI_DBUS_INTERFACE_STATS,
+                             spi_org_a11y_atspi_Stats, methods, NULL);
+}
+
+/*END------------------------------------------------------------------------*/
@@ -29,6 +29,7 @@
 
 #include "common/spi-dbus.h"
 #include "object.h"
+#include "event.h"
 #include "introspection.h"
 
 static dbus_bool_t
@@ -47,6 +48,14 @@ impl_get_CaretOffset (DBusMessageIter * iter, void *user_data)
   return droute_return_v_int32 (iter, atk_text_get_caret_offset (text));
 }
 
+static dbus_bool_t
+impl_get_ChangeSerial (DBusMessageIter * iter, void *user_data)
+{
+  g_return_val_if_fail (ATK_IS_TEXT (user_data), FALSE);
+  return droute_return_v_uint32 (iter,
+                                 spi_atk_get_text_change_serial (ATK_OBJECT (user_data)));
+}
+
 static DBusMessage *
 impl_GetText (DBusConnection * bus, DBusMessage * message, void *user_data)
 {
@@ -78,6 +87,48 @@ impl_GetText (DBusConnection * bus, DBusMessage * message, void *user_data)
   return reply;
 }
 
+/*
+ * Reads a range of text as it was at the given text change serial, so
+ * that a client can fetch the text of a long text-changed event in one
+ * round trip. Returns FALSE and an empty string if the text has changed
+ * since.
+ */
+static DBusMessage *
+impl_GetTextAtSerial (DBusConnection * bus, DBusMessage * message,
+                      void *user_data)
+{
+  AtkText *text = (AtkText *) user_data;
+  dbus_uint32_t serial;
+  dbus_int32_t startOffset, endOffset;
+  dbus_bool_t current;
+  gchar *txt = NULL;
+  DBusError error;
+  DBusMessage *reply;
+
+  g_return_val_if_fail (ATK_IS_TEXT (user_data),
+                        droute_not_yet_handled_error (message));
+  dbus_error_init (&error);
+  if (!dbus_message_get_args
+      (message, &error, DBUS_TYPE_UINT32, &serial, DBUS_TYPE_INT32,
+       &startOffset, DBUS_TYPE_INT32, &endOffset, DBUS_TYPE_INVALID))
+    {
+      return droute_invalid_arguments_error (message);
+    }
+  current = serial == spi_atk_get_text_change_serial (ATK_OBJECT (text));
+  if (current)
+    txt = atk_text_get_text (text, startOffset, endOffset);
+  if (!txt)
+    txt = g_strdup ("");
+  reply = dbus_message_new_method_return (message);
+  if (reply)
+    {
+      dbus_message_append_args (reply, DBUS_TYPE_BOOLEAN, &current,
+                                DBUS_TYPE_STRING, &txt, DBUS_TYPE_INVALID);
+    }
+  g_free (txt);
+  return reply;
+}
+
 static DBusMessage *
 impl_SetCaretOffset (DBusConnection * bus, DBusMessage * message,
                      void *user_data)
@@ -805,6 +856,7 @@ impl_GetDefaultAttributeSet (DBusConnection * bus, DBusMessage * message,
 
 static DRouteMethod methods[] = {
   {impl_GetText, "GetText"},
+  {impl_GetTextAtSerial, "GetTextAtSerial"},
   {impl_SetCaretOffset, "SetCaretOffset"},
   {impl_GetTextBeforeOffset, "GetTextBeforeOffset"},
   {impl_GetTextAtOffset, "GetTextAtOffset"},
@@ -830,6 +882,7 @@ static DRouteMethod methods[] = {
 static DRouteProperty properties[] = {
   {impl_get_CharacterCount, NULL, "CharacterCount"},
   {impl_get_CaretOffset, NULL, "CaretOffset"},
+  {impl_get_ChangeSerial, NULL, "ChangeSerial"},
   {NULL, NULL, NULL}
 };
 
@@ -0,0 +1,585 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Unit tests for the parts of the bridge that do not need a bus or ATK.
+ * Prints each failure and exits non-zero if any check fails.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "cache-set.h"
+#include "event-limit.h"
+#include "event-template.h"
+#include "key-listeners.h"
+#include "reference-table.h"
+
+static gboolean success = TRUE;
+
+#define check(expr)                                                     \
+  G_STMT_START {                                                        \
+    if (!(expr))                                                        \
+      {                                                                 \
+        g_print ("Failed: %s:%d: %s\n", __FILE__, __LINE__, #expr);     \
+        success = FALSE;                                                \
+      }                                                                 \
+  } G_STMT_END
+
+/*---------------------------------------------------------------------------*/
+
+/* The messages handed back by the limiter, in the order it sent them */
+static GSList *sent = NULL;
+
+static void
+record_sent (GObject * object, GSList * messages, gboolean lease,
+             gpointer data)
+{
+  GSList *l;
+
+  for (l = messages; l; l = l->next)
+    sent = g_slist_append (sent, dbus_message_ref (l->data));
+}
+
+static void
+clear_sent (void)
+{
+  g_slist_foreach (sent, (GFunc) dbus_message_unref, NULL);
+  g_slist_free (sent);
+  sent = NULL;
+}
+
+static const gchar *
+sent_member (guint n)
+{
+  DBusMessage *message = g_slist_nth_data (sent, n);
+
+  return message ? dbus_message_get_member (message) : NULL;
+}
+
+static DBusMessage *
+new_signal (const gchar * member)
+{
+  return dbus_message_new_signal ("/org/a11y/atspi/accessible/1",
+                                  "org.a11y.atspi.Event.Object", member);
+}
+
+static const SpiEventLimitCounts *found_counts;
+
+static void
+find_counts (const SpiEventLimitCounts * counts, gpointer data)
+{
+  if (!strcmp (counts->type, data))
+    found_counts = counts;
+}
+
+/*
+ * The bridge sends property changes under the D-Bus member name, so a
+ * rate set for "property-change" has to limit "PropertyChange".
+ */
+static void
+test_event_limit (void)
+{
+  GObject *object = g_object_new (G_TYPE_OBJECT, NULL);
+  GObject *other = g_object_new (G_TYPE_OBJECT, NULL);
+  SpiEventBucket *bucket;
+  DBusMessage *sig;
+  gint64 now = 1000 * G_USEC_PER_SEC;
+  gint i;
+
+  spi_event_limit_set_rate ("property-change", 10);
+  spi_event_limit_reset_counts ();
+
+  /* A second's worth goes out at once */
+  for (i = 0; i < 10; i++)
+    check (!spi_event_limit_take (object, "PropertyChange", "accessible-name",
+                                  now));
+  bucket = spi_event_limit_take (object, "PropertyChange", "accessible-name",
+                                 now);
+  check (bucket != NULL);
+
+  /* Other details and objects have buckets of their own */
+  check (!spi_event_limit_take (object, "PropertyChange",
+                                "accessible-description", now));
+  check (!spi_event_limit_take (other, "PropertyChange", "accessible-name",
+                                now));
+  /* Types with no rate are not limited */
+  check (!spi_event_limit_take (object, "ChildrenChanged", "add", now));
+
+  /* Only the latest is held, with what follows it */
+  sig = new_signal ("PropertyChange");
+  spi_event_limit_hold (bucket, sig, TRUE);
+  dbus_message_unref (sig);
+  bucket = spi_event_limit_take (object, "PropertyChange", "accessible-name",
+                                 now);
+  check (bucket != NULL);
+  sig = new_signal ("PropertyChange");
+  spi_event_limit_hold (bucket, sig, TRUE);
+  dbus_message_unref (sig);
+  sig = new_signal ("PropertiesChanged");
+  spi_event_limit_hold_also (bucket, sig);
+  dbus_message_unref (sig);
+
+  /* Nothing goes out before a token is back */
+  check (spi_event_limit_sweep (now + G_USEC_PER_SEC / 100, record_sent,
+                                NULL));
+  check (sent == NULL);
+
+  /* Then the held event goes out ahead of the signal that follows it */
+  check (spi_event_limit_sweep (now + G_USEC_PER_SEC / 5, record_sent, NULL));
+  check (g_slist_length (sent) == 2);
+  check (!g_strcmp0 (sent_member (0), "PropertyChange"));
+  check (!g_strcmp0 (sent_member (1), "PropertiesChanged"));
+  clear_sent ();
+
+  found_counts = NULL;
+  spi_event_limit_foreach (find_counts, "property-change");
+  check (found_counts != NULL);
+  check (found_counts && found_counts->dropped == 2);
+  check (found_counts && found_counts->flushed == 1);
+
+  /* Another event for the object sends what is held first */
+  now += 2 * G_USEC_PER_SEC;
+  for (i = 0; i < 10; i++)
+    spi_event_limit_take (object, "PropertyChange", "accessible-name", now);
+  bucket = spi_event_limit_take (object, "PropertyChange", "accessible-name",
+                                 now);
+  check (bucket != NULL);
+  sig = new_signal ("PropertyChange");
+  spi_event_limit_hold (bucket, sig, TRUE);
+  dbus_message_unref (sig);
+  spi_event_limit_flush_object (other, record_sent, NULL);
+  check (sent == NULL);
+  spi_event_limit_flush_object (object, record_sent, NULL);
+  check (g_slist_length (sent) == 1);
+  clear_sent ();
+
+  /* Buckets that have refilled and hold nothing are freed */
+  check (!spi_event_limit_sweep (now + 10 * G_USEC_PER_SEC, record_sent,
+                                 NULL));
+  check (sent == NULL);
+  check (!spi_event_limit_active ());
+
+  /* A rate of 0 does not limit the type */
+  spi_event_limit_set_rate ("PropertyChange", 0);
+  for (i = 0; i < 100; i++)
+    check (!spi_event_limit_take (object, "PropertyChange", "accessible-name",
+                                   now));
+  spi_event_limit_clear (record_sent, NULL);
+  check (sent == NULL);
+
+  g_object_unref (object);
+  g_object_unref (other);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/* Objects are only compared, so any distinct non-NULL pointers do */
+#define FAKE_OBJECT(i) GUINT_TO_POINTER (((i) + 1) * 8)
+
+static void
+test_ref_table (void)
+{
+  SpiRefTable *table = spi_ref_table_new ();
+  guint refs[1000];
+  GHashTable *seen;
+  guint ref;
+  guint i;
+
+  /* Enough objects to grow both the slots and the reverse table */
+  for (i = 0; i < G_N_ELEMENTS (refs); i++)
+    {
+      refs[i] = spi_ref_table_insert (table, FAKE_OBJECT (i));
+      check (refs[i] != 0);
+    }
+  check (spi_ref_table_size (table) == G_N_ELEMENTS (refs));
+  for (i = 0; i < G_N_ELEMENTS (refs); i++)
+    {
+      check (spi_ref_table_lookup_object (table, refs[i]) == FAKE_OBJECT (i));
+      check (spi_ref_table_lookup_ref (table, FAKE_OBJECT (i)) == refs[i]);
+    }
+
+  /* Removing some must not lose the others sharing their probe sequence */
+  for (i = 0; i < G_N_ELEMENTS (refs); i += 2)
+    check (spi_ref_table_remove (table, FAKE_OBJECT (i)) == refs[i]);
+  check (spi_ref_table_size (table) == G_N_ELEMENTS (refs) / 2);
+  for (i = 0; i < G_N_ELEMENTS (refs); i++)
+    {
+      gpointer expected = (i % 2) ? FAKE_OBJECT (i) : NULL;
+
+      check (spi_ref_table_lookup_object (table, refs[i]) == expected);
+      check (spi_ref_table_lookup_ref (table, FAKE_OBJECT (i)) ==
+             ((i % 2) ? refs[i] : 0));
+    }
+  check (spi_ref_table_remove (table, FAKE_OBJECT (0)) == 0);
+
+  /* A reused slot gets a new generation, so the old reference is stale */
+  ref = spi_ref_table_insert (table, FAKE_OBJECT (2000));
+  check (ref != 0);
+  for (i = 0; i < G_N_ELEMENTS (refs); i += 2)
+    check (ref != refs[i]);
+  check (spi_ref_table_lookup_object (table, ref) == FAKE_OBJECT (2000));
+  spi_ref_table_remove (table, FAKE_OBJECT (2000));
+
+  /* A slot is retired rather than wrapped, so no reference comes back */
+  seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+  for (i = 0; i < 1024; i++)
+    {
+      ref = spi_ref_table_insert (table, FAKE_OBJECT (3000));
+      check (ref != 0);
+      check (!g_hash_table_lookup (seen, GUINT_TO_POINTER (ref)));
+      g_hash_table_insert (seen, GUINT_TO_POINTER (ref), GINT_TO_POINTER (1));
+      spi_ref_table_remove (table, FAKE_OBJECT (3000));
+      check (spi_ref_table_lookup_object (table, ref) == NULL);
+    }
+  g_hash_table_destroy (seen);
+
+  /* References that were never handed out do not resolve */
+  check (spi_ref_table_lookup_object (table, 0) == NULL);
+  check (spi_ref_table_lookup_object (table, 0x00ffffff) == NULL);
+  check (spi_ref_table_lookup_ref (table, NULL) == 0);
+
+  spi_ref_table_free (table);
+}
+
+/*---------------------------------------------------------------------------*/
+
+#define CACHE_SET_STABLE 256
+#define CACHE_SET_CHURN  4096
+
+static volatile gint cache_set_done = 0;
+static volatile gint cache_set_misses = 0;
+
+/*
+ * Looks for objects that stay in the set while the writer adds and
+ * removes others around them, growing the shards under the reader.
+ */
+static gpointer
+cache_set_read (gpointer data)
+{
+  SpiCacheSet *set = data;
+  SpiCacheSetReader *reader = spi_cache_set_reader_new (set);
+  guint i;
+
+  while (!g_atomic_int_get (&cache_set_done))
+    {
+      spi_cache_set_read_begin (reader);
+      for (i = 0; i < CACHE_SET_STABLE; i++)
+        if (!spi_cache_set_contains (set, FAKE_OBJECT (i)))
+          g_atomic_int_inc (&cache_set_misses);
+      spi_cache_set_read_end (reader);
+    }
+  spi_cache_set_reader_free (reader);
+  return NULL;
+}
+
+static void
+test_cache_set (void)
+{
+  SpiCacheSet *set = spi_cache_set_new ();
+  GPtrArray *snapshot;
+  GThread *thread;
+  guint i, round;
+
+  for (i = 0; i < CACHE_SET_STABLE; i++)
+    check (spi_cache_set_add (set, FAKE_OBJECT (i)));
+  check (!spi_cache_set_add (set, FAKE_OBJECT (0)));
+  check (spi_cache_set_size (set) == CACHE_SET_STABLE);
+
+  thread = g_thread_create (cache_set_read, set, TRUE, NULL);
+  for (round = 0; round < 8; round++)
+    {
+      for (i = CACHE_SET_STABLE; i < CACHE_SET_CHURN; i++)
+        check (spi_cache_set_add (set, FAKE_OBJECT (i)));
+      for (i = CACHE_SET_STABLE; i < CACHE_SET_CHURN; i++)
+        check (spi_cache_set_remove (set, FAKE_OBJECT (i)));
+    }
+  g_atomic_int_set (&cache_set_done, 1);
+  g_thread_join (thread);
+  check (g_atomic_int_get (&cache_set_misses) == 0);
+
+  /* Removed objects are gone, and their tombstones do not hide others */
+  check (spi_cache_set_size (set) == CACHE_SET_STABLE);
+  check (!spi_cache_set_contains (set, FAKE_OBJECT (CACHE_SET_STABLE)));
+  check (!spi_cache_set_remove (set, FAKE_OBJECT (CACHE_SET_STABLE)));
+  for (i = 0; i < CACHE_SET_STABLE; i += 2)
+    check (spi_cache_set_remove (set, FAKE_OBJECT (i)));
+  for (i = 0; i < CACHE_SET_STABLE; i++)
+    check (spi_cache_set_contains (set, FAKE_OBJECT (i)) == (i % 2));
+
+  snapshot = spi_cache_set_snapshot (set);
+  check (snapshot->len == CACHE_SET_STABLE / 2);
+  for (i = 0; i < snapshot->len; i++)
+    check (GPOINTER_TO_UINT (g_ptr_array_index (snapshot, i)) % 16 == 0);
+  g_ptr_array_free (snapshot, TRUE);
+
+  spi_cache_set_free (set);
+}
+
+/*---------------------------------------------------------------------------*/
+
+#define TEST_APP_NAME ":1.42"
+#define TEST_APP_PATH "/org/a11y/atspi/accessible/root"
+
+/* Builds an event the way the bridge does without a template */
+static DBusMessage *
+new_event (const char *path, const char *minor, dbus_int32_t detail1,
+           dbus_int32_t detail2, int type, const void *value)
+{
+  DBusMessage *message;
+  DBusMessageIter iter, iter_variant, iter_struct;
+  const char *app_name = TEST_APP_NAME;
+  const char *app_path = TEST_APP_PATH;
+  char sig[2] = { type, '\0' };
+
+  message = dbus_message_new_signal (path, "org.a11y.atspi.Event.Object",
+                                     "PropertyChange");
+  dbus_message_iter_init_append (message, &iter);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &minor);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &detail1);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &detail2);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT, sig,
+                                    &iter_variant);
+  dbus_message_iter_append_basic (&iter_variant, type, value);
+  dbus_message_iter_close_container (&iter, &iter_variant);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &app_name);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH,
+                                  &app_path);
+  dbus_message_iter_close_container (&iter, &iter_struct);
+  return message;
+}
+
+static gboolean
+messages_equal (DBusMessage * a, DBusMessage * b)
+{
+  char *bytes_a, *bytes_b;
+  int len_a, len_b;
+  gboolean equal;
+
+  if (!a || !b)
+    return FALSE;
+  if (!dbus_message_marshal (a, &bytes_a, &len_a))
+    return FALSE;
+  if (!dbus_message_marshal (b, &bytes_b, &len_b))
+    {
+      dbus_free (bytes_a);
+      return FALSE;
+    }
+  equal = len_a == len_b && !memcmp (bytes_a, bytes_b, len_a);
+  dbus_free (bytes_a);
+  dbus_free (bytes_b);
+  return equal;
+}
+
+/*
+ * Events built from a template must be the same bytes as those libdbus
+ * builds, for paths and strings of every length modulo 8.
+ */
+static void
+test_event_template (void)
+{
+  SpiEventTemplate *tmpl;
+  DBusMessage *built, *expected;
+  const char *paths[] = {
+    "/a", "/org/a11y/atspi/accessible/1",
+    "/org/a11y/atspi/accessible/12", "/org/a11y/atspi/accessible/123",
+    "/org/a11y/atspi/accessible/1234", "/org/a11y/atspi/accessible/12345",
+    "/org/a11y/atspi/accessible/123456", "/org/a11y/atspi/accessible/1234567"
+  };
+  const char *strings[] = { "", "a", "ab", "abc", "abcd", "abcde", "abcdef",
+                            "abcdefg" };
+  dbus_uint32_t number = 42;
+  guint i, j;
+
+  tmpl = spi_event_template_new ("org.a11y.atspi.Event.Object",
+                                 "PropertyChange", TEST_APP_NAME,
+                                 TEST_APP_PATH);
+
+  for (i = 0; i < G_N_ELEMENTS (paths); i++)
+    for (j = 0; j < G_N_ELEMENTS (strings); j++)
+      {
+        built = spi_event_template_build (tmpl, paths[i], strings[j], 1, -2,
+                                          DBUS_TYPE_INT32, &number);
+        expected = new_event (paths[i], strings[j], 1, -2, DBUS_TYPE_INT32,
+                              &number);
+        check (messages_equal (built, expected));
+        if (built)
+          dbus_message_unref (built);
+        dbus_message_unref (expected);
+
+        built = spi_event_template_build (tmpl, paths[i], "accessible-name",
+                                          0, 0, DBUS_TYPE_STRING, &strings[j]);
+        expected = new_event (paths[i], "accessible-name", 0, 0,
+                              DBUS_TYPE_STRING, &strings[j]);
+        check (messages_equal (built, expected));
+        if (built)
+          dbus_message_unref (built);
+        dbus_message_unref (expected);
+      }
+
+  spi_event_template_free (tmpl);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Appends a listener as the device event controller describes it, a
+ * (souua(iisi)u(bbb)), written out field by field.
+ */
+static void
+append_key_listener (DBusMessageIter * iter, const char *bus_name,
+                     const char *path, dbus_uint32_t mask,
+                     dbus_bool_t preemptive)
+{
+  DBusMessageIter iter_struct, iter_keys, iter_key, iter_mode;
+  dbus_uint32_t type = 0, types = 3;
+  dbus_int32_t keycode = 38, keysym = 97, timeout = 0;
+  const char *keystring = "a";
+  dbus_bool_t synchronous = TRUE, global = FALSE;
+
+  dbus_message_iter_open_container (iter, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_struct);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &bus_name);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &type);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &types);
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "(iisi)",
+                                    &iter_keys);
+  dbus_message_iter_open_container (&iter_keys, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_key);
+  dbus_message_iter_append_basic (&iter_key, DBUS_TYPE_INT32, &keycode);
+  dbus_message_iter_append_basic (&iter_key, DBUS_TYPE_INT32, &keysym);
+  dbus_message_iter_append_basic (&iter_key, DBUS_TYPE_STRING, &keystring);
+  dbus_message_iter_append_basic (&iter_key, DBUS_TYPE_INT32, &timeout);
+  dbus_message_iter_close_container (&iter_keys, &iter_key);
+  dbus_message_iter_close_container (&iter_struct, &iter_keys);
+  dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_UINT32, &mask);
+  dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_STRUCT, NULL,
+                                    &iter_mode);
+  dbus_message_iter_append_basic (&iter_mode, DBUS_TYPE_BOOLEAN, &synchronous);
+  dbus_message_iter_append_basic (&iter_mode, DBUS_TYPE_BOOLEAN, &preemptive);
+  dbus_message_iter_append_basic (&iter_mode, DBUS_TYPE_BOOLEAN, &global);
+  dbus_message_iter_close_container (&iter_struct, &iter_mode);
+  dbus_message_iter_close_container (iter, &iter_struct);
+}
+
+static DBusMessage *
+new_key_listener_signal (const char *member, const char *path,
+                         dbus_uint32_t mask, dbus_bool_t preemptive)
+{
+  DBusMessage *signal;
+  DBusMessageIter iter;
+
+  signal = dbus_message_new_signal ("/org/a11y/atspi/registry/deviceeventcontroller",
+                                    "org.a11y.atspi.DeviceEventListener",
+                                    member);
+  dbus_message_iter_init_append (signal, &iter);
+  append_key_listener (&iter, ":1.2", path, mask, preemptive);
+  return signal;
+}
+
+static void
+test_key_listeners (void)
+{
+  DBusMessage *reply, *signal;
+  DBusMessageIter iter, iter_array;
+  const char *path = "/listener/4";
+
+  /* A reply to GetKeystrokeListeners naming two listeners */
+  reply = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    "(souua(iisi)u(bbb))", &iter_array);
+  append_key_listener (&iter_array, ":1.2", "/listener/1", 0, FALSE);
+  append_key_listener (&iter_array, ":1.2", "/listener/2", 0, TRUE);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  check (spi_key_listeners_read (reply));
+  check (spi_key_listeners_any ());
+  check (spi_key_listeners_may_consume ());
+  dbus_message_unref (reply);
+
+  /* The same path may hold a listener for each modifier mask */
+  signal = new_key_listener_signal ("KeystrokeListenerRegistered",
+                                    "/listener/2", 1, FALSE);
+  check (spi_key_listeners_update (signal));
+  dbus_message_unref (signal);
+  signal = new_key_listener_signal ("KeystrokeListenerDeregistered",
+                                    "/listener/2", 0, TRUE);
+  check (spi_key_listeners_update (signal));
+  dbus_message_unref (signal);
+  check (!spi_key_listeners_may_consume ());
+  signal = new_key_listener_signal ("KeystrokeListenerDeregistered",
+                                    "/listener/2", 1, FALSE);
+  check (spi_key_listeners_update (signal));
+  dbus_message_unref (signal);
+  check (spi_key_listeners_any ());
+
+  /* An empty list means nobody listens */
+  reply = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  dbus_message_iter_init_append (reply, &iter);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY,
+                                    "(souua(iisi)u(bbb))", &iter_array);
+  dbus_message_iter_close_container (&iter, &iter_array);
+  check (spi_key_listeners_read (reply));
+  check (!spi_key_listeners_any ());
+  dbus_message_unref (reply);
+
+  /* Anything else is not a list of listeners, and changes nothing */
+  signal = new_key_listener_signal ("KeystrokeListenerRegistered",
+                                    "/listener/3", 0, FALSE);
+  check (spi_key_listeners_update (signal));
+  dbus_message_unref (signal);
+  reply = dbus_message_new (DBUS_MESSAGE_TYPE_METHOD_RETURN);
+  dbus_message_append_args (reply, DBUS_TYPE_STRING, &path,
+                            DBUS_TYPE_INVALID);
+  check (!spi_key_listeners_read (reply));
+  check (spi_key_listeners_any ());
+  dbus_message_unref (reply);
+
+  spi_key_listeners_clear ();
+  check (!spi_key_listeners_any ());
+}
+
+/*---------------------------------------------------------------------------*/
+
+int
+main (int argc, char **argv)
+{
+  g_type_init ();
+  if (!g_thread_supported ())
+    g_thread_init (NULL);
+
+  test_event_limit ();
+  test_ref_table ();
+  test_cache_set ();
+  test_event_template ();
+  test_key_listeners ();
+
+  return success ? 0 : 1;
+}
+
+/*END------------------------------------------------------------------------*/
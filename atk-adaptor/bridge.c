@@ -270,6 +270,9 @@ exit_func (void)
       return;
     }
 
+  droute_stop_io_thread (spi_global_app_data->droute);
+  if (g_getenv ("AT_SPI_STATS"))
+    spi_stats_dump ();
   spi_atk_tidy_windows ();
   spi_atk_deregister_event_listeners ();
   deregister_application (spi_global_app_data);
@@ -384,7 +387,8 @@ socket_embed_hook (AtkSocket * socket, gchar * plug_id)
       *(plug_path++) = '\0';
       message = dbus_message_new_method_call (plug_name, plug_path, SPI_DBUS_INTERFACE_SOCKET, "Embedded");
       dbus_message_append_args (message, DBUS_TYPE_STRING, &path, DBUS_TYPE_INVALID);
-      dbus_connection_send (spi_global_app_data->bus, message, NULL);
+      droute_send (spi_global_app_data->droute, message);
+      dbus_message_unref (message);
     }
   g_free (plug_name);
   g_free (path);
@@ -408,12 +412,33 @@ install_plug_hooks ()
 
 gchar *atspi_dbus_name = NULL;
 static gboolean atspi_no_register = FALSE;
+gboolean spi_atk_cache_batch_signals = FALSE;
+gboolean spi_atk_lazy_cache = FALSE;
+gboolean spi_atk_threaded_dispatch = FALSE;
+static gchar *atspi_coalesce = NULL;
+static gchar *atspi_rate_limit = NULL;
+gint spi_atk_text_changed_limit = 0;
+gint spi_atk_key_timeout = -1;
 
 static GOptionEntry atspi_option_entries[] = {
   {"atspi-dbus-name", 0, 0, G_OPTION_ARG_STRING, &atspi_dbus_name,
    "D-Bus bus name to register as", NULL},
   {"atspi-no-register", 0, 0, G_OPTION_ARG_NONE, &atspi_no_register,
    "Do not register with Registry Daemon", NULL},
+  {"atspi-cache-batch-signals", 0, 0, G_OPTION_ARG_NONE, &spi_atk_cache_batch_signals,
+   "Send batched cache signals, which older clients do not understand", NULL},
+  {"atspi-lazy-cache", 0, 0, G_OPTION_ARG_NONE, &spi_atk_lazy_cache,
+   "Only cache the accessible tree once a client asks for it", NULL},
+  {"atspi-threaded-dispatch", 0, 0, G_OPTION_ARG_NONE, &spi_atk_threaded_dispatch,
+   "Read and write D-Bus messages on a separate thread", NULL},
+  {"atspi-coalesce", 0, 0, G_OPTION_ARG_STRING, &atspi_coalesce,
+   "Milliseconds to coalesce events over, as type=ms,...", NULL},
+  {"atspi-rate-limit", 0, 0, G_OPTION_ARG_STRING, &atspi_rate_limit,
+   "Events a second to send per object and event, as type=rate,...", NULL},
+  {"atspi-text-limit", 0, 0, G_OPTION_ARG_INT, &spi_atk_text_changed_limit,
+   "Longest text change, in characters, to send the text of, or 0 for any", NULL},
+  {"atspi-key-timeout", 0, 0, G_OPTION_ARG_INT, &spi_atk_key_timeout,
+   "Milliseconds to wait for key listeners to answer, or -1 for no limit", NULL},
   {NULL}
 };
 
@@ -447,6 +472,12 @@ adaptor_init (gint * argc, gchar ** argv[])
   DBusConnection *bus;
   AtkObject *root;
   gchar *introspection_directory;
+  const gchar *threaded;
+  const gchar *batch;
+  const gchar *coalesce;
+  const gchar *rate_limit;
+  const gchar *text_limit;
+  const gchar *key_timeout;
   static gboolean inited = FALSE;
 
   if (inited)
@@ -459,6 +490,14 @@ adaptor_init (gint * argc, gchar ** argv[])
   root = atk_get_root ();
   g_return_val_if_fail (root, 0);
 
+  /* The environment sets defaults that the command line overrides */
+  text_limit = g_getenv ("AT_SPI_TEXT_LIMIT");
+  if (text_limit)
+    spi_atk_text_changed_limit = atoi (text_limit);
+  key_timeout = g_getenv ("AT_SPI_KEY_TIMEOUT");
+  if (key_timeout)
+    spi_atk_key_timeout = atoi (key_timeout);
+
   /* Parse command line options */
   opt = g_option_context_new (NULL);
   g_option_context_add_main_entries (opt, atspi_option_entries, NULL);
@@ -466,6 +505,22 @@ adaptor_init (gint * argc, gchar ** argv[])
   if (!g_option_context_parse (opt, argc, argv, &err))
     g_warning ("AT-SPI Option parsing failed: %s\n", err->message);
 
+  batch = g_getenv ("AT_SPI_CACHE_BATCH_SIGNALS");
+  if (batch && g_ascii_strtod (batch, NULL) != 0)
+    spi_atk_cache_batch_signals = TRUE;
+
+  threaded = g_getenv ("AT_SPI_THREADED_DISPATCH");
+  if (threaded && g_ascii_strtod (threaded, NULL) != 0)
+    spi_atk_threaded_dispatch = TRUE;
+
+  /* Both libraries must be thread aware before the connection is opened */
+  if (spi_atk_threaded_dispatch)
+    {
+      if (!g_thread_supported ())
+        g_thread_init (NULL);
+      dbus_threads_init_default ();
+    }
+
   /* Allocate global data and do ATK initializations */
   spi_global_app_data = g_new0 (SpiBridge, 1);
   atk_misc = atk_misc_get_instance ();
@@ -514,6 +569,8 @@ adaptor_init (gint * argc, gchar ** argv[])
   /* Register droute for routing AT-SPI messages */
   spi_global_app_data->droute =
     droute_new (spi_global_app_data->bus);
+  if (g_getenv ("AT_SPI_STATS"))
+    droute_set_stats_enabled (spi_global_app_data->droute, TRUE);
 
   treepath = droute_add_one (spi_global_app_data->droute,
                              "/org/a11y/atspi/cache", spi_global_cache);
@@ -531,10 +588,14 @@ adaptor_init (gint * argc, gchar ** argv[])
                              NULL,
                              (DRouteGetDatumFunction)
                              spi_global_register_path_to_object);
+  droute_path_set_interface_mask (accpath, spi_object_get_interface_names (),
+                                  spi_object_get_implemented);
+  spi_global_app_data->accessible_path = accpath;
 
 
   /* Register all interfaces with droute and set up application accessible db */
   spi_initialize_cache (treepath);
+  spi_initialize_stats (treepath);
   spi_initialize_accessible (accpath);
   spi_initialize_application (accpath);
   spi_initialize_action (accpath);
@@ -551,6 +612,18 @@ adaptor_init (gint * argc, gchar ** argv[])
   spi_initialize_text (accpath);
   spi_initialize_value (accpath);
 
+  /* The command line overrides the environment */
+  coalesce = g_getenv ("AT_SPI_COALESCE");
+  if (coalesce)
+    spi_atk_set_coalesce_windows (coalesce);
+  if (atspi_coalesce)
+    spi_atk_set_coalesce_windows (atspi_coalesce);
+  rate_limit = g_getenv ("AT_SPI_RATE_LIMIT");
+  if (rate_limit)
+    spi_atk_set_rate_limits (rate_limit);
+  if (atspi_rate_limit)
+    spi_atk_set_rate_limits (atspi_rate_limit);
+
   /* Register methods to send D-Bus signals on certain ATK events */
   spi_atk_register_event_listeners ();
 
@@ -558,6 +631,11 @@ adaptor_init (gint * argc, gchar ** argv[])
   if (!atspi_no_register && (!root || !ATK_IS_PLUG (root)))
     register_application (spi_global_app_data);
 
+  /* Registration waits for its reply on this thread, so comes first */
+  if (spi_atk_threaded_dispatch &&
+      !droute_start_io_thread (spi_global_app_data->droute))
+    spi_atk_threaded_dispatch = FALSE;
+
   g_atexit (exit_func);
 
   return 0;
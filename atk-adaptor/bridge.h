@@ -41,6 +41,7 @@ struct _SpiBridge
 
   DBusConnection *bus;
   DRouteContext  *droute;
+  DRoutePath     *accessible_path;
 
 /*
   SpiRegister *reg;
@@ -53,6 +54,12 @@ struct _SpiBridge
 
 extern SpiBridge *spi_global_app_data;
 
+extern gboolean spi_atk_cache_batch_signals;
+extern gboolean spi_atk_lazy_cache;
+extern gboolean spi_atk_threaded_dispatch;
+extern gint spi_atk_text_changed_limit;
+extern gint spi_atk_key_timeout;
+
 G_END_DECLS
 
 #endif /* BRIDGE_H */
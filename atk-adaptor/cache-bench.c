@@ -0,0 +1,240 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Measures the cost of bridge startup for a large accessible tree,
+ * with the cache either walking the whole tree up front or waiting
+ * for a client to ask for it.
+ *
+ * Usage: cache-bench [eager|lazy] [nodes]
+ *
+ * The tree has 50000 nodes by default. Startup time and the growth in
+ * resident memory are reported, followed in lazy mode by the cost of
+ * the first full population.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <atk/atk.h>
+
+#include "accessible-cache.h"
+#include "accessible-register.h"
+#include "bridge.h"
+
+#define BENCH_DEFAULT_NODES 50000
+#define BENCH_FANOUT        8
+
+/* Globals normally provided by bridge.c */
+SpiBridge *spi_global_app_data = NULL;
+gboolean spi_atk_cache_batch_signals = FALSE;
+gboolean spi_atk_lazy_cache = FALSE;
+
+/*---------------------------------------------------------------------------*/
+
+typedef struct _BenchNode BenchNode;
+typedef struct _BenchNodeClass BenchNodeClass;
+
+struct _BenchNode
+{
+  AtkObject parent;
+  GPtrArray *children;
+};
+
+struct _BenchNodeClass
+{
+  AtkObjectClass parent_class;
+};
+
+GType bench_node_get_type (void);
+
+G_DEFINE_TYPE (BenchNode, bench_node, ATK_TYPE_OBJECT)
+
+static gint
+bench_node_get_n_children (AtkObject * accessible)
+{
+  return ((BenchNode *) accessible)->children->len;
+}
+
+static AtkObject *
+bench_node_ref_child (AtkObject * accessible, gint i)
+{
+  BenchNode *node = (BenchNode *) accessible;
+
+  if (i < 0 || i >= node->children->len)
+    return NULL;
+  return g_object_ref (g_ptr_array_index (node->children, i));
+}
+
+static void
+bench_node_init (BenchNode * node)
+{
+  node->children = g_ptr_array_new ();
+}
+
+static void
+bench_node_class_init (BenchNodeClass * klass)
+{
+  AtkObjectClass *atk_class = ATK_OBJECT_CLASS (klass);
+
+  atk_class->get_n_children = bench_node_get_n_children;
+  atk_class->ref_child = bench_node_ref_child;
+}
+
+/*
+ * Builds a tree of n nodes breadth first, each node having up to
+ * BENCH_FANOUT children.
+ */
+static AtkObject *
+build_tree (guint n)
+{
+  GQueue *parents = g_queue_new ();
+  BenchNode *root;
+  guint made = 1;
+
+  root = g_object_new (bench_node_get_type (), NULL);
+  atk_object_set_role (ATK_OBJECT (root), ATK_ROLE_APPLICATION);
+  g_queue_push_tail (parents, root);
+
+  while (made < n)
+    {
+      BenchNode *parent = g_queue_pop_head (parents);
+      guint i;
+
+      for (i = 0; i < BENCH_FANOUT && made < n; i++, made++)
+        {
+          BenchNode *child = g_object_new (bench_node_get_type (), NULL);
+
+          atk_object_set_role (ATK_OBJECT (child), ATK_ROLE_PANEL);
+          atk_object_set_parent (ATK_OBJECT (child), ATK_OBJECT (parent));
+          g_ptr_array_add (parent->children, child);
+          g_queue_push_tail (parents, child);
+        }
+    }
+
+  g_queue_free (parents);
+  return ATK_OBJECT (root);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static gulong
+rss_kb (void)
+{
+  FILE *statm = fopen ("/proc/self/statm", "r");
+  gulong size = 0, resident = 0;
+
+  if (!statm)
+    return 0;
+  if (fscanf (statm, "%lu %lu", &size, &resident) != 2)
+    resident = 0;
+  fclose (statm);
+  return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static void
+count_hf (gpointer key, gpointer value, gpointer data)
+{
+  (*(guint *) data)++;
+}
+
+static guint
+cache_size (void)
+{
+  guint count = 0;
+
+  spi_cache_foreach (spi_global_cache, count_hf, &count);
+  return count;
+}
+
+/*
+ * Registering each added object stands in for the cache adaptor,
+ * which looks up a path for every object it sends to clients.
+ */
+static void
+register_added (SpiCache * cache, GObject * gobj, gpointer data)
+{
+  gchar path[SPI_REGISTER_PATH_MAX];
+
+  spi_register_object_path_into (spi_global_register, gobj, path);
+}
+
+static void
+register_hf (gpointer key, gpointer value, gpointer data)
+{
+  register_added (NULL, G_OBJECT (key), data);
+}
+
+int
+main (int argc, char **argv)
+{
+  GTimer *timer;
+  guint n = BENCH_DEFAULT_NODES;
+  gulong rss_before;
+  gdouble startup;
+
+  g_type_init ();
+
+  if (argc > 1)
+    spi_atk_lazy_cache = !strcmp (argv[1], "lazy");
+  if (argc > 2)
+    n = atoi (argv[2]);
+
+  /* Measure the whole traversal rather than the first slice */
+  g_setenv ("AT_SPI_CACHE_SLICE_NODES", "0", TRUE);
+  g_setenv ("AT_SPI_CACHE_SLICE_US", "0", TRUE);
+
+  spi_global_app_data = g_new0 (SpiBridge, 1);
+  spi_global_app_data->root = build_tree (n);
+
+  rss_before = rss_kb ();
+  timer = g_timer_new ();
+
+  g_timer_start (timer);
+  spi_global_register = g_object_new (SPI_REGISTER_TYPE, NULL);
+  spi_global_cache = g_object_new (SPI_CACHE_TYPE, NULL);
+
+  /* Objects added during startup are registered before the handler exists */
+  spi_cache_foreach (spi_global_cache, register_hf, NULL);
+  startup = g_timer_elapsed (timer, NULL);
+  g_signal_connect (spi_global_cache, "object-added",
+                    (GCallback) register_added, NULL);
+
+  printf ("%-6s %8u nodes: startup %8.2f ms, %8u cached, RSS +%lu kB\n",
+          spi_atk_lazy_cache ? "lazy" : "eager", n, startup * 1e3,
+          cache_size (), rss_kb () - rss_before);
+
+  if (spi_atk_lazy_cache)
+    {
+      g_timer_start (timer);
+      spi_cache_populate (spi_global_cache,
+                          G_OBJECT (spi_global_app_data->root));
+      printf ("%-6s %8u nodes: populate %7.2f ms, %8u cached, RSS +%lu kB\n",
+              "lazy", n, g_timer_elapsed (timer, NULL) * 1e3,
+              cache_size (), rss_kb () - rss_before);
+    }
+
+  g_timer_destroy (timer);
+  return 0;
+}
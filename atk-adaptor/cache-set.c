@@ -0,0 +1,387 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "cache-set.h"
+
+#define SPI_CACHE_SET_SHARD_BITS 4
+#define SPI_CACHE_SET_SHARDS     (1 << SPI_CACHE_SET_SHARD_BITS)
+#define SPI_CACHE_SET_MIN_SLOTS  64
+
+/* Marks a slot whose object has been removed, probes carry on past it */
+static const gchar tombstone;
+#define TOMBSTONE ((gpointer) &tombstone)
+
+typedef struct _SetTable
+{
+  guint mask;
+  gpointer slots[1];
+} SetTable;
+
+/* The counts are only used by the writer */
+typedef struct _SetShard
+{
+  SetTable *table;
+  guint used;                   /* Slots holding an object or a tombstone */
+  guint live;
+} SetShard;
+
+typedef struct _RetiredTable
+{
+  SetTable *table;
+  gint epoch;
+} RetiredTable;
+
+struct _SpiCacheSet
+{
+  SetShard shards[SPI_CACHE_SET_SHARDS];
+  gint size;
+
+  /*
+   * Tables replaced in a shard are retired in the current epoch, which
+   * is then advanced. A retired table is freed once every reader in a
+   * read section entered it in a later epoch.
+   */
+  gint epoch;
+  GSList *retired;
+
+  GStaticMutex readers_lock;
+  GSList *readers;
+};
+
+struct _SpiCacheSetReader
+{
+  SpiCacheSet *set;
+  gint epoch;                   /* 0 outside of a read section */
+};
+
+/*---------------------------------------------------------------------------*/
+
+static inline guint
+object_hash (gconstpointer object)
+{
+  guint64 h = (guint64) GPOINTER_TO_SIZE (object);
+
+  return (guint) ((h * G_GUINT64_CONSTANT (0x9E3779B97F4A7C15)) >> 32);
+}
+
+#define SHARD_INDEX(h) ((h) & (SPI_CACHE_SET_SHARDS - 1))
+#define SLOT_INDEX(h, mask) (((h) >> SPI_CACHE_SET_SHARD_BITS) & (mask))
+
+static SetTable *
+table_new (guint n_slots)
+{
+  SetTable *table;
+
+  table = g_malloc0 (sizeof (SetTable) + (n_slots - 1) * sizeof (gpointer));
+  table->mask = n_slots - 1;
+  return table;
+}
+
+static void
+reclaim_tables (SpiCacheSet * set)
+{
+  GSList *l, *next;
+  gint oldest = G_MAXINT;
+
+  g_static_mutex_lock (&set->readers_lock);
+  for (l = set->readers; l; l = l->next)
+    {
+      SpiCacheSetReader *reader = l->data;
+      gint epoch = g_atomic_int_get (&reader->epoch);
+
+      if (epoch && epoch < oldest)
+        oldest = epoch;
+    }
+  g_static_mutex_unlock (&set->readers_lock);
+
+  for (l = set->retired; l; l = next)
+    {
+      RetiredTable *retired = l->data;
+
+      next = l->next;
+      if (retired->epoch < oldest)
+        {
+          g_free (retired->table);
+          g_slice_free (RetiredTable, retired);
+          set->retired = g_slist_delete_link (set->retired, l);
+        }
+    }
+}
+
+/*
+ * Copies the live objects of a shard into a new table with room for
+ * them to double, and publishes it. Readers may still be probing the
+ * old table, so it is retired rather than freed.
+ */
+static void
+shard_rebuild (SpiCacheSet * set, SetShard * shard)
+{
+  SetTable *old = shard->table;
+  SetTable *table;
+  RetiredTable *retired;
+  guint n_slots = SPI_CACHE_SET_MIN_SLOTS;
+  guint i;
+
+  while (n_slots < shard->live * 4)
+    n_slots <<= 1;
+
+  table = table_new (n_slots);
+  for (i = 0; i <= old->mask; i++)
+    {
+      gpointer object = old->slots[i];
+      guint j;
+
+      if (object == NULL || object == TOMBSTONE)
+        continue;
+
+      j = SLOT_INDEX (object_hash (object), table->mask);
+      while (table->slots[j])
+        j = (j + 1) & table->mask;
+      table->slots[j] = object;
+    }
+  shard->used = shard->live;
+
+  /*
+   * The exchange is a full barrier, so a reader that has not been seen
+   * in a read section by reclaim_tables will only find the new table.
+   */
+  g_atomic_pointer_compare_and_exchange ((gpointer *) &shard->table,
+                                         old, table);
+
+  retired = g_slice_new (RetiredTable);
+  retired->table = old;
+  retired->epoch = g_atomic_int_get (&set->epoch);
+  set->retired = g_slist_prepend (set->retired, retired);
+  g_atomic_int_inc (&set->epoch);
+
+  reclaim_tables (set);
+}
+
+/*---------------------------------------------------------------------------*/
+
+SpiCacheSet *
+spi_cache_set_new (void)
+{
+  SpiCacheSet *set = g_new0 (SpiCacheSet, 1);
+  guint i;
+
+  for (i = 0; i < SPI_CACHE_SET_SHARDS; i++)
+    set->shards[i].table = table_new (SPI_CACHE_SET_MIN_SLOTS);
+  set->epoch = 1;
+  g_static_mutex_init (&set->readers_lock);
+  return set;
+}
+
+void
+spi_cache_set_free (SpiCacheSet * set)
+{
+  guint i;
+
+  if (set->readers)
+    g_warning ("AT-SPI: Cache set freed while it still has readers");
+
+  set->readers = NULL;
+  reclaim_tables (set);
+
+  for (i = 0; i < SPI_CACHE_SET_SHARDS; i++)
+    g_free (set->shards[i].table);
+  g_static_mutex_free (&set->readers_lock);
+  g_free (set);
+}
+
+/*
+ * Adds an object to the set. May only be called from the writer thread.
+ *
+ * Returns FALSE if the object was already in the set.
+ */
+gboolean
+spi_cache_set_add (SpiCacheSet * set, gpointer object)
+{
+  guint h = object_hash (object);
+  SetShard *shard = &set->shards[SHARD_INDEX (h)];
+  SetTable *table = shard->table;
+  guint i, free_slot = G_MAXUINT;
+
+  g_return_val_if_fail (object != NULL && object != TOMBSTONE, FALSE);
+
+  for (i = SLOT_INDEX (h, table->mask); table->slots[i];
+       i = (i + 1) & table->mask)
+    {
+      if (table->slots[i] == object)
+        return FALSE;
+      if (table->slots[i] == TOMBSTONE && free_slot == G_MAXUINT)
+        free_slot = i;
+    }
+
+  if (free_slot == G_MAXUINT)
+    {
+      /* Keeping half the slots empty keeps probes short */
+      if ((shard->used + 1) * 2 > table->mask + 1)
+        {
+          shard_rebuild (set, shard);
+          table = shard->table;
+          for (i = SLOT_INDEX (h, table->mask); table->slots[i];
+               i = (i + 1) & table->mask)
+            ;
+        }
+      free_slot = i;
+      shard->used++;
+    }
+
+  g_atomic_pointer_set (&table->slots[free_slot], object);
+  shard->live++;
+  g_atomic_int_inc (&set->size);
+  return TRUE;
+}
+
+/*
+ * Removes an object from the set. May only be called from the writer
+ * thread.
+ *
+ * Returns FALSE if the object was not in the set.
+ */
+gboolean
+spi_cache_set_remove (SpiCacheSet * set, gconstpointer object)
+{
+  guint h = object_hash (object);
+  SetShard *shard = &set->shards[SHARD_INDEX (h)];
+  SetTable *table = shard->table;
+  guint i;
+
+  for (i = SLOT_INDEX (h, table->mask); table->slots[i];
+       i = (i + 1) & table->mask)
+    {
+      if (table->slots[i] == object)
+        {
+          g_atomic_pointer_set (&table->slots[i], TOMBSTONE);
+          shard->live--;
+          g_atomic_int_add (&set->size, -1);
+          return TRUE;
+        }
+    }
+  return FALSE;
+}
+
+guint
+spi_cache_set_size (SpiCacheSet * set)
+{
+  return g_atomic_int_get (&set->size);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Readers are created once per thread and may then enter and leave
+ * read sections at no more cost than a pair of atomic operations.
+ */
+SpiCacheSetReader *
+spi_cache_set_reader_new (SpiCacheSet * set)
+{
+  SpiCacheSetReader *reader = g_slice_new0 (SpiCacheSetReader);
+
+  reader->set = set;
+  g_static_mutex_lock (&set->readers_lock);
+  set->readers = g_slist_prepend (set->readers, reader);
+  g_static_mutex_unlock (&set->readers_lock);
+  return reader;
+}
+
+void
+spi_cache_set_reader_free (SpiCacheSetReader * reader)
+{
+  SpiCacheSet *set = reader->set;
+
+  g_static_mutex_lock (&set->readers_lock);
+  set->readers = g_slist_remove (set->readers, reader);
+  g_static_mutex_unlock (&set->readers_lock);
+  g_slice_free (SpiCacheSetReader, reader);
+}
+
+void
+spi_cache_set_read_begin (SpiCacheSetReader * reader)
+{
+  gint epoch = g_atomic_int_get (&reader->set->epoch);
+
+  /*
+   * The exchange is a full barrier, so the epoch is visible to the
+   * writer before any table is read. Read sections do not nest.
+   */
+  if (!g_atomic_int_compare_and_exchange (&reader->epoch, 0, epoch))
+    g_warning ("AT-SPI: Nested cache set read section");
+}
+
+void
+spi_cache_set_read_end (SpiCacheSetReader * reader)
+{
+  g_atomic_int_set (&reader->epoch, 0);
+}
+
+/*
+ * Returns TRUE if the object is in the set. From any thread other
+ * than the writer this must be called within a read section.
+ */
+gboolean
+spi_cache_set_contains (SpiCacheSet * set, gconstpointer object)
+{
+  guint h = object_hash (object);
+  SetTable *table = g_atomic_pointer_get (&set->shards[SHARD_INDEX (h)].table);
+  guint i = SLOT_INDEX (h, table->mask);
+  gpointer current;
+
+  while ((current = g_atomic_pointer_get (&table->slots[i])))
+    {
+      if (current == object)
+        return TRUE;
+      i = (i + 1) & table->mask;
+    }
+  return FALSE;
+}
+
+/*
+ * Copies the objects in the set into a new array. From any thread
+ * other than the writer this must be called within a read section.
+ *
+ * The objects themselves are not referenced.
+ */
+GPtrArray *
+spi_cache_set_snapshot (SpiCacheSet * set)
+{
+  GPtrArray *objects;
+  guint s, i;
+
+  objects = g_ptr_array_sized_new (spi_cache_set_size (set));
+  for (s = 0; s < SPI_CACHE_SET_SHARDS; s++)
+    {
+      SetTable *table = g_atomic_pointer_get (&set->shards[s].table);
+
+      for (i = 0; i <= table->mask; i++)
+        {
+          gpointer current = g_atomic_pointer_get (&table->slots[i]);
+
+          if (current && current != TOMBSTONE)
+            g_ptr_array_add (objects, current);
+        }
+    }
+  return objects;
+}
+
+/*END------------------------------------------------------------------------*/
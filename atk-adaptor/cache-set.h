@@ -0,0 +1,82 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef CACHE_SET_H
+#define CACHE_SET_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A set of object pointers that one writer thread updates while any
+ * number of other threads read it without locking.
+ *
+ * The set is split into shards, each an open-addressing table whose
+ * slots are read and written atomically. A shard that needs to grow
+ * is copied and the copy published in its place. The old copy is
+ * freed once no reader that might still see it remains, which readers
+ * show by bracketing their accesses with spi_cache_set_read_begin and
+ * spi_cache_set_read_end.
+ *
+ * Readers see each add and remove as it happens but are not given a
+ * single point in time view of the whole set. The writer thread may
+ * read the set without a reader.
+ */
+typedef struct _SpiCacheSet SpiCacheSet;
+typedef struct _SpiCacheSetReader SpiCacheSetReader;
+
+SpiCacheSet *
+spi_cache_set_new (void);
+
+void
+spi_cache_set_free (SpiCacheSet * set);
+
+gboolean
+spi_cache_set_add (SpiCacheSet * set, gpointer object);
+
+gboolean
+spi_cache_set_remove (SpiCacheSet * set, gconstpointer object);
+
+guint
+spi_cache_set_size (SpiCacheSet * set);
+
+SpiCacheSetReader *
+spi_cache_set_reader_new (SpiCacheSet * set);
+
+void
+spi_cache_set_reader_free (SpiCacheSetReader * reader);
+
+void
+spi_cache_set_read_begin (SpiCacheSetReader * reader);
+
+void
+spi_cache_set_read_end (SpiCacheSetReader * reader);
+
+gboolean
+spi_cache_set_contains (SpiCacheSet * set, gconstpointer object);
+
+GPtrArray *
+spi_cache_set_snapshot (SpiCacheSet * set);
+
+G_END_DECLS
+#endif /* CACHE_SET_H */
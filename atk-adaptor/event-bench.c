@@ -0,0 +1,269 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Measures what emitting an event costs the bridge for the names it is
+ * sent under, against querying the signal and converting its name for
+ * every event as the listeners did before. Then measures how many event
+ * messages a second can be built field by field, and from templates.
+ *
+ * Usage: event-bench [iterations]
+ *
+ * The events are a mix of the ATK signals busy applications emit most.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atk/atk.h>
+#include <dbus/dbus.h>
+
+#include "event-names.h"
+#include "event-template.h"
+
+#define BENCH_DEFAULT_ITERATIONS 1000000
+
+#define BENCH_INTERFACE "org.a11y.atspi.Event.Object"
+#define BENCH_PATH      "/org/a11y/atspi/accessible/1234"
+#define BENCH_APP_NAME  ":1.42"
+#define BENCH_APP_PATH  "/org/a11y/atspi/accessible/root"
+
+typedef struct _BenchSignal
+{
+  const gchar *name;
+  const gchar *detail;
+} BenchSignal;
+
+static const BenchSignal bench_signals[] = {
+  {"property-change", "accessible-name"},
+  {"property-change", "accessible-value"},
+  {"state-change", "focused"},
+  {"state-change", "showing"},
+  {"children-changed", "add"},
+  {"children-changed", "remove"},
+  {"visible-data-changed", NULL},
+  {"active-descendant-changed", NULL}
+};
+
+typedef struct _BenchHint
+{
+  guint signal_id;
+  GQuark detail;
+} BenchHint;
+
+static volatile gsize bench_sink;
+
+/*---------------------------------------------------------------------------*/
+
+/* How each event was named before */
+static gchar *
+signal_name_to_dbus (const gchar * s)
+{
+  gchar *ret = g_strdup (s);
+  gchar *t;
+
+  if (!ret)
+    return NULL;
+  ret[0] = toupper (ret[0]);
+  while ((t = strchr (ret, '-')) != NULL)
+    {
+      memmove (t, t + 1, strlen (t));
+      *t = toupper (*t);
+    }
+  return ret;
+}
+
+/* As emit_event builds an event without a template */
+static void
+build_message (const gchar * member, const gchar * minor)
+{
+  DBusMessage *sig;
+  DBusMessageIter iter, sub;
+  dbus_int32_t detail = 0;
+  const char *app_name = BENCH_APP_NAME;
+  const char *app_path = BENCH_APP_PATH;
+
+  sig = dbus_message_new_signal (BENCH_PATH, BENCH_INTERFACE, member);
+  dbus_message_iter_init_append (sig, &iter);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &minor);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &detail);
+  dbus_message_iter_append_basic (&iter, DBUS_TYPE_INT32, &detail);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_VARIANT,
+                                    DBUS_TYPE_INT32_AS_STRING, &sub);
+  dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &detail);
+  dbus_message_iter_close_container (&iter, &sub);
+  dbus_message_iter_open_container (&iter, DBUS_TYPE_STRUCT, NULL, &sub);
+  dbus_message_iter_append_basic (&sub, DBUS_TYPE_STRING, &app_name);
+  dbus_message_iter_append_basic (&sub, DBUS_TYPE_OBJECT_PATH, &app_path);
+  dbus_message_iter_close_container (&iter, &sub);
+  dbus_message_unref (sig);
+}
+
+static gdouble
+time_queried (const BenchHint * hints, guint n_hints, guint iterations,
+              gboolean with_message)
+{
+  GTimer *timer = g_timer_new ();
+  gsize total = 0;
+  gdouble elapsed;
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    {
+      const BenchHint *hint = &hints[i % n_hints];
+      GSignalQuery query;
+      const gchar *minor;
+      gchar *member;
+
+      g_signal_query (hint->signal_id, &query);
+      minor = g_quark_to_string (hint->detail);
+      member = signal_name_to_dbus (query.signal_name);
+      if (with_message)
+        build_message (member, minor ? minor : "");
+      total += strlen (member);
+      g_free (member);
+    }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+  bench_sink = total;
+  return elapsed;
+}
+
+static gdouble
+time_table (const BenchHint * hints, guint n_hints, guint iterations,
+            gboolean with_message)
+{
+  GTimer *timer = g_timer_new ();
+  gsize total = 0;
+  gdouble elapsed;
+  guint i;
+
+  for (i = 0; i < iterations; i++)
+    {
+      const BenchHint *hint = &hints[i % n_hints];
+      const SpiEventName *names;
+      const gchar *member;
+
+      names = spi_event_name_lookup (hint->signal_id, hint->detail);
+      member = spi_event_member_lookup (names->name);
+      if (with_message)
+        build_message (member, names->minor);
+      total += (gsize) member;
+    }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+  bench_sink = total;
+  return elapsed;
+}
+
+/* Templates are kept per member, as emit_event keeps them */
+static gdouble
+time_templates (const BenchHint * hints, guint n_hints, guint iterations)
+{
+  GHashTable *templates;
+  GTimer *timer;
+  gdouble elapsed;
+  guint i;
+
+  templates = g_hash_table_new_full (NULL, NULL, NULL,
+                                     (GDestroyNotify) spi_event_template_free);
+  timer = g_timer_new ();
+  for (i = 0; i < iterations; i++)
+    {
+      const BenchHint *hint = &hints[i % n_hints];
+      const SpiEventName *names;
+      SpiEventTemplate *tmpl;
+      DBusMessage *sig;
+      dbus_int32_t detail = 0;
+
+      names = spi_event_name_lookup (hint->signal_id, hint->detail);
+      tmpl = g_hash_table_lookup (templates, names->member);
+      if (!tmpl)
+        {
+          tmpl = spi_event_template_new (BENCH_INTERFACE, names->member,
+                                         BENCH_APP_NAME, BENCH_APP_PATH);
+          g_hash_table_insert (templates, (gpointer) names->member, tmpl);
+        }
+      sig = spi_event_template_build (tmpl, BENCH_PATH, names->minor,
+                                      detail, detail, DBUS_TYPE_INT32,
+                                      &detail);
+      dbus_message_unref (sig);
+    }
+
+  elapsed = g_timer_elapsed (timer, NULL);
+  g_timer_destroy (timer);
+  g_hash_table_destroy (templates);
+  return elapsed;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int
+main (int argc, char **argv)
+{
+  BenchHint hints[G_N_ELEMENTS (bench_signals)];
+  guint iterations = BENCH_DEFAULT_ITERATIONS;
+  guint n = G_N_ELEMENTS (bench_signals);
+  gpointer klass;
+  guint i;
+
+  g_type_init ();
+
+  if (argc > 1)
+    iterations = atoi (argv[1]);
+  if (iterations == 0)
+    iterations = 1;
+
+  /* The signals are created with the class */
+  klass = g_type_class_ref (ATK_TYPE_OBJECT);
+  for (i = 0; i < n; i++)
+    {
+      hints[i].signal_id = g_signal_lookup (bench_signals[i].name,
+                                            ATK_TYPE_OBJECT);
+      hints[i].detail = bench_signals[i].detail ?
+        g_quark_from_static_string (bench_signals[i].detail) : 0;
+      g_assert (hints[i].signal_id != 0);
+    }
+
+  /* Warm both paths, which also fills the table */
+  time_queried (hints, n, n, TRUE);
+  time_table (hints, n, n, TRUE);
+
+  printf ("names, queried:        %7.1f ns per event\n",
+          time_queried (hints, n, iterations, FALSE) * 1e9 / iterations);
+  printf ("names, table:          %7.1f ns per event\n",
+          time_table (hints, n, iterations, FALSE) * 1e9 / iterations);
+  printf ("field by field:        %7.0f events per second\n",
+          iterations / time_table (hints, n, iterations, TRUE));
+  printf ("template:              %7.0f events per second\n",
+          iterations / time_templates (hints, n, iterations));
+
+  spi_event_names_clear ();
+  g_type_class_unref (klass);
+  return 0;
+}
+
+/*END------------------------------------------------------------------------*/
@@ -0,0 +1,384 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "event-limit.h"
+#include "event-names.h"
+
+#define RATE_LIMIT_DEFAULT 100
+
+typedef struct _SpiEventRate
+{
+  SpiEventLimitCounts counts;   /* The type is the name it was set under */
+  guint rate;
+} SpiEventRate;
+
+struct _SpiEventBucket
+{
+  GObject *object;
+  const gchar *major;           /* Interned */
+  const gchar *minor;           /* Interned */
+  SpiEventRate *rate;
+  gdouble tokens;
+  gint64 last;
+  GSList *held;                 /* Newest first */
+  gboolean lease;
+};
+
+/* What a pass over the buckets needs */
+typedef struct _SpiEventSweep
+{
+  gint64 now;
+  SpiEventSendFunc func;
+  gpointer data;
+  GSList *ready;
+} SpiEventSweep;
+
+static GSList *rates = NULL;
+static GHashTable *buckets = NULL;      /* Object and event -> bucket */
+static GHashTable *objects = NULL;      /* Object -> its buckets */
+
+/*---------------------------------------------------------------------------*/
+
+static SpiEventRate *
+rate_find (const gchar * type)
+{
+  GSList *l;
+
+  for (l = rates; l; l = l->next)
+    {
+      SpiEventRate *rate = l->data;
+
+      if (spi_event_name_equal (rate->counts.type, type))
+        return rate;
+    }
+  return NULL;
+}
+
+static void
+rate_add (const gchar * type, guint value)
+{
+  SpiEventRate *rate = g_new0 (SpiEventRate, 1);
+
+  rate->counts.type = g_intern_string (type);
+  rate->rate = value;
+  rates = g_slist_append (rates, rate);
+}
+
+static void
+ensure_rates (void)
+{
+  static gboolean done = FALSE;
+
+  if (done)
+    return;
+  done = TRUE;
+  rate_add ("property-change", RATE_LIMIT_DEFAULT);
+  rate_add ("state-changed", RATE_LIMIT_DEFAULT);
+}
+
+/*
+ * Sets the rate of an event type, matched as clients match event names,
+ * so "property-change" also limits "PropertyChange". 0 does not limit it.
+ */
+void
+spi_event_limit_set_rate (const gchar * type, guint value)
+{
+  SpiEventRate *rate;
+
+  ensure_rates ();
+  rate = rate_find (type);
+  if (rate)
+    rate->rate = value;
+  else
+    rate_add (type, value);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static guint
+bucket_hash (gconstpointer data)
+{
+  const SpiEventBucket *bucket = data;
+
+  return g_direct_hash (bucket->object) ^ g_str_hash (bucket->major) ^
+         g_str_hash (bucket->minor);
+}
+
+static gboolean
+bucket_equal (gconstpointer a, gconstpointer b)
+{
+  const SpiEventBucket *ba = a;
+  const SpiEventBucket *bb = b;
+
+  return ba->object == bb->object && !strcmp (ba->major, bb->major) &&
+         !strcmp (ba->minor, bb->minor);
+}
+
+static void
+bucket_drop_held (SpiEventBucket * bucket)
+{
+  g_slist_foreach (bucket->held, (GFunc) dbus_message_unref, NULL);
+  g_slist_free (bucket->held);
+  bucket->held = NULL;
+}
+
+/* Frees a bucket already taken out of the bucket table */
+static void
+bucket_free (SpiEventBucket * bucket)
+{
+  GSList *list;
+
+  list = g_hash_table_lookup (objects, bucket->object);
+  list = g_slist_remove (list, bucket);
+  if (list)
+    g_hash_table_insert (objects, bucket->object, list);
+  else
+    g_hash_table_remove (objects, bucket->object);
+
+  bucket_drop_held (bucket);
+  g_object_unref (bucket->object);
+  g_free (bucket);
+}
+
+static void
+bucket_refill (SpiEventBucket * bucket, gint64 now)
+{
+  guint rate = bucket->rate->rate;
+
+  if (now > bucket->last)
+    bucket->tokens = MIN (rate, bucket->tokens +
+                          (gdouble) (now - bucket->last) * rate / G_USEC_PER_SEC);
+  bucket->last = now;
+}
+
+/* Hands the held messages to func, which sends them */
+static void
+bucket_send_held (SpiEventBucket * bucket, SpiEventSendFunc func,
+                  gpointer data)
+{
+  bucket->held = g_slist_reverse (bucket->held);
+  bucket->rate->counts.flushed++;
+  func (bucket->object, bucket->held, bucket->lease, data);
+  bucket_drop_held (bucket);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Takes a token for an event, and returns NULL if it should be sent.
+ * Otherwise returns the bucket to hold the event in.
+ */
+SpiEventBucket *
+spi_event_limit_take (GObject * object, const gchar * major,
+                      const gchar * minor, gint64 now)
+{
+  SpiEventBucket key, *bucket;
+  SpiEventRate *rate;
+
+  ensure_rates ();
+  rate = rate_find (major);
+  if (!rate || !rate->rate)
+    return NULL;
+
+  if (!buckets)
+    {
+      buckets = g_hash_table_new (bucket_hash, bucket_equal);
+      objects = g_hash_table_new (NULL, NULL);
+    }
+
+  key.object = object;
+  key.major = major;
+  key.minor = minor;
+  bucket = g_hash_table_lookup (buckets, &key);
+  if (!bucket)
+    {
+      GSList *list;
+
+      bucket = g_new0 (SpiEventBucket, 1);
+      bucket->object = g_object_ref (object);
+      bucket->major = g_intern_string (major);
+      bucket->minor = g_intern_string (minor);
+      bucket->rate = rate;
+      bucket->tokens = rate->rate;
+      bucket->last = now;
+      g_hash_table_insert (buckets, bucket, bucket);
+      list = g_hash_table_lookup (objects, object);
+      g_hash_table_insert (objects, object, g_slist_prepend (list, bucket));
+    }
+  else
+    bucket_refill (bucket, now);
+
+  if (bucket->tokens < 1)
+    return bucket;
+
+  bucket->tokens -= 1;
+  /* The event sent now supersedes any held */
+  bucket_drop_held (bucket);
+  return NULL;
+}
+
+/* Holds an event in place of any held before */
+void
+spi_event_limit_hold (SpiEventBucket * bucket, DBusMessage * message,
+                      gboolean lease)
+{
+  bucket_drop_held (bucket);
+  bucket->held = g_slist_prepend (NULL, dbus_message_ref (message));
+  bucket->lease = lease;
+  bucket->rate->counts.dropped++;
+}
+
+/* Holds a message that is to follow the event just held */
+void
+spi_event_limit_hold_also (SpiEventBucket * bucket, DBusMessage * message)
+{
+  bucket->held = g_slist_prepend (bucket->held, dbus_message_ref (message));
+}
+
+/*
+ * Sends whatever is held for an object, whether or not the rate allows
+ * it, so that no other event for the object overtakes it.
+ */
+void
+spi_event_limit_flush_object (GObject * object, SpiEventSendFunc func,
+                              gpointer data)
+{
+  GSList *l;
+
+  if (!objects)
+    return;
+
+  for (l = g_hash_table_lookup (objects, object); l; l = l->next)
+    {
+      SpiEventBucket *bucket = l->data;
+
+      if (!bucket->held)
+        continue;
+      bucket->tokens -= 1;
+      bucket_send_held (bucket, func, data);
+    }
+}
+
+static gboolean
+bucket_sweep (gpointer key, gpointer value, gpointer data)
+{
+  SpiEventBucket *bucket = value;
+  SpiEventSweep *sweep = data;
+
+  bucket_refill (bucket, sweep->now);
+  if (bucket->held && bucket->tokens >= 1)
+    {
+      bucket->tokens -= 1;
+      sweep->ready = g_slist_prepend (sweep->ready, bucket);
+      return FALSE;
+    }
+  if (!bucket->held && bucket->tokens >= bucket->rate->rate)
+    {
+      bucket_free (bucket);
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/*
+ * Sends the events the rate now allows, and frees the buckets that have
+ * refilled and hold nothing. Returns TRUE while any bucket is left.
+ */
+gboolean
+spi_event_limit_sweep (gint64 now, SpiEventSendFunc func, gpointer data)
+{
+  SpiEventSweep sweep;
+  GSList *l;
+
+  if (!buckets)
+    return FALSE;
+
+  sweep.now = now;
+  sweep.ready = NULL;
+  g_hash_table_foreach_remove (buckets, bucket_sweep, &sweep);
+  for (l = sweep.ready; l; l = l->next)
+    bucket_send_held (l->data, func, data);
+  g_slist_free (sweep.ready);
+
+  return g_hash_table_size (buckets) != 0;
+}
+
+/* Returns TRUE while any bucket is left for a sweep to free */
+gboolean
+spi_event_limit_active (void)
+{
+  return buckets && g_hash_table_size (buckets) != 0;
+}
+
+static gboolean
+bucket_clear (gpointer key, gpointer value, gpointer data)
+{
+  SpiEventBucket *bucket = value;
+  SpiEventSweep *clear = data;
+
+  if (bucket->held)
+    bucket_send_held (bucket, clear->func, clear->data);
+  bucket_free (bucket);
+  return TRUE;
+}
+
+/* Sends everything held and forgets every bucket */
+void
+spi_event_limit_clear (SpiEventSendFunc func, gpointer data)
+{
+  SpiEventSweep clear;
+
+  if (!buckets)
+    return;
+
+  clear.func = func;
+  clear.data = data;
+  g_hash_table_foreach_remove (buckets, bucket_clear, &clear);
+}
+
+void
+spi_event_limit_foreach (SpiEventLimitFunc func, gpointer data)
+{
+  GSList *l;
+
+  ensure_rates ();
+  for (l = rates; l; l = l->next)
+    func (&((SpiEventRate *) l->data)->counts, data);
+}
+
+void
+spi_event_limit_reset_counts (void)
+{
+  GSList *l;
+
+  for (l = rates; l; l = l->next)
+    {
+      SpiEventRate *rate = l->data;
+
+      rate->counts.dropped = 0;
+      rate->counts.flushed = 0;
+    }
+}
+
+/*END------------------------------------------------------------------------*/
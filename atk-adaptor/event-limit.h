@@ -0,0 +1,86 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVENT_LIMIT_H
+#define EVENT_LIMIT_H
+
+#include <dbus/dbus.h>
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Limits the rate of events per object, event type and detail. Each event
+ * type has a rate, in events a second, with a burst of one second's
+ * worth. Events over the limit are held rather than sent, the latest
+ * replacing any before it, and released once the rate allows or when
+ * another event for the object is sent.
+ *
+ * Times are in microseconds, as from g_get_monotonic_time ().
+ */
+typedef struct _SpiEventBucket SpiEventBucket;
+
+/*
+ * Events of a type over its rate. Of those, flushed counts the latest
+ * for an object, sent once the rate allowed it.
+ */
+typedef struct _SpiEventLimitCounts
+{
+  const gchar *type;
+  guint dropped;
+  guint flushed;
+} SpiEventLimitCounts;
+
+typedef void (*SpiEventLimitFunc) (const SpiEventLimitCounts *counts,
+                                   gpointer data);
+
+/* Called with the messages held for an object, oldest first */
+typedef void (*SpiEventSendFunc) (GObject *object, GSList *messages,
+                                  gboolean lease, gpointer data);
+
+void spi_event_limit_set_rate (const gchar *type, guint rate);
+
+SpiEventBucket *spi_event_limit_take (GObject *object, const gchar *major,
+                                      const gchar *minor, gint64 now);
+
+void spi_event_limit_hold (SpiEventBucket *bucket, DBusMessage *message,
+                           gboolean lease);
+
+void spi_event_limit_hold_also (SpiEventBucket *bucket, DBusMessage *message);
+
+void spi_event_limit_flush_object (GObject *object, SpiEventSendFunc func,
+                                   gpointer data);
+
+gboolean spi_event_limit_sweep (gint64 now, SpiEventSendFunc func,
+                                gpointer data);
+
+gboolean spi_event_limit_active (void);
+
+void spi_event_limit_clear (SpiEventSendFunc func, gpointer data);
+
+void spi_event_limit_foreach (SpiEventLimitFunc func, gpointer data);
+
+void spi_event_limit_reset_counts (void);
+
+G_END_DECLS
+
+#endif /* EVENT_LIMIT_H */
@@ -0,0 +1,173 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "event-names.h"
+
+/*
+ * Listeners used to query each signal for its name, and each event
+ * converted the name to a D-Bus member in a newly allocated string.
+ * Both are now worked out once, the first time a signal and detail are
+ * seen, and looked up on every later emission.
+ */
+typedef struct _SpiSignalEntry
+{
+  guint signal_id;
+  GQuark detail;
+  SpiEventName names;
+} SpiSignalEntry;
+
+static GHashTable *signal_entries = NULL;       /* Signal and detail -> entry */
+static GHashTable *members = NULL;              /* Major name -> member */
+
+/*---------------------------------------------------------------------------*/
+
+static guint
+signal_entry_hash (gconstpointer data)
+{
+  const SpiSignalEntry *entry = data;
+
+  return entry->signal_id * 31 + entry->detail;
+}
+
+static gboolean
+signal_entry_equal (gconstpointer a, gconstpointer b)
+{
+  const SpiSignalEntry *ea = a;
+  const SpiSignalEntry *eb = b;
+
+  return ea->signal_id == eb->signal_id && ea->detail == eb->detail;
+}
+
+/*
+ * '-' is not allowed in D-Bus member names, so "children-changed"
+ * is sent as "ChildrenChanged".
+ */
+static const gchar *
+member_new (const gchar * major)
+{
+  gchar *s = g_strdup (major);
+  const gchar *member;
+  gchar *t;
+
+  s[0] = toupper (s[0]);
+  while ((t = strchr (s, '-')) != NULL)
+    {
+      memmove (t, t + 1, strlen (t));
+      *t = toupper (*t);
+    }
+  member = g_intern_string (s);
+  g_free (s);
+  return member;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Compares event names ignoring case and separators, as the bridge sends
+ * "PropertyChange" where clients ask for "property-change".
+ */
+gboolean
+spi_event_name_equal (const gchar * a, const gchar * b)
+{
+  for (;;)
+    {
+      while (*a == '-' || *a == '_')
+        a++;
+      while (*b == '-' || *b == '_')
+        b++;
+      if (g_ascii_tolower (*a) != g_ascii_tolower (*b))
+        return FALSE;
+      if (!*a)
+        return TRUE;
+      a++;
+      b++;
+    }
+}
+
+/*
+ * Returns the D-Bus member for an event's major name. Names are looked
+ * up by address, so they must live as long as the process, as signal
+ * names and string literals do.
+ */
+const gchar *
+spi_event_member_lookup (const gchar * major)
+{
+  const gchar *member;
+
+  if (G_UNLIKELY (!members))
+    members = g_hash_table_new (NULL, NULL);
+
+  member = g_hash_table_lookup (members, major);
+  if (G_UNLIKELY (!member))
+    {
+      member = member_new (major);
+      g_hash_table_insert (members, (gpointer) major, (gpointer) member);
+    }
+  return member;
+}
+
+/*
+ * Returns the names for a signal emission, from the signal id and
+ * detail of its invocation hint.
+ */
+const SpiEventName *
+spi_event_name_lookup (guint signal_id, GQuark detail)
+{
+  SpiSignalEntry key, *entry;
+  const gchar *minor;
+
+  if (G_UNLIKELY (!signal_entries))
+    signal_entries = g_hash_table_new_full (signal_entry_hash,
+                                            signal_entry_equal, g_free, NULL);
+
+  key.signal_id = signal_id;
+  key.detail = detail;
+  entry = g_hash_table_lookup (signal_entries, &key);
+  if (G_LIKELY (entry))
+    return &entry->names;
+
+  entry = g_new (SpiSignalEntry, 1);
+  entry->signal_id = signal_id;
+  entry->detail = detail;
+  entry->names.name = g_intern_string (g_signal_name (signal_id));
+  entry->names.member = spi_event_member_lookup (entry->names.name);
+  minor = detail ? g_quark_to_string (detail) : NULL;
+  entry->names.minor = minor ? minor : "";
+  g_hash_table_insert (signal_entries, entry, entry);
+  return &entry->names;
+}
+
+void
+spi_event_names_clear (void)
+{
+  if (signal_entries)
+    g_hash_table_destroy (signal_entries);
+  signal_entries = NULL;
+  if (members)
+    g_hash_table_destroy (members);
+  members = NULL;
+}
+
+/*END------------------------------------------------------------------------*/
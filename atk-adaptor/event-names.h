@@ -0,0 +1,51 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVENT_NAMES_H
+#define EVENT_NAMES_H
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The names an ATK signal is sent under. The strings are owned by the
+ * table and live as long as the process.
+ */
+typedef struct _SpiEventName
+{
+  const gchar *name;            /* The ATK signal name, "children-changed" */
+  const gchar *member;          /* The D-Bus signal name, "ChildrenChanged" */
+  const gchar *minor;           /* The signal detail, "add", or "" */
+} SpiEventName;
+
+const SpiEventName *spi_event_name_lookup (guint signal_id, GQuark detail);
+
+const gchar *spi_event_member_lookup (const gchar *major);
+
+gboolean spi_event_name_equal (const gchar *a, const gchar *b);
+
+void spi_event_names_clear (void);
+
+G_END_DECLS
+
+#endif /* EVENT_NAMES_H */
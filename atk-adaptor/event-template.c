@@ -0,0 +1,214 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "event-template.h"
+
+/*
+ * Events are written in the D-Bus wire format. The fixed header is
+ * followed by the header fields, each an 8 aligned (yv) struct, and the
+ * body, which starts 8 aligned. The fields are in the order libdbus
+ * writes them, path first. Those after the path start 8 aligned, so they
+ * are the same bytes each time. The application reference is an 8 aligned
+ * struct at the end of the body, so it too is the same bytes each time.
+ */
+#define EVENT_SIGNATURE "siiv(so)"
+
+#define HEADER_FIXED_SIZE       16
+#define HEADER_BODY_LENGTH      4
+#define HEADER_SERIAL           8
+#define HEADER_FIELDS_LENGTH    12
+
+#define FIELD_PATH      1
+#define FIELD_INTERFACE 2
+#define FIELD_MEMBER    3
+#define FIELD_SIGNATURE 8
+
+struct _SpiEventTemplate
+{
+  GString *header;              /* The fixed part */
+  GString *fields;              /* The fields after the path */
+  GString *reference;           /* The application reference */
+};
+
+/*---------------------------------------------------------------------------*/
+
+static void
+pad (GString * s, gsize alignment)
+{
+  while (s->len % alignment)
+    g_string_append_c (s, '\0');
+}
+
+static void
+put_uint32 (GString * s, dbus_uint32_t v)
+{
+  pad (s, 4);
+  g_string_append_len (s, (const gchar *) &v, 4);
+}
+
+static void
+set_uint32 (GString * s, gsize offset, dbus_uint32_t v)
+{
+  memcpy (s->str + offset, &v, 4);
+}
+
+/* Strings and object paths */
+static void
+put_string (GString * s, const char *v)
+{
+  gsize len = strlen (v);
+
+  put_uint32 (s, len);
+  g_string_append_len (s, v, len + 1);
+}
+
+static void
+put_signature (GString * s, const char *v)
+{
+  gsize len = strlen (v);
+
+  g_string_append_c (s, (gchar) len);
+  g_string_append_len (s, v, len + 1);
+}
+
+static void
+put_field (GString * s, guchar code, char type, const char *v)
+{
+  char sig[2] = { type, '\0' };
+
+  pad (s, 8);
+  g_string_append_c (s, code);
+  put_signature (s, sig);
+  if (type == DBUS_TYPE_SIGNATURE)
+    put_signature (s, v);
+  else
+    put_string (s, v);
+}
+
+/*---------------------------------------------------------------------------*/
+
+SpiEventTemplate *
+spi_event_template_new (const char *interface,
+                        const char *member,
+                        const char *app_name, const char *app_path)
+{
+  SpiEventTemplate *tmpl;
+  GString *h;
+
+  tmpl = g_new0 (SpiEventTemplate, 1);
+
+  h = tmpl->header = g_string_sized_new (128);
+  g_string_append_c (h, G_BYTE_ORDER == G_LITTLE_ENDIAN ? 'l' : 'B');
+  g_string_append_c (h, DBUS_MESSAGE_TYPE_SIGNAL);
+  g_string_append_c (h, 0x1);   /* As dbus_message_new_signal, no reply */
+  g_string_append_c (h, 1);     /* Protocol version */
+  put_uint32 (h, 0);            /* Body length */
+  put_uint32 (h, 1);            /* Serial, cleared once read back */
+  put_uint32 (h, 0);            /* Header fields length */
+
+  h = tmpl->fields = g_string_sized_new (128);
+  put_field (h, FIELD_INTERFACE, DBUS_TYPE_STRING, interface);
+  put_field (h, FIELD_MEMBER, DBUS_TYPE_STRING, member);
+  put_field (h, FIELD_SIGNATURE, DBUS_TYPE_SIGNATURE, EVENT_SIGNATURE);
+
+  tmpl->reference = g_string_sized_new (64);
+  put_string (tmpl->reference, app_name);
+  put_string (tmpl->reference, app_path);
+  return tmpl;
+}
+
+void
+spi_event_template_free (SpiEventTemplate * tmpl)
+{
+  g_string_free (tmpl->header, TRUE);
+  g_string_free (tmpl->fields, TRUE);
+  g_string_free (tmpl->reference, TRUE);
+  g_free (tmpl);
+}
+
+/*
+ * Builds an event whose data is the basic type given, which must be
+ * DBUS_TYPE_INT32, DBUS_TYPE_UINT32 or DBUS_TYPE_STRING. The value is
+ * passed as to dbus_message_iter_append_basic. Returns NULL if libdbus
+ * does not accept the event, such as for a string that is not UTF-8.
+ *
+ * The template is only read, so events may be built on any thread.
+ */
+DBusMessage *
+spi_event_template_build (SpiEventTemplate * tmpl,
+                          const char *path,
+                          const char *minor,
+                          dbus_int32_t detail1,
+                          dbus_int32_t detail2, int type, const void *value)
+{
+  GString *s;
+  char sig[2] = { type, '\0' };
+  DBusMessage *message;
+  gsize body;
+
+  g_return_val_if_fail (path != NULL, NULL);
+  g_return_val_if_fail (minor != NULL, NULL);
+  g_return_val_if_fail (value != NULL, NULL);
+  g_return_val_if_fail (type != DBUS_TYPE_STRING ||
+                        *(const char **) value != NULL, NULL);
+
+  s = g_string_sized_new (tmpl->header->len + tmpl->fields->len +
+                          tmpl->reference->len + 256);
+  g_string_append_len (s, tmpl->header->str, tmpl->header->len);
+  put_field (s, FIELD_PATH, DBUS_TYPE_OBJECT_PATH, path);
+  pad (s, 8);
+  g_string_append_len (s, tmpl->fields->str, tmpl->fields->len);
+  set_uint32 (s, HEADER_FIELDS_LENGTH, s->len - HEADER_FIXED_SIZE);
+  pad (s, 8);
+
+  body = s->len;
+  put_string (s, minor);
+  put_uint32 (s, detail1);
+  put_uint32 (s, detail2);
+  put_signature (s, sig);
+  switch (type)
+    {
+    case DBUS_TYPE_INT32:
+    case DBUS_TYPE_UINT32:
+      put_uint32 (s, *(const dbus_uint32_t *) value);
+      break;
+    case DBUS_TYPE_STRING:
+      put_string (s, *(const char **) value);
+      break;
+    default:
+      g_string_free (s, TRUE);
+      g_return_val_if_reached (NULL);
+    }
+  pad (s, 8);
+  g_string_append_len (s, tmpl->reference->str, tmpl->reference->len);
+  set_uint32 (s, HEADER_BODY_LENGTH, s->len - body);
+
+  message = dbus_message_demarshal (s->str, s->len, NULL);
+  g_string_free (s, TRUE);
+  if (message)
+    dbus_message_set_serial (message, 0);
+  return message;
+}
+
+/*END------------------------------------------------------------------------*/
@@ -0,0 +1,56 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef EVENT_TEMPLATE_H
+#define EVENT_TEMPLATE_H
+
+#include <glib.h>
+#include <dbus/dbus.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A pre-built AT-SPI event signal for one interface and member. The
+ * header fields, signature and trailing application reference are
+ * serialized once. Building an event then writes only its path, detail
+ * and data, and has libdbus read the result back as a message.
+ */
+typedef struct _SpiEventTemplate SpiEventTemplate;
+
+SpiEventTemplate *spi_event_template_new   (const char *interface,
+                                            const char *member,
+                                            const char *app_name,
+                                            const char *app_path);
+
+void              spi_event_template_free  (SpiEventTemplate *tmpl);
+
+DBusMessage      *spi_event_template_build (SpiEventTemplate *tmpl,
+                                            const char       *path,
+                                            const char       *minor,
+                                            dbus_int32_t      detail1,
+                                            dbus_int32_t      detail2,
+                                            int               type,
+                                            const void       *value);
+
+G_END_DECLS
+
+#endif /* EVENT_TEMPLATE_H */
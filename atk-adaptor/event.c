@@ -28,11 +28,18 @@
 #include <droute/droute.h>
 
 #include "bridge.h"
+#include "accessible-cache.h"
 #include "accessible-register.h"
+#include "event.h"
+#include "event-limit.h"
+#include "event-names.h"
+#include "event-template.h"
+#include "key-listeners.h"
 
 #include "common/spi-dbus.h"
 
-static GArray *listener_ids = NULL;
+static GArray *listener_ids = NULL;        /* Hooks that only send events */
+static GArray *cache_listener_ids = NULL;  /* Hooks that also update the cache */
 
 static gint atk_bridge_key_event_listener_id;
 static gint atk_bridge_focus_tracker_id;
@@ -46,10 +53,421 @@ static gint atk_bridge_focus_tracker_id;
 
 /*---------------------------------------------------------------------------*/
 
+/*
+ * The event types clients listen for, as "category:name:detail" with the
+ * name and detail optional. The registry reports them from its
+ * GetRegisteredEvents method and keeps us up to date with its
+ * EventListenerRegistered and EventListenerDeregistered signals. Events
+ * nobody listens for are dropped before they are marshalled. Until the
+ * registry has answered with its list of listeners, and if it answers
+ * with an error or not at all, every event is sent.
+ */
+typedef struct _SpiEventListener
+{
+  gchar *bus_name;
+  gchar *event_type;
+  gchar *category;
+  gchar *name;                  /* NULL matches any name */
+  gchar *detail;                /* NULL matches any detail */
+} SpiEventListener;
+
+static GList *event_listeners = NULL;
+static gboolean event_listeners_known = FALSE;
+static gboolean event_listener_filter_added = FALSE;
+
+/*
+ * Milliseconds to wait for the registry to report its listeners. The
+ * calls do not block, this only bounds how long a call stays pending.
+ */
+#define SPI_LISTENERS_TIMEOUT 5000
+
+static DBusPendingCall *event_listeners_call = NULL;
+static DBusPendingCall *key_listeners_call = NULL;
+
+static guint events_emitted = 0;
+static guint events_suppressed = 0;
+
+static void update_emission_hooks (void);
+
+static SpiEventListener *
+event_listener_new (const gchar *bus_name, const gchar *event_type)
+{
+  SpiEventListener *listener;
+  gchar **parts;
+
+  parts = g_strsplit (event_type, ":", 3);
+  listener = g_new0 (SpiEventListener, 1);
+  listener->bus_name = g_strdup (bus_name);
+  listener->event_type = g_strdup (event_type);
+  listener->category = g_strdup (parts[0] ? parts[0] : "");
+  if (parts[0] && parts[1] && parts[1][0])
+    listener->name = g_strdup (parts[1]);
+  if (parts[0] && parts[1] && parts[2] && parts[2][0])
+    listener->detail = g_strdup (parts[2]);
+  g_strfreev (parts);
+  return listener;
+}
+
+static void
+event_listener_free (SpiEventListener * listener)
+{
+  g_free (listener->bus_name);
+  g_free (listener->event_type);
+  g_free (listener->category);
+  g_free (listener->name);
+  g_free (listener->detail);
+  g_free (listener);
+}
+
+static gboolean
+event_is_listened_for (const char *klass, const char *major, const char *minor)
+{
+  const gchar *category;
+  GList *l;
+
+  if (!event_listeners_known)
+    return TRUE;
+
+  category = strrchr (klass, '.');
+  category = category ? category + 1 : klass;
+  for (l = event_listeners; l; l = l->next)
+    {
+      SpiEventListener *listener = l->data;
+
+      if (!spi_event_name_equal (listener->category, category))
+        continue;
+      if (listener->name && !spi_event_name_equal (listener->name, major))
+        continue;
+      if (listener->detail && !spi_event_name_equal (listener->detail, minor))
+        continue;
+      return TRUE;
+    }
+  return FALSE;
+}
+
+/* Counts the event as suppressed if no client listens for it */
+static gboolean
+event_wanted (const char *klass, const char *major, const char *minor)
+{
+  if (event_is_listened_for (klass, major, minor))
+    return TRUE;
+  events_suppressed++;
+  return FALSE;
+}
+
+static void
+add_event_listener (const gchar * bus_name, const gchar * event_type)
+{
+  event_listeners = g_list_prepend (event_listeners,
+                                    event_listener_new (bus_name, event_type));
+}
+
+static void
+remove_event_listener (const gchar * bus_name, const gchar * event_type)
+{
+  GList *l;
+
+  for (l = event_listeners; l; l = l->next)
+    {
+      SpiEventListener *listener = l->data;
+
+      if (!strcmp (listener->bus_name, bus_name) &&
+          !strcmp (listener->event_type, event_type))
+        {
+          event_listeners = g_list_delete_link (event_listeners, l);
+          event_listener_free (listener);
+          return;
+        }
+    }
+}
+
+static void
+clear_event_listeners (void)
+{
+  g_list_foreach (event_listeners, (GFunc) event_listener_free, NULL);
+  g_list_free (event_listeners);
+  event_listeners = NULL;
+}
+
+/* Runs on the main context, whichever thread read the signal */
+static gboolean
+handle_event_listener_signal (gpointer data)
+{
+  DBusMessage *message = data;
+  const char *bus_name, *event_type;
+
+  if (dbus_message_get_args (message, NULL,
+                             DBUS_TYPE_STRING, &bus_name,
+                             DBUS_TYPE_STRING, &event_type,
+                             DBUS_TYPE_INVALID) && event_listeners_known)
+    {
+      if (!strcmp (dbus_message_get_member (message), "EventListenerRegistered"))
+        add_event_listener (bus_name, event_type);
+      else
+        remove_event_listener (bus_name, event_type);
+      update_emission_hooks ();
+    }
+  dbus_message_unref (message);
+  return FALSE;
+}
+
+static gboolean handle_key_listener_signal (gpointer data);
+
+static DBusHandlerResult
+event_listener_filter (DBusConnection * bus, DBusMessage * message,
+                       void *user_data)
+{
+  if (dbus_message_is_signal (message, SPI_DBUS_INTERFACE_REGISTRY,
+                              "EventListenerRegistered") ||
+      dbus_message_is_signal (message, SPI_DBUS_INTERFACE_REGISTRY,
+                              "EventListenerDeregistered"))
+    g_idle_add (handle_event_listener_signal, dbus_message_ref (message));
+  else if (dbus_message_is_signal (message,
+                                   SPI_DBUS_INTERFACE_DEVICE_EVENT_LISTENER,
+                                   "KeystrokeListenerRegistered") ||
+           dbus_message_is_signal (message,
+                                   SPI_DBUS_INTERFACE_DEVICE_EVENT_LISTENER,
+                                   "KeystrokeListenerDeregistered"))
+    g_idle_add (handle_key_listener_signal, dbus_message_ref (message));
+  return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+}
+
+/*
+ * The registry's answers are read on the main context, queued behind any
+ * listener signals read before them. Those signals are dropped, as the
+ * answer already takes them into account.
+ */
+static void
+registry_reply_notify (DBusPendingCall * pending, void *user_data)
+{
+  g_idle_add ((GSourceFunc) user_data, NULL);
+}
+
+/* Calls a registry method without waiting, read_reply reads the answer */
+static DBusPendingCall *
+call_registry (const char *path, const char *interface, const char *method,
+               GSourceFunc read_reply)
+{
+  DBusMessage *message;
+  DBusPendingCall *pending = NULL;
+
+  message = dbus_message_new_method_call (SPI_DBUS_NAME_REGISTRY, path,
+                                          interface, method);
+  if (!message)
+    return NULL;
+  if (!dbus_connection_send_with_reply (spi_global_app_data->bus, message,
+                                        &pending, SPI_LISTENERS_TIMEOUT))
+    pending = NULL;
+  dbus_message_unref (message);
+  if (!pending)
+    return NULL;
+
+  dbus_pending_call_set_notify (pending, registry_reply_notify, read_reply,
+                                NULL);
+  /* With threaded dispatch the reply may have come before the notify */
+  if (dbus_pending_call_get_completed (pending))
+    g_idle_add (read_reply, NULL);
+  return pending;
+}
+
+/*
+ * Takes the reply to a registry call once it has completed, or returns
+ * NULL. Only a method return with the given signature is kept, an empty
+ * list meaning that nobody listens.
+ */
+static DBusMessage *
+take_registry_reply (DBusPendingCall ** call, const char *signature)
+{
+  DBusPendingCall *pending = *call;
+  DBusMessage *reply;
+
+  if (!pending || !dbus_pending_call_get_completed (pending))
+    return NULL;
+  *call = NULL;
+  reply = dbus_pending_call_steal_reply (pending);
+  dbus_pending_call_unref (pending);
+  if (!reply)
+    return NULL;
+
+  if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+      !strcmp (dbus_message_get_signature (reply), signature))
+    return reply;
+  dbus_message_unref (reply);
+  return NULL;
+}
+
+static void
+cancel_registry_call (DBusPendingCall ** call)
+{
+  if (!*call)
+    return;
+  dbus_pending_call_cancel (*call);
+  dbus_pending_call_unref (*call);
+  *call = NULL;
+}
+
+static gboolean
+read_registered_events (gpointer data)
+{
+  DBusMessage *reply;
+  DBusMessageIter iter, iter_array, iter_struct;
+
+  reply = take_registry_reply (&event_listeners_call, "a(ss)");
+  if (!reply)
+    return FALSE;
+
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+    {
+      const char *bus_name, *event_type;
+
+      dbus_message_iter_recurse (&iter_array, &iter_struct);
+      dbus_message_iter_get_basic (&iter_struct, &bus_name);
+      dbus_message_iter_next (&iter_struct);
+      dbus_message_iter_get_basic (&iter_struct, &event_type);
+      add_event_listener (bus_name, event_type);
+      dbus_message_iter_next (&iter_array);
+    }
+  event_listeners_known = TRUE;
+  dbus_message_unref (reply);
+
+  update_emission_hooks ();
+  return FALSE;
+}
+
+/*
+ * Asks the registry which events are listened for. The signals are
+ * watched first, so that no change is missed while we wait.
+ */
+static void
+get_registered_event_listeners (void)
+{
+  DBusConnection *bus = spi_global_app_data->bus;
+
+  dbus_connection_add_filter (bus, event_listener_filter, NULL, NULL);
+  event_listener_filter_added = TRUE;
+  dbus_bus_add_match (bus, "type='signal',interface='" SPI_DBUS_INTERFACE_REGISTRY
+                      "',member='EventListenerRegistered'", NULL);
+  dbus_bus_add_match (bus, "type='signal',interface='" SPI_DBUS_INTERFACE_REGISTRY
+                      "',member='EventListenerDeregistered'", NULL);
+
+  event_listeners_call = call_registry (SPI_DBUS_PATH_REGISTRY,
+                                        SPI_DBUS_INTERFACE_REGISTRY,
+                                        "GetRegisteredEvents",
+                                        read_registered_events);
+}
+
+void
+spi_atk_get_event_counts (guint * emitted, guint * suppressed)
+{
+  *emitted = events_emitted;
+  *suppressed = events_suppressed;
+}
+
+void
+spi_atk_reset_event_counts (void)
+{
+  events_emitted = 0;
+  events_suppressed = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * The keystroke listeners clients hold with the device event controller,
+ * as reported by its GetKeystrokeListeners method and kept up to date by
+ * its KeystrokeListenerRegistered and KeystrokeListenerDeregistered
+ * signals. Keys are not sent when nobody listens for them, and not
+ * waited on when no listener is preemptive and so none can consume them.
+ * Until the controller has answered with its list of listeners, every
+ * key is sent and waited on.
+ */
+static gboolean key_listeners_known = FALSE;
+
+static SpiKeyStats key_stats;
+
+static gboolean
+handle_key_listener_signal (gpointer data)
+{
+  DBusMessage *message = data;
+
+  if (key_listeners_known)
+    spi_key_listeners_update (message);
+  dbus_message_unref (message);
+  return FALSE;
+}
+
+static gboolean
+read_keystroke_listeners (gpointer data)
+{
+  DBusMessage *reply;
+
+  reply = take_registry_reply (&key_listeners_call,
+                               DBUS_TYPE_ARRAY_AS_STRING
+                               SPI_KEY_LISTENER_SIGNATURE);
+  if (!reply)
+    return FALSE;
+
+  if (spi_key_listeners_read (reply))
+    key_listeners_known = TRUE;
+  dbus_message_unref (reply);
+  return FALSE;
+}
+
+/* Called once the filter is in place, as for event listeners */
+static void
+get_registered_key_listeners (void)
+{
+  DBusConnection *bus = spi_global_app_data->bus;
+
+  dbus_bus_add_match (bus, "type='signal',interface='"
+                      SPI_DBUS_INTERFACE_DEVICE_EVENT_LISTENER
+                      "',member='KeystrokeListenerRegistered'", NULL);
+  dbus_bus_add_match (bus, "type='signal',interface='"
+                      SPI_DBUS_INTERFACE_DEVICE_EVENT_LISTENER
+                      "',member='KeystrokeListenerDeregistered'", NULL);
+
+  key_listeners_call = call_registry (SPI_DBUS_PATH_DEC,
+                                      SPI_DBUS_INTERFACE_DEC,
+                                      "GetKeystrokeListeners",
+                                      read_keystroke_listeners);
+}
+
+static void
+key_stats_add_round_trip (const GTimeVal * start)
+{
+  GTimeVal end;
+  glong usec;
+  guint bucket = 0;
+
+  g_get_current_time (&end);
+  usec = (end.tv_sec - start->tv_sec) * G_USEC_PER_SEC +
+         (end.tv_usec - start->tv_usec);
+  if (usec > 0)
+    bucket = MIN (g_bit_storage (usec), SPI_KEY_STATS_BUCKETS - 1);
+  key_stats.buckets[bucket]++;
+}
+
+void
+spi_atk_get_key_stats (SpiKeyStats * stats)
+{
+  *stats = key_stats;
+}
+
+void
+spi_atk_reset_key_stats (void)
+{
+  memset (&key_stats, 0, sizeof (key_stats));
+}
+
+/*---------------------------------------------------------------------------*/
+
 typedef struct _SpiReentrantCallClosure 
 {
   GMainLoop   *loop;
   DBusMessage *reply;
+  gboolean     timed_out;
 } SpiReentrantCallClosure;
 
 static void
@@ -61,34 +479,138 @@ set_reply (DBusPendingCall * pending, void *user_data)
   g_main_loop_quit (closure->loop);
 }
 
+static void
+wakeup_main_context (DBusPendingCall * pending, void *user_data)
+{
+  g_main_context_wakeup (NULL);
+}
+
+static gboolean
+set_timed_out (gpointer data)
+{
+  SpiReentrantCallClosure* closure = (SpiReentrantCallClosure *) data;
+
+  closure->timed_out = TRUE;
+  if (closure->loop)
+    g_main_loop_quit (closure->loop);
+  return FALSE;
+}
+
+static glong
+elapsed_ms (const GTimeVal * start)
+{
+  GTimeVal now;
+
+  g_get_current_time (&now);
+  return (now.tv_sec - start->tv_sec) * 1000 +
+         (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/* Takes the reply if there is one, or gives up on the call */
+static DBusMessage *
+finish_pending_call (DBusPendingCall * pending)
+{
+  DBusMessage *reply = NULL;
+
+  if (dbus_pending_call_get_completed (pending))
+    reply = dbus_pending_call_steal_reply (pending);
+  else
+    dbus_pending_call_cancel (pending);
+  dbus_pending_call_unref (pending);
+  return reply;
+}
+
+/*
+ * With threaded dispatch the reply is read on the I/O thread, and calls
+ * made on us while we wait are only answered if the main context runs.
+ * The notify may come before it is set, so completion is polled and the
+ * notify used only to wake the context.
+ */
 static DBusMessage *
-send_and_allow_reentry (DBusConnection * bus, DBusMessage * message)
+wait_on_main_context (DBusPendingCall * pending, gint timeout)
+{
+  SpiReentrantCallClosure closure;
+  guint source = 0;
+
+  /* There is no pending call once the connection has gone */
+  if (!pending)
+    return NULL;
+
+  closure.loop = NULL;
+  closure.timed_out = FALSE;
+  dbus_pending_call_set_notify (pending, wakeup_main_context, NULL, NULL);
+  if (timeout >= 0)
+    source = g_timeout_add (timeout, set_timed_out, &closure);
+  while (!dbus_pending_call_get_completed (pending) && !closure.timed_out)
+    g_main_context_iteration (NULL, TRUE);
+  if (source && !closure.timed_out)
+    g_source_remove (source);
+
+  return finish_pending_call (pending);
+}
+
+/*
+ * Sends a method call and waits up to timeout ms, or without limit if
+ * timeout is -1, for its reply. Calls made on us meanwhile are answered.
+ */
+static DBusMessage *
+send_and_allow_reentry (DBusConnection * bus, DBusMessage * message,
+                        gint timeout)
 {
   DBusPendingCall *pending;
   SpiReentrantCallClosure closure;
+  GTimeVal start;
 
-  if (!dbus_connection_send_with_reply (bus, message, &pending, -1))
+  if (!dbus_connection_send_with_reply (bus, message, &pending, timeout))
       return NULL;
-  dbus_pending_call_set_notify (pending, set_reply, (void *) &closure, NULL);
+  if (spi_atk_threaded_dispatch)
+    return wait_on_main_context (pending, timeout);
+  if (!pending)
+    return NULL;
+
   closure.loop = g_main_loop_new (NULL, FALSE);
+  closure.reply = NULL;
+  closure.timed_out = FALSE;
+  dbus_pending_call_set_notify (pending, set_reply, (void *) &closure, NULL);
 
   /* TODO: Remove old AT_SPI_CLIENT name */
   if (getenv ("AT_SPI_CLIENT") || getenv ("AT_SPI_REENTER_G_MAIN_LOOP"))
     {
-      g_main_loop_run  (closure.loop);
+      guint source = 0;
+
+      if (timeout >= 0)
+        source = g_timeout_add (timeout, set_timed_out, &closure);
+      if (!dbus_pending_call_get_completed (pending))
+        g_main_loop_run  (closure.loop);
+      if (source && !closure.timed_out)
+        g_source_remove (source);
     }
   else
     {
-      closure.reply = NULL;
-      while (!closure.reply)
+      g_get_current_time (&start);
+      while (!dbus_pending_call_get_completed (pending))
         {
-          if (!dbus_connection_read_write_dispatch (spi_global_app_data->bus, 1000))
-            return NULL;
+          glong wait = 1000;
+
+          if (timeout >= 0)
+            {
+              wait = timeout - elapsed_ms (&start);
+              if (wait <= 0)
+                break;
+            }
+          if (!dbus_connection_read_write_dispatch (spi_global_app_data->bus, wait))
+            break;
         }
     }
-  
+
   g_main_loop_unref (closure.loop);
-  return closure.reply;
+  /* The notify may have taken the reply already */
+  if (closure.reply)
+    {
+      dbus_pending_call_unref (pending);
+      return closure.reply;
+    }
+  return finish_pending_call (pending);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -105,8 +627,14 @@ Accessibility_DeviceEventController_NotifyListenersSync (const
                                                          * key_event)
 {
   DBusMessage *message;
-  DBusError error;
   dbus_bool_t consumed = FALSE;
+  GTimeVal start;
+
+  if (key_listeners_known && !spi_key_listeners_any ())
+    {
+      key_stats.skipped++;
+      return FALSE;
+    }
 
   message =
     dbus_message_new_method_call (SPI_DBUS_NAME_REGISTRY,
@@ -114,19 +642,45 @@ Accessibility_DeviceEventController_NotifyListenersSync (const
                                   SPI_DBUS_INTERFACE_DEC,
                                   "NotifyListenersSync");
 
-  dbus_error_init (&error);
-  if (spi_dbus_marshal_deviceEvent (message, key_event))
+  if (!spi_dbus_marshal_deviceEvent (message, key_event))
     {
-      DBusMessage *reply =
-        send_and_allow_reentry (spi_global_app_data->bus, message);
-      if (reply)
+      dbus_message_unref (message);
+      return FALSE;
+    }
+
+  if (key_listeners_known && !spi_key_listeners_may_consume ())
+    {
+      /* Nobody can consume the key, so the answer is known */
+      dbus_message_set_no_reply (message, TRUE);
+      droute_send (spi_global_app_data->droute, message);
+      key_stats.unwaited++;
+    }
+  else
+    {
+      DBusMessage *reply;
+
+      g_get_current_time (&start);
+      reply = send_and_allow_reentry (spi_global_app_data->bus, message,
+                                      spi_atk_key_timeout);
+      key_stats_add_round_trip (&start);
+      key_stats.sent++;
+      /* libdbus answers a call it gave up on with a NoReply error */
+      if (!reply || dbus_message_is_error (reply, DBUS_ERROR_NO_REPLY))
+        key_stats.timed_out++;
+      else
         {
-          DBusError error;
-          dbus_error_init (&error);
-          dbus_message_get_args (reply, &error, DBUS_TYPE_BOOLEAN, &consumed,
-                                 DBUS_TYPE_INVALID);
-          dbus_message_unref (reply);
+          DBusError reply_error;
+
+          dbus_error_init (&reply_error);
+          if (!dbus_message_get_args (reply, &reply_error,
+                                      DBUS_TYPE_BOOLEAN, &consumed,
+                                      DBUS_TYPE_INVALID))
+            dbus_error_free (&reply_error);
         }
+      if (reply)
+        dbus_message_unref (reply);
+      if (consumed)
+        key_stats.consumed++;
     }
   dbus_message_unref (message);
   return consumed;
@@ -197,23 +751,6 @@ spi_atk_bridge_key_listener (AtkKeyEventStruct * event, gpointer data)
 
 /*---------------------------------------------------------------------------*/
 
-static gchar *
-convert_signal_name (const gchar * s)
-{
-  gchar *ret = g_strdup (s);
-  gchar *t;
-
-  if (!ret)
-    return NULL;
-  ret[0] = toupper (ret[0]);
-  while ((t = strchr (ret, '-')) != NULL)
-    {
-      memmove (t, t + 1, strlen (t));
-      *t = toupper (*t);
-    }
-  return ret;
-}
-
 static const void *
 replace_null (const gint type,
               const void *val)
@@ -243,54 +780,255 @@ append_basic (DBusMessageIter *iter,
     val = replace_null ((int) *type, val);
     dbus_message_iter_append_basic(&sub, (int) *type, &val);
 
-  dbus_message_iter_close_container(iter, &sub);
-}
+  dbus_message_iter_close_container(iter, &sub);
+}
+
+static void
+append_uint32 (DBusMessageIter *iter,
+               const char *type,
+               const void *val)
+{
+  DBusMessageIter sub;
+
+  dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, type, &sub);
+  dbus_message_iter_append_basic(&sub, DBUS_TYPE_UINT32, val);
+  dbus_message_iter_close_container(iter, &sub);
+}
+
+static void
+append_rect (DBusMessageIter *iter,
+             const char *type,
+             const void *val)
+{
+  DBusMessageIter variant, sub;
+  const AtkRectangle *rect = (const AtkRectangle *) val;
+
+  dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, type, &variant);
+
+    dbus_message_iter_open_container (&variant, DBUS_TYPE_STRUCT, NULL, &sub);
+
+      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->x));
+      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->y));
+      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->width));
+      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->height));
+
+    dbus_message_iter_close_container (&variant, &sub);
+
+  dbus_message_iter_close_container(iter, &variant);
+}
+
+static void
+append_object (DBusMessageIter *iter,
+               const char *type,
+               const void *val)
+{
+  spi_object_append_v_reference (iter, ATK_OBJECT (val));
+}
+
+/*
+ * Events whose data is an int, uint or string, which are most of those
+ * sent, are built from a template per interface and member. Any other
+ * event, or one a template cannot build, is built field by field.
+ */
+typedef struct _SpiTemplateEntry
+{
+  const char *klass;
+  SpiEventTemplate *tmpl;
+} SpiTemplateEntry;
+
+static GHashTable *event_templates = NULL;      /* Member -> entries */
+
+static SpiEventTemplate *
+lookup_event_template (const char *klass, const char *member)
+{
+  GSList *entries, *l;
+  SpiTemplateEntry *entry;
+  gchar buf[SPI_REGISTER_PATH_MAX];
+  const char *app_name, *app_path = NULL;
+
+  if (!event_templates)
+    event_templates = g_hash_table_new (NULL, NULL);
+
+  entries = g_hash_table_lookup (event_templates, member);
+  for (l = entries; l; l = l->next)
+    {
+      entry = l->data;
+      if (!strcmp (entry->klass, klass))
+        return entry->tmpl;
+    }
+
+  app_name = dbus_bus_get_unique_name (spi_global_app_data->bus);
+  if (!app_name)
+    return NULL;
+  /* The root is never leased, so its reference does not change */
+  if (spi_global_app_data->root)
+    app_path = spi_register_object_path_into (spi_global_register,
+                                              G_OBJECT (spi_global_app_data->root),
+                                              buf);
+  if (!app_path)
+    app_path = SPI_DBUS_PATH_NULL;
+
+  entry = g_new (SpiTemplateEntry, 1);
+  entry->klass = g_intern_string (klass);
+  entry->tmpl = spi_event_template_new (klass, member, app_name, app_path);
+  g_hash_table_insert (event_templates, (gpointer) member,
+                       g_slist_prepend (entries, entry));
+  return entry->tmpl;
+}
+
+static void
+free_template_entries (gpointer key, gpointer value, gpointer data)
+{
+  GSList *l;
+
+  for (l = value; l; l = l->next)
+    {
+      SpiTemplateEntry *entry = l->data;
+
+      spi_event_template_free (entry->tmpl);
+      g_free (entry);
+    }
+  g_slist_free (value);
+}
+
+static void
+clear_event_templates (void)
+{
+  if (!event_templates)
+    return;
+  g_hash_table_foreach (event_templates, free_template_entries, NULL);
+  g_hash_table_destroy (event_templates);
+  event_templates = NULL;
+}
+
+static DBusMessage *
+new_event_from_template (const char *path,
+                         const char *klass,
+                         const char *member,
+                         const char *minor,
+                         dbus_int32_t detail1,
+                         dbus_int32_t detail2,
+                         const char *type,
+                         const void *val,
+                         void (*append_variant) (DBusMessageIter *, const char *, const void *))
+{
+  SpiEventTemplate *tmpl;
+  dbus_uint32_t number;
+  const char *string;
+  const void *value;
+
+  if (type[0] == '\0' || type[1] != '\0')
+    return NULL;
+
+  /* append_basic passes numbers in the pointer itself */
+  if (append_variant == append_basic &&
+      (type[0] == DBUS_TYPE_INT32 || type[0] == DBUS_TYPE_UINT32))
+    {
+      number = GPOINTER_TO_UINT (val);
+      value = &number;
+    }
+  else if (append_variant == append_basic && type[0] == DBUS_TYPE_STRING)
+    {
+      string = replace_null (DBUS_TYPE_STRING, val);
+      value = &string;
+    }
+  else if (append_variant == append_uint32)
+    value = val;
+  else
+    return NULL;
+
+  tmpl = lookup_event_template (klass, member);
+  if (!tmpl)
+    return NULL;
+  return spi_event_template_build (tmpl, path, minor, detail1, detail2,
+                                   type[0], value);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Events of some types, such as property-change, are limited to a rate per
+ * object and event by event-limit.c. The latest event over the limit is
+ * held, along with the PropertiesChanged signal that follows it, and sent
+ * once the rate allows or before any other event for the object.
+ */
+
+#define RATE_LIMIT_SWEEP_INTERVAL 100
 
-static void
-append_rect (DBusMessageIter *iter,
-             const char *type,
-             const void *val)
-{
-  DBusMessageIter variant, sub;
-  const AtkRectangle *rect = (const AtkRectangle *) val;
+static guint rate_sweep_timeout = 0;
 
-  dbus_message_iter_open_container(iter, DBUS_TYPE_VARIANT, type, &variant);
+typedef void (*SpiEventTypeValueFunc) (const gchar *type, guint value);
 
-    dbus_message_iter_open_container (&variant, DBUS_TYPE_STRUCT, NULL, &sub);
+static DBusMessage *new_properties_changed (AtkObject *accessible,
+                                            const gchar *pname);
 
-      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->x));
-      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->y));
-      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->width));
-      dbus_message_iter_append_basic (&sub, DBUS_TYPE_INT32, &(rect->height));
+/*
+ * Sets values per event type from a list such as "bounds-changed=16".
+ * Types not listed keep their value.
+ */
+static void
+set_event_type_values (const gchar * spec, const gchar * what,
+                       SpiEventTypeValueFunc func)
+{
+  gchar **entries;
+  gint i;
 
-    dbus_message_iter_close_container (&variant, &sub);
+  entries = g_strsplit (spec, ",", 0);
+  for (i = 0; entries[i]; i++)
+    {
+      gchar **pair = g_strsplit (entries[i], "=", 2);
+
+      g_strstrip (pair[0]);
+      if (pair[0][0] && pair[1])
+        func (pair[0], g_ascii_strtoull (pair[1], NULL, 10));
+      else if (pair[0][0])
+        g_warning ("AT-SPI: Bad %s '%s'", what, entries[i]);
+      g_strfreev (pair);
+    }
+  g_strfreev (entries);
+}
 
-  dbus_message_iter_close_container(iter, &variant);
+/*
+ * Sets the rate limit of event types from a list such as
+ * "property-change=100,state-changed=0".
+ */
+void
+spi_atk_set_rate_limits (const gchar * spec)
+{
+  set_event_type_values (spec, "rate limit", spi_event_limit_set_rate);
 }
 
 static void
-append_object (DBusMessageIter *iter,
-               const char *type,
-               const void *val)
+send_held_messages (GObject * object, GSList * messages, gboolean lease,
+                    gpointer data)
 {
-  spi_object_append_v_reference (iter, ATK_OBJECT (val));
+  GSList *l;
+
+  for (l = messages; l; l = l->next)
+    droute_send (spi_global_app_data->droute, l->data);
+  events_emitted++;
+  if (lease)
+    spi_object_lease_if_needed (object);
 }
 
-static gchar *
-signal_name_to_dbus (const gchar *s)
+static gboolean
+send_held_events (gpointer data)
 {
-  gchar *ret = g_strdup (s);
-  gchar *t;
+  if (spi_event_limit_sweep (g_get_monotonic_time (), send_held_messages,
+                             NULL))
+    return TRUE;
+  rate_sweep_timeout = 0;
+  return FALSE;
+}
 
-  if (!ret)
-    return NULL;
-  ret [0] = toupper (ret [0]);
-  while ((t = strchr (ret, '-')) != NULL)
-  {
-    memmove (t, t + 1, strlen (t));
-    *t = toupper (*t);
-  }
-  return ret;
+/* Sends every event held, as the bridge is going away */
+static void
+clear_rate_buckets (void)
+{
+  spi_event_limit_clear (send_held_messages, NULL);
+  if (rate_sweep_timeout)
+    g_source_remove (rate_sweep_timeout);
+  rate_sweep_timeout = 0;
 }
 
 /*
@@ -314,41 +1052,329 @@ emit_event (AtkObject  *obj,
             const void *val,
             void (*append_variant) (DBusMessageIter *, const char *, const void *))
 {
-  DBusConnection *bus = spi_global_app_data->bus;
-  const char *path =  spi_register_object_to_path (spi_global_register,
-                                                   G_OBJECT (obj));
-
-  gchar *cname, *t;
+  gchar buf[SPI_REGISTER_PATH_MAX];
+  const char *path;
+  const char *member;
   DBusMessage *sig;
   DBusMessageIter iter, iter_struct;
+  DBusMessage *follow = NULL;
+  SpiEventBucket *bucket;
+  gboolean lease;
   
   if (!klass) klass = "";
   if (!major) major = "";
   if (!minor) minor = "";
   if (!type) type = "u";
 
+  if (!event_wanted (klass, major, minor))
+    return;
+  bucket = spi_event_limit_take (G_OBJECT (obj), major, minor,
+                                 g_get_monotonic_time ());
+  /* The sweep also frees the buckets once they are idle */
+  if (!rate_sweep_timeout && spi_event_limit_active ())
+    rate_sweep_timeout = g_timeout_add (RATE_LIMIT_SWEEP_INTERVAL,
+                                        send_held_events, NULL);
+
+  path = spi_register_object_path_into (spi_global_register,
+                                        G_OBJECT (obj), buf);
+
   /*
    * This is very annoying, but as '-' isn't a legal signal
    * name in D-Bus (Why not??!?) The names need converting
    * on this side, and again on the client side.
    */
-  cname = signal_name_to_dbus (major);
-  sig = dbus_message_new_signal(path, klass, cname);
-  g_free(cname);
+  member = spi_event_member_lookup (major);
+  sig = new_event_from_template (path, klass, member, minor, detail1, detail2,
+                                 type, val, append_variant);
+  if (!sig)
+    {
+      sig = dbus_message_new_signal(path, klass, member);
+
+      dbus_message_iter_init_append(sig, &iter);
+
+      dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &minor);
+      dbus_message_iter_append_basic(&iter, DBUS_TYPE_INT32, &detail1);
+      dbus_message_iter_append_basic(&iter, DBUS_TYPE_INT32, &detail2);
+      append_variant (&iter, type, val);
+      spi_object_append_reference (&iter, spi_global_app_data->root);
+    }
+
+  if (!strcmp (member, "PropertyChange"))
+    follow = new_properties_changed (obj, minor);
+  lease = strcmp (member, "ChildrenChanged") != 0;
+
+  if (bucket)
+    {
+      spi_event_limit_hold (bucket, sig, lease);
+      if (follow)
+        spi_event_limit_hold_also (bucket, follow);
+    }
+  else
+    {
+      spi_event_limit_flush_object (G_OBJECT (obj), send_held_messages, NULL);
+      events_emitted++;
+      droute_send (spi_global_app_data->droute, sig);
+      if (follow)
+        droute_send (spi_global_app_data->droute, follow);
+      if (lease)
+        spi_object_lease_if_needed (G_OBJECT (obj));
+    }
+
+  dbus_message_unref (sig);
+  if (follow)
+    dbus_message_unref (follow);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Events that can fire many times a frame, such as bounds-changed while
+ * scrolling, are held for a short window and only the latest for each
+ * object and event type is sent. The window, in milliseconds, is set per
+ * event type, and 0 sends the event at once. Anything held for an object
+ * is sent before its state-changed and children-changed events, so that
+ * clients see them in the order they happened.
+ */
+typedef struct _SpiPendingEvent
+{
+  AtkObject *accessible;
+  const gchar *name;            /* The signal name, which outlives us */
+  gint detail1;
+  gint detail2;
+  gboolean has_rect;
+  AtkRectangle rect;
+  gint64 deadline;              /* In us, from g_get_monotonic_time */
+} SpiPendingEvent;
+
+#define COALESCE_DEFAULT_WINDOW 16
+
+static GHashTable *coalesce_windows = NULL;     /* Event name -> window */
+static GHashTable *pending_events = NULL;       /* Object and name -> event */
+static GHashTable *pending_objects = NULL;      /* Object -> events held */
+static GQueue *pending_order = NULL;            /* Oldest first */
+static guint pending_timeout = 0;
+static gint64 pending_timeout_deadline = 0;
+
+static guint
+pending_event_hash (gconstpointer data)
+{
+  const SpiPendingEvent *event = data;
+
+  return g_direct_hash (event->accessible) ^ g_str_hash (event->name);
+}
+
+static gboolean
+pending_event_equal (gconstpointer a, gconstpointer b)
+{
+  const SpiPendingEvent *ea = a;
+  const SpiPendingEvent *eb = b;
+
+  return ea->accessible == eb->accessible && !strcmp (ea->name, eb->name);
+}
+
+static void
+ensure_coalesce_windows (void)
+{
+  if (coalesce_windows)
+    return;
+
+  coalesce_windows = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, NULL);
+  g_hash_table_insert (coalesce_windows, g_strdup ("bounds-changed"),
+                       GUINT_TO_POINTER (COALESCE_DEFAULT_WINDOW));
+  g_hash_table_insert (coalesce_windows, g_strdup ("visible-data-changed"),
+                       GUINT_TO_POINTER (COALESCE_DEFAULT_WINDOW));
+  g_hash_table_insert (coalesce_windows, g_strdup ("text-caret-moved"),
+                       GUINT_TO_POINTER (COALESCE_DEFAULT_WINDOW));
+}
+
+static void
+set_coalesce_window (const gchar * type, guint window)
+{
+  g_hash_table_replace (coalesce_windows, g_strdup (type),
+                        GUINT_TO_POINTER (window));
+}
+
+/*
+ * Sets the coalescing window of event types from a list such as
+ * "bounds-changed=16,text-caret-moved=0". Types not listed keep their
+ * window.
+ */
+void
+spi_atk_set_coalesce_windows (const gchar * spec)
+{
+  ensure_coalesce_windows ();
+  set_event_type_values (spec, "coalescing window", set_coalesce_window);
+}
+
+static void
+pending_objects_add (AtkObject * accessible, gint n)
+{
+  guint held;
+
+  held = GPOINTER_TO_UINT (g_hash_table_lookup (pending_objects, accessible));
+  held += n;
+  if (held)
+    g_hash_table_insert (pending_objects, accessible, GUINT_TO_POINTER (held));
+  else
+    g_hash_table_remove (pending_objects, accessible);
+}
+
+static void
+pending_event_emit (SpiPendingEvent * event)
+{
+  if (event->has_rect)
+    emit_event (event->accessible, ITF_EVENT_OBJECT, event->name, "", 0, 0,
+                "(iiii)", &event->rect, append_rect);
+  else
+    emit_event (event->accessible, ITF_EVENT_OBJECT, event->name, "",
+                event->detail1, event->detail2,
+                DBUS_TYPE_INT32_AS_STRING, 0, append_basic);
+  g_object_unref (event->accessible);
+  g_free (event);
+}
+
+/*
+ * Sends the events held for an object, or all of them if accessible is
+ * NULL, or only those due if due is set. Events are taken out before any
+ * is sent, so that sending may hold new ones.
+ */
+static void
+send_pending_events (AtkObject * accessible, gboolean due)
+{
+  GList *ready = NULL;
+  GList *l, *next;
+  gint64 now = g_get_monotonic_time ();
+
+  if (!pending_order)
+    return;
+  if (accessible && !g_hash_table_lookup (pending_objects, accessible))
+    return;
+
+  for (l = pending_order->head; l; l = next)
+    {
+      SpiPendingEvent *event = l->data;
+
+      next = l->next;
+      if (accessible && event->accessible != accessible)
+        continue;
+      if (due && event->deadline > now)
+        continue;
+      g_hash_table_remove (pending_events, event);
+      g_queue_delete_link (pending_order, l);
+      pending_objects_add (event->accessible, -1);
+      ready = g_list_prepend (ready, event);
+    }
+
+  ready = g_list_reverse (ready);
+  for (l = ready; l; l = l->next)
+    pending_event_emit (l->data);
+  g_list_free (ready);
+}
+
+/*
+ * Sends whatever is coalesced or rate limited for an object, so that a
+ * signal about it sent from elsewhere does not overtake its events.
+ */
+void
+spi_atk_send_held_events (GObject * object)
+{
+  /* Only a key, as the object may be going away */
+  send_pending_events ((AtkObject *) object, FALSE);
+  spi_event_limit_flush_object (object, send_held_messages, NULL);
+}
+
+static gboolean send_due_events (gpointer data);
+
+/* Makes sure a timeout fires by the given deadline */
+static void
+schedule_pending_events (gint64 deadline)
+{
+  gint64 now;
+
+  if (pending_timeout && pending_timeout_deadline <= deadline)
+    return;
+  if (pending_timeout)
+    g_source_remove (pending_timeout);
+
+  /* Rounded up, so that the events are due when the timeout fires */
+  now = g_get_monotonic_time ();
+  pending_timeout_deadline = deadline;
+  pending_timeout = g_timeout_add (deadline > now ?
+                                   (deadline - now + 999) / 1000 : 0,
+                                   send_due_events, NULL);
+}
+
+static gboolean
+send_due_events (gpointer data)
+{
+  gint64 earliest = G_MAXINT64;
+  GList *l;
+
+  pending_timeout = 0;
+  send_pending_events (NULL, TRUE);
+
+  for (l = pending_order->head; l; l = l->next)
+    earliest = MIN (earliest, ((SpiPendingEvent *) l->data)->deadline);
+  if (earliest != G_MAXINT64)
+    schedule_pending_events (earliest);
+  return FALSE;
+}
 
-  dbus_message_iter_init_append(sig, &iter);
+/*
+ * Holds an event for its type's window, replacing any held for the same
+ * object and type. Returns FALSE if the event should be sent now.
+ */
+static gboolean
+coalesce_event (AtkObject * accessible, const gchar * name,
+                gint detail1, gint detail2, const AtkRectangle * rect)
+{
+  SpiPendingEvent key, *event;
+  guint window;
+
+  ensure_coalesce_windows ();
+  window = GPOINTER_TO_UINT (g_hash_table_lookup (coalesce_windows, name));
+  if (!window)
+    return FALSE;
+
+  if (!pending_events)
+    {
+      pending_events = g_hash_table_new (pending_event_hash,
+                                         pending_event_equal);
+      pending_objects = g_hash_table_new (NULL, NULL);
+      pending_order = g_queue_new ();
+    }
 
-  dbus_message_iter_append_basic(&iter, DBUS_TYPE_STRING, &minor);
-  dbus_message_iter_append_basic(&iter, DBUS_TYPE_INT32, &detail1);
-  dbus_message_iter_append_basic(&iter, DBUS_TYPE_INT32, &detail2);
-  append_variant (&iter, type, val);
-  spi_object_append_reference (&iter, spi_global_app_data->root);
+  key.accessible = accessible;
+  key.name = name;
+  event = g_hash_table_lookup (pending_events, &key);
+  if (!event)
+    {
+      event = g_new0 (SpiPendingEvent, 1);
+      event->accessible = g_object_ref (accessible);
+      event->name = name;
+      event->deadline = g_get_monotonic_time () + (gint64) window * 1000;
+      g_hash_table_insert (pending_events, event, event);
+      g_queue_push_tail (pending_order, event);
+      pending_objects_add (accessible, 1);
+      schedule_pending_events (event->deadline);
+    }
 
-  dbus_connection_send(bus, sig, NULL);
-  dbus_message_unref(sig);
+  event->detail1 = detail1;
+  event->detail2 = detail2;
+  event->has_rect = (rect != NULL);
+  if (rect)
+    event->rect = *rect;
+  return TRUE;
+}
 
-  if (g_strcmp0 (cname, "ChildrenChanged") != 0)
-    spi_object_lease_if_needed (G_OBJECT (obj));
+static void
+clear_pending_events (void)
+{
+  send_pending_events (NULL, FALSE);
+  if (pending_timeout)
+    g_source_remove (pending_timeout);
+  pending_timeout = 0;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -368,6 +1394,51 @@ focus_tracker (AtkObject * accessible)
 
 #define PCHANGE "PropertyChange"
 
+/* The ATK properties that are also D-Bus properties of the object */
+typedef struct _SpiPropertyMap
+{
+  const gchar *atk_name;
+  const gchar *interface;
+  const gchar *property;
+} SpiPropertyMap;
+
+static const SpiPropertyMap property_map[] = {
+  {"accessible-name", SPI_DBUS_INTERFACE_ACCESSIBLE, "Name"},
+  {"accessible-description", SPI_DBUS_INTERFACE_ACCESSIBLE, "Description"},
+  {"accessible-parent", SPI_DBUS_INTERFACE_ACCESSIBLE, "Parent"},
+  {"accessible-value", SPI_DBUS_INTERFACE_VALUE, "CurrentValue"},
+  {"accessible-table-caption-object", SPI_DBUS_INTERFACE_TABLE, "Caption"},
+  {"accessible-table-summary", SPI_DBUS_INTERFACE_TABLE, "Summary"}
+};
+
+/*
+ * Builds PropertiesChanged with the new value of a property, so that
+ * clients can keep a copy rather than asking for it. It follows the
+ * event, so that clients dropping their copies on any event keep this one.
+ */
+static DBusMessage *
+new_properties_changed (AtkObject *accessible, const gchar *pname)
+{
+  gchar buf[SPI_REGISTER_PATH_MAX];
+  const gchar *properties[2];
+  const gchar *path;
+  gint i;
+
+  for (i = 0; i < G_N_ELEMENTS (property_map); i++)
+    if (!strcmp (property_map[i].atk_name, pname))
+      break;
+  if (i == G_N_ELEMENTS (property_map))
+    return NULL;
+
+  path = spi_register_object_path_into (spi_global_register,
+                                        G_OBJECT (accessible), buf);
+  properties[0] = property_map[i].property;
+  properties[1] = NULL;
+  return droute_path_new_properties_changed (spi_global_app_data->accessible_path,
+                                             path, property_map[i].interface,
+                                             properties);
+}
+
 /* 
  * This handler handles the following ATK signals and
  * converts them to AT-SPI events:
@@ -395,6 +1466,8 @@ property_event_listener (GSignalInvocationHint * signal_hint,
 
   pname = values[0].property_name;
 
+  spi_cache_invalidate (spi_global_cache, G_OBJECT (accessible));
+
   /* TODO Could improve this control statement by matching
    * on only the end of the signal names,
    */
@@ -473,6 +1546,7 @@ property_event_listener (GSignalInvocationHint * signal_hint,
       emit_event (accessible, ITF_EVENT_OBJECT, PCHANGE, pname, 0, 0,
             DBUS_TYPE_INT32_AS_STRING, 0, append_basic);
     }
+
   return TRUE;
 }
 
@@ -497,10 +1571,13 @@ state_event_listener (GSignalInvocationHint * signal_hint,
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
   pname = g_strdup (g_value_get_string (&param_values[1]));
 
+  spi_cache_invalidate (spi_global_cache, G_OBJECT (accessible));
+
   /* TODO - Possibly ignore a change to the 'defunct' state.
    * This is because without reference counting defunct objects should be removed.
    */
   detail1 = (g_value_get_boolean (&param_values[2])) ? 1 : 0;
+  send_pending_events (accessible, FALSE);
   emit_event (accessible, ITF_EVENT_OBJECT, STATE_CHANGED, pname, detail1, 0,
               DBUS_TYPE_INT32_AS_STRING, 0, append_basic);
   g_free (pname);
@@ -526,11 +1603,12 @@ window_event_listener (GSignalInvocationHint * signal_hint,
                        const GValue * param_values, gpointer data)
 {
   AtkObject *accessible;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *s;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
   s = atk_object_get_name (accessible);
@@ -556,11 +1634,12 @@ document_event_listener (GSignalInvocationHint * signal_hint,
                          const GValue * param_values, gpointer data)
 {
   AtkObject *accessible;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *s;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
   s = atk_object_get_name (accessible);
@@ -583,11 +1662,12 @@ bounds_event_listener (GSignalInvocationHint * signal_hint,
 {
   AtkObject *accessible;
   AtkRectangle *atk_rect;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *s;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
 
@@ -595,8 +1675,10 @@ bounds_event_listener (GSignalInvocationHint * signal_hint,
   {
     atk_rect = g_value_get_boxed (param_values + 1);
 
-    emit_event (accessible, ITF_EVENT_OBJECT, name, "", 0, 0,
-                "(iiii)", atk_rect, append_rect);
+    if (event_wanted (ITF_EVENT_OBJECT, name, "") &&
+        !coalesce_event (accessible, name, 0, 0, atk_rect))
+      emit_event (accessible, ITF_EVENT_OBJECT, name, "", 0, 0,
+                  "(iiii)", atk_rect, append_rect);
   }
   return TRUE;
 }
@@ -615,17 +1697,18 @@ active_descendant_event_listener (GSignalInvocationHint * signal_hint,
 {
   AtkObject *accessible;
   AtkObject *child;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *minor;
   gint detail1;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
   child = ATK_OBJECT (g_value_get_pointer (&param_values[1]));
   g_return_val_if_fail (ATK_IS_OBJECT (child), TRUE);
-  minor = g_quark_to_string (signal_hint->detail);
+  minor = event_name->minor;
 
   detail1 = atk_object_get_index_in_parent (child);
 
@@ -647,15 +1730,16 @@ link_selected_event_listener (GSignalInvocationHint * signal_hint,
                               const GValue * param_values, gpointer data)
 {
   AtkObject *accessible;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *minor;
-  gint detail1;
+  gint detail1 = 0;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
-  minor = g_quark_to_string (signal_hint->detail);
+  minor = event_name->minor;
 
   if (G_VALUE_TYPE (&param_values[1]) == G_TYPE_INT)
     detail1 = g_value_get_int (&param_values[1]);
@@ -667,6 +1751,43 @@ link_selected_event_listener (GSignalInvocationHint * signal_hint,
 
 /*---------------------------------------------------------------------------*/
 
+static GQuark quark_text_change_serial = 0;
+
+/*
+ * Counts the changes to an object's text. A text-changed event longer
+ * than spi_atk_text_changed_limit characters carries the count in place
+ * of its text, and a client may read inserted text with GetText for as
+ * long as the Text ChangeSerial property still matches. There is no
+ * limit unless one is set, as clients that do not know about this
+ * expect the text.
+ */
+guint
+spi_atk_get_text_change_serial (AtkObject * accessible)
+{
+  if (!quark_text_change_serial)
+    return 0;
+  return GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (accessible),
+                                               quark_text_change_serial));
+}
+
+static guint
+text_change_serial_next (AtkObject * accessible)
+{
+  guint serial;
+
+  if (!quark_text_change_serial)
+    quark_text_change_serial =
+      g_quark_from_static_string ("spi-text-change-serial");
+
+  /* 0 is never a serial, so that an object's first change is told apart */
+  serial = spi_atk_get_text_change_serial (accessible) + 1;
+  if (!serial)
+    serial = 1;
+  g_object_set_qdata (G_OBJECT (accessible), quark_text_change_serial,
+                      GUINT_TO_POINTER (serial));
+  return serial;
+}
+
 /* 
  * Handles the ATK signal 'Gtk:AtkText:text-changed' and
  * converts it to the AT-SPI signal - 'object:text-changed'
@@ -678,16 +1799,18 @@ text_changed_event_listener (GSignalInvocationHint * signal_hint,
                              const GValue * param_values, gpointer data)
 {
   AtkObject *accessible;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *minor;
   gchar *selected;
-  gint detail1, detail2;
+  gint detail1 = 0, detail2 = 0;
+  dbus_uint32_t serial;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
-  minor = g_quark_to_string (signal_hint->detail);
+  minor = event_name->minor;
 
   if (G_VALUE_TYPE (&param_values[1]) == G_TYPE_INT)
     detail1 = g_value_get_int (&param_values[1]);
@@ -695,11 +1818,26 @@ text_changed_event_listener (GSignalInvocationHint * signal_hint,
   if (G_VALUE_TYPE (&param_values[2]) == G_TYPE_INT)
     detail2 = g_value_get_int (&param_values[2]);
 
+  /* Counted whether or not the event is sent, so stale serials never match */
+  serial = text_change_serial_next (accessible);
+
+  /* Spare copying the text when nobody wants it */
+  if (!event_wanted (ITF_EVENT_OBJECT, name, minor))
+    return TRUE;
+
+  if (spi_atk_text_changed_limit > 0 && detail2 > spi_atk_text_changed_limit)
+    {
+      emit_event (accessible, ITF_EVENT_OBJECT, name, minor, detail1, detail2,
+                  DBUS_TYPE_UINT32_AS_STRING, &serial, append_uint32);
+      return TRUE;
+    }
+
   selected =
     atk_text_get_text (ATK_TEXT (accessible), detail1, detail1 + detail2);
 
   emit_event (accessible, ITF_EVENT_OBJECT, name, minor, detail1, detail2,
               DBUS_TYPE_STRING_AS_STRING, selected, append_basic);
+  g_free (selected);
   return TRUE;
 }
 
@@ -717,15 +1855,16 @@ text_selection_changed_event_listener (GSignalInvocationHint * signal_hint,
                                        gpointer data)
 {
   AtkObject *accessible;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *minor;
-  gint detail1, detail2;
+  gint detail1 = 0, detail2 = 0;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
-  minor = g_quark_to_string (signal_hint->detail);
+  minor = event_name->minor;
 
   if (G_VALUE_TYPE (&param_values[1]) == G_TYPE_INT)
     detail1 = g_value_get_int (&param_values[1]);
@@ -755,22 +1894,32 @@ children_changed_event_listener (GSignalInvocationHint * signal_hint,
                                  guint n_param_values,
                                  const GValue * param_values, gpointer data)
 {
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name, *minor;
   gint detail1, detail2 = 0;
 
   AtkObject *accessible, *ao=NULL;
   gpointer child;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
-  minor = g_quark_to_string (signal_hint->detail);
+  minor = event_name->minor;
+
+  spi_cache_invalidate (spi_global_cache, G_OBJECT (accessible));
+
+  if (!event_wanted (ITF_EVENT_OBJECT, name, minor))
+    return TRUE;
 
   detail1 = g_value_get_uint (param_values + 1);
   child = g_value_get_pointer (param_values + 2);
 
+  send_pending_events (accessible, FALSE);
+  if (ATK_IS_OBJECT (child))
+    send_pending_events (ATK_OBJECT (child), FALSE);
+
   if (ATK_IS_OBJECT (child))
     {
       ao = ATK_OBJECT (child);
@@ -829,12 +1978,13 @@ generic_event_listener (GSignalInvocationHint * signal_hint,
                         const GValue * param_values, gpointer data)
 {
   AtkObject *accessible;
-  GSignalQuery signal_query;
+  const SpiEventName *event_name;
   const gchar *name;
   int detail1 = 0, detail2 = 0;
 
-  g_signal_query (signal_hint->signal_id, &signal_query);
-  name = signal_query.signal_name;
+  event_name = spi_event_name_lookup (signal_hint->signal_id,
+                                      signal_hint->detail);
+  name = event_name->name;
 
   accessible = ATK_OBJECT (g_value_get_object (&param_values[0]));
 
@@ -844,8 +1994,10 @@ generic_event_listener (GSignalInvocationHint * signal_hint,
   if (n_param_values > 2 && G_VALUE_TYPE (&param_values[2]) == G_TYPE_INT)
     detail2 = g_value_get_int (&param_values[2]);
 
-  emit_event (accessible, ITF_EVENT_OBJECT, name, "", detail1, detail2,
-              DBUS_TYPE_INT32_AS_STRING, 0, append_basic);
+  if (event_wanted (ITF_EVENT_OBJECT, name, "") &&
+      !coalesce_event (accessible, name, detail1, detail2, NULL))
+    emit_event (accessible, ITF_EVENT_OBJECT, name, "", detail1, detail2,
+                DBUS_TYPE_INT32_AS_STRING, 0, append_basic);
   return TRUE;
 }
 
@@ -857,85 +2009,143 @@ generic_event_listener (GSignalInvocationHint * signal_hint,
  * de-registered later.
  */
 static void
-add_signal_listener (GSignalEmissionHook listener, const char *signal_name)
+add_signal_listener (GArray *ids, GSignalEmissionHook listener,
+                     const char *signal_name)
 {
   guint id;
 
   id = atk_add_global_event_listener (listener, signal_name);
-  g_array_append_val (listener_ids, id);
+  g_array_append_val (ids, id);
 }
 
-/*
- * Initialization for the signal handlers.
- *
- * Registers all required signal handlers.
- */
-void
-spi_atk_register_event_listeners (void)
+static void
+remove_signal_listeners (GArray *ids)
 {
-  /*
-   * Kludge to make sure the Atk interface types are registered, otherwise
-   * the AtkText signal handlers below won't get registered
-   */
-  GObject *ao = g_object_new (ATK_TYPE_OBJECT, NULL);
-  AtkObject *bo = atk_no_op_object_new (ao);
+  gint i;
 
-  g_object_unref (G_OBJECT (bo));
-  g_object_unref (ao);
+  for (i = 0; ids && i < ids->len; i++)
+    {
+      atk_remove_global_event_listener (g_array_index (ids, guint, i));
+    }
+  if (ids)
+    g_array_free (ids, TRUE);
+}
 
-  /* Register for focus event notifications, and register app with central registry  */
+/*
+ * The handlers that do nothing but send events, added only while some
+ * client listens.
+ */
+static void
+add_emission_hooks (void)
+{
   listener_ids = g_array_sized_new (FALSE, TRUE, sizeof (guint), 16);
 
   atk_bridge_focus_tracker_id = atk_add_focus_tracker (focus_tracker);
 
-  add_signal_listener (property_event_listener,
-                       "Gtk:AtkObject:property-change");
-  add_signal_listener (window_event_listener, "window:create");
-  add_signal_listener (window_event_listener, "window:destroy");
-  add_signal_listener (window_event_listener, "window:minimize");
-  add_signal_listener (window_event_listener, "window:maximize");
-  add_signal_listener (window_event_listener, "window:restore");
-  add_signal_listener (window_event_listener, "window:activate");
-  add_signal_listener (window_event_listener, "window:deactivate");
-  add_signal_listener (document_event_listener,
+  add_signal_listener (listener_ids, window_event_listener, "window:create");
+  add_signal_listener (listener_ids, window_event_listener, "window:destroy");
+  add_signal_listener (listener_ids, window_event_listener, "window:minimize");
+  add_signal_listener (listener_ids, window_event_listener, "window:maximize");
+  add_signal_listener (listener_ids, window_event_listener, "window:restore");
+  add_signal_listener (listener_ids, window_event_listener, "window:activate");
+  add_signal_listener (listener_ids, window_event_listener,
+                       "window:deactivate");
+  add_signal_listener (listener_ids, document_event_listener,
                        "Gtk:AtkDocument:load-complete");
-  add_signal_listener (document_event_listener, "Gtk:AtkDocument:reload");
-  add_signal_listener (document_event_listener,
+  add_signal_listener (listener_ids, document_event_listener,
+                       "Gtk:AtkDocument:reload");
+  add_signal_listener (listener_ids, document_event_listener,
                        "Gtk:AtkDocument:load-stopped");
-  /* TODO Fake this event on the client side */
-  add_signal_listener (state_event_listener, "Gtk:AtkObject:state-change");
   /* TODO */
-  add_signal_listener (active_descendant_event_listener,
+  add_signal_listener (listener_ids, active_descendant_event_listener,
                        "Gtk:AtkObject:active-descendant-changed");
-  add_signal_listener (bounds_event_listener,
+  add_signal_listener (listener_ids, bounds_event_listener,
                        "Gtk:AtkComponent:bounds-changed");
-  add_signal_listener (text_selection_changed_event_listener,
+  add_signal_listener (listener_ids, text_selection_changed_event_listener,
                        "Gtk:AtkText:text-selection-changed");
-  add_signal_listener (text_changed_event_listener,
+  add_signal_listener (listener_ids, text_changed_event_listener,
                        "Gtk:AtkText:text-changed");
-  add_signal_listener (link_selected_event_listener,
+  add_signal_listener (listener_ids, link_selected_event_listener,
                        "Gtk:AtkHypertext:link-selected");
-  add_signal_listener (generic_event_listener,
+  add_signal_listener (listener_ids, generic_event_listener,
                        "Gtk:AtkObject:visible-data-changed");
-  add_signal_listener (generic_event_listener,
+  add_signal_listener (listener_ids, generic_event_listener,
                        "Gtk:AtkSelection:selection-changed");
-  add_signal_listener (generic_event_listener,
+  add_signal_listener (listener_ids, generic_event_listener,
                        "Gtk:AtkText:text-attributes-changed");
-  add_signal_listener (generic_event_listener,
+  add_signal_listener (listener_ids, generic_event_listener,
                        "Gtk:AtkText:text-caret-moved");
-  add_signal_listener (generic_event_listener, "Gtk:AtkTable:row-inserted");
-  add_signal_listener (generic_event_listener, "Gtk:AtkTable:row-reordered");
-  add_signal_listener (generic_event_listener, "Gtk:AtkTable:row-deleted");
-  add_signal_listener (generic_event_listener,
+  add_signal_listener (listener_ids, generic_event_listener,
+                       "Gtk:AtkTable:row-inserted");
+  add_signal_listener (listener_ids, generic_event_listener,
+                       "Gtk:AtkTable:row-reordered");
+  add_signal_listener (listener_ids, generic_event_listener,
+                       "Gtk:AtkTable:row-deleted");
+  add_signal_listener (listener_ids, generic_event_listener,
                        "Gtk:AtkTable:column-inserted");
-  add_signal_listener (generic_event_listener,
+  add_signal_listener (listener_ids, generic_event_listener,
                        "Gtk:AtkTable:column-reordered");
-  add_signal_listener (generic_event_listener, "Gtk:AtkTable:column-deleted");
-  add_signal_listener (generic_event_listener, "Gtk:AtkTable:model-changed");
+  add_signal_listener (listener_ids, generic_event_listener,
+                       "Gtk:AtkTable:column-deleted");
+  add_signal_listener (listener_ids, generic_event_listener,
+                       "Gtk:AtkTable:model-changed");
+}
+
+static void
+remove_emission_hooks (void)
+{
+  GArray *ids = listener_ids;
+  listener_ids = NULL;
+
+  if (atk_bridge_focus_tracker_id)
+    atk_remove_focus_tracker (atk_bridge_focus_tracker_id);
+  atk_bridge_focus_tracker_id = 0;
+
+  remove_signal_listeners (ids);
+}
+
+/* Adds the emission hooks if any client listens, or removes them if none */
+static void
+update_emission_hooks (void)
+{
+  gboolean wanted = !event_listeners_known || event_listeners != NULL;
+
+  if (wanted && !listener_ids)
+    add_emission_hooks ();
+  else if (!wanted && listener_ids)
+    remove_emission_hooks ();
+}
+
+/*
+ * Initialization for the signal handlers.
+ *
+ * Registers all required signal handlers.
+ */
+void
+spi_atk_register_event_listeners (void)
+{
+  /*
+   * Kludge to make sure the Atk interface types are registered, otherwise
+   * the AtkText signal handlers below won't get registered
+   */
+  GObject *ao = g_object_new (ATK_TYPE_OBJECT, NULL);
+  AtkObject *bo = atk_no_op_object_new (ao);
+
+  g_object_unref (G_OBJECT (bo));
+  g_object_unref (ao);
+
+  /* These also keep the cache current, so stay whoever listens */
+  cache_listener_ids = g_array_sized_new (FALSE, TRUE, sizeof (guint), 4);
+
+  add_signal_listener (cache_listener_ids, property_event_listener,
+                       "Gtk:AtkObject:property-change");
+  /* TODO Fake this event on the client side */
+  add_signal_listener (cache_listener_ids, state_event_listener,
+                       "Gtk:AtkObject:state-change");
 
   /* Children signal listeners */
-  atk_add_global_event_listener (children_changed_event_listener,
-                                 "Gtk:AtkObject:children-changed");
+  add_signal_listener (cache_listener_ids, children_changed_event_listener,
+                       "Gtk:AtkObject:children-changed");
 
 #if 0
   g_signal_connect (G_OBJECT (spi_global_app_data->root),
@@ -947,6 +2157,10 @@ spi_atk_register_event_listeners (void)
                     (GCallback) toplevel_removed_event_listener, NULL);
 #endif
 
+  get_registered_event_listeners ();
+  get_registered_key_listeners ();
+  update_emission_hooks ();
+
   /*
    * May add the following listeners to implement preemptive key listening for GTK+
    *
@@ -965,20 +2179,30 @@ spi_atk_register_event_listeners (void)
 void
 spi_atk_deregister_event_listeners (void)
 {
-  gint i;
-  GArray *ids = listener_ids;
-  listener_ids = NULL;
-
-  if (atk_bridge_focus_tracker_id)
-    atk_remove_focus_tracker (atk_bridge_focus_tracker_id);
+  GArray *ids = cache_listener_ids;
+  cache_listener_ids = NULL;
 
-  for (i = 0; ids && i < ids->len; i++)
-    {
-      atk_remove_global_event_listener (g_array_index (ids, guint, i));
-    }
+  remove_emission_hooks ();
+  remove_signal_listeners (ids);
+  clear_pending_events ();
+  clear_rate_buckets ();
+  spi_event_names_clear ();
+  clear_event_templates ();
 
   if (atk_bridge_key_event_listener_id)
     atk_remove_key_event_listener (atk_bridge_key_event_listener_id);
+  atk_bridge_key_event_listener_id = 0;
+
+  if (event_listener_filter_added)
+    dbus_connection_remove_filter (spi_global_app_data->bus,
+                                   event_listener_filter, NULL);
+  event_listener_filter_added = FALSE;
+  cancel_registry_call (&event_listeners_call);
+  cancel_registry_call (&key_listeners_call);
+  clear_event_listeners ();
+  event_listeners_known = FALSE;
+  spi_key_listeners_clear ();
+  key_listeners_known = FALSE;
 }
 
 /*---------------------------------------------------------------------------*/
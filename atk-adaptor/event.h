@@ -25,10 +25,36 @@
 #ifndef EVENT_H
 #define EVENT_H
 
+#include <atk/atk.h>
 #include <common/spi-types.h>
 
 void spi_atk_register_event_listeners (void);
 void spi_atk_deregister_event_listeners (void);
 void spi_atk_tidy_windows (void);
 
+void spi_atk_get_event_counts (guint *emitted, guint *suppressed);
+void spi_atk_reset_event_counts (void);
+
+void spi_atk_set_coalesce_windows (const gchar *spec);
+void spi_atk_set_rate_limits (const gchar *spec);
+void spi_atk_send_held_events (GObject *object);
+
+guint spi_atk_get_text_change_serial (AtkObject *accessible);
+
+/* Bucket i counts key events answered in under 2^i us */
+#define SPI_KEY_STATS_BUCKETS 24
+
+typedef struct _SpiKeyStats
+{
+  guint sent;
+  guint consumed;
+  guint timed_out;
+  guint unwaited;
+  guint skipped;
+  guint buckets[SPI_KEY_STATS_BUCKETS];
+} SpiKeyStats;
+
+void spi_atk_get_key_stats (SpiKeyStats *stats);
+void spi_atk_reset_key_stats (void);
+
 #endif /* EVENT_H */
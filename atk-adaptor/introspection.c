@@ -508,6 +508,14 @@ const char *spi_org_a11y_atspi_Text =
 "    <arg direction=\"out\" type=\"s\" />"
 "  </method>"
 ""
+"  <method name=\"GetTextAtSerial\">"
+"    <arg direction=\"in\" name=\"changeSerial\" type=\"u\" />"
+"    <arg direction=\"in\" name=\"startOffset\" type=\"i\" />"
+"    <arg direction=\"in\" name=\"endOffset\" type=\"i\" />"
+"    <arg direction=\"out\" name=\"current\" type=\"b\" />"
+"    <arg direction=\"out\" type=\"s\" />"
+"  </method>"
+""
 "  <method name=\"SetCaretOffset\">"
 "    <arg direction=\"in\" name=\"offset\" type=\"i\" />"
 "    <arg direction=\"out\" type=\"b\" />"
@@ -694,6 +702,29 @@ const char *spi_org_a11y_atspi_Cache =
 "    "
 "  </method>"
 ""
+"  <method name=\"GetItemsPaged\">"
+"    <arg direction=\"in\" name=\"cursor\" type=\"u\" />"
+"    <arg direction=\"in\" name=\"maxItems\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"nodes\" type=\"a((so)(so)(so)a(so)assusau)\" />"
+"    <arg direction=\"out\" name=\"nextCursor\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"generation\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"removed\" type=\"a(so)\" />"
+"    <arg direction=\"out\" name=\"resync\" type=\"b\" />"
+"  </method>"
+""
+"  <method name=\"GetItemsCompact\">"
+"    <arg direction=\"out\" name=\"busName\" type=\"s\" />"
+"    <arg direction=\"out\" name=\"pathPrefix\" type=\"s\" />"
+"    <arg direction=\"out\" name=\"interfaces\" type=\"as\" />"
+"    <arg direction=\"out\" name=\"nodes\" type=\"a(uuauuuuuau)\" />"
+"    <arg direction=\"out\" name=\"fullNodes\" type=\"a((so)(so)(so)a(so)assusau)\" />"
+"    <arg direction=\"out\" name=\"strings\" type=\"as\" />"
+"  </method>"
+""
+"  <method name=\"PopulateSubtree\">"
+"    <arg direction=\"in\" name=\"root\" type=\"o\" />"
+"  </method>"
+""
 "  <signal name=\"AddAccessible\">"
 "    <arg name=\"nodeAdded\" type=\"((so)(so)a(so)assusau)\" />"
 "    "
@@ -704,6 +735,16 @@ const char *spi_org_a11y_atspi_Cache =
 "    "
 "  </signal>"
 ""
+"  <signal name=\"AddAccessibles\">"
+"    <arg name=\"nodesAdded\" type=\"a((so)(so)(so)a(so)assusau)\" />"
+"    "
+"  </signal>"
+""
+"  <signal name=\"RemoveAccessibles\">"
+"    <arg name=\"nodesRemoved\" type=\"a(so)\" />"
+"    "
+"  </signal>"
+""
 "</interface>"
 "";
 
@@ -797,3 +838,53 @@ const char *spi_org_a11y_atspi_DeviceEventListener =
 "</interface>"
 "";
 
+const char *spi_org_a11y_atspi_Stats = 
+"<interface name=\"org.a11y.atspi.Stats\" version=\"0.1.7\">"
+""
+"  <method name=\"GetStats\">"
+"    <arg direction=\"out\" name=\"stats\" type=\"a(ssuuau)\" />"
+"  </method>"
+""
+"  <method name=\"GetEventCounts\">"
+"    <arg direction=\"out\" name=\"emitted\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"suppressed\" type=\"u\" />"
+"  </method>"
+""
+"  <method name=\"GetRateLimitCounts\">"
+"    <arg direction=\"out\" name=\"counts\" type=\"a(suu)\" />"
+"  </method>"
+""
+"  <method name=\"GetKeyStats\">"
+"    <arg direction=\"out\" name=\"sent\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"consumed\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"timed_out\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"unwaited\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"skipped\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"buckets\" type=\"au\" />"
+"  </method>"
+""
+"  <method name=\"GetCacheStats\">"
+"    <arg direction=\"out\" name=\"signalsSaved\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"slices\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"lastSliceUs\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"maxSliceUs\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"totalSliceUs\" type=\"t\" />"
+"  </method>"
+""
+"  <method name=\"GetLeaseStats\">"
+"    <arg direction=\"out\" name=\"active\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"renewals\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"expirations\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"renewalsPerSecond\" type=\"u\" />"
+"    <arg direction=\"out\" name=\"expirationsPerSecond\" type=\"u\" />"
+"  </method>"
+""
+"  <method name=\"Reset\">"
+"  </method>"
+""
+"  <method name=\"SetEnabled\">"
+"    <arg direction=\"in\" name=\"enabled\" type=\"b\" />"
+"  </method>"
+""
+"</interface>"
+"";
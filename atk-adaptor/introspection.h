@@ -47,5 +47,7 @@ const char *spi_org_a11y_atspi_DeviceEventController;
 
 const char *spi_org_a11y_atspi_DeviceEventListener;
 
+const char *spi_org_a11y_atspi_Stats;
+
 
 #endif /* SPI_INTROSPECTION_DATA_H_ */
@@ -0,0 +1,180 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "key-listeners.h"
+
+typedef struct _SpiKeyListener
+{
+  gchar *bus_name;
+  gchar *path;
+  dbus_uint32_t mask;
+  gboolean preemptive;
+} SpiKeyListener;
+
+/* A client registers a listener once for each modifier mask it wants */
+static GList *key_listeners = NULL;
+
+static void
+key_listener_free (SpiKeyListener * listener)
+{
+  g_free (listener->bus_name);
+  g_free (listener->path);
+  g_free (listener);
+}
+
+/*
+ * Reads a listener from the iterator, which must point at a struct of
+ * SPI_KEY_LISTENER_SIGNATURE.
+ */
+static SpiKeyListener *
+key_listener_new_from_iter (DBusMessageIter * iter)
+{
+  SpiKeyListener *listener;
+  DBusMessageIter iter_struct, iter_mode;
+  const char *bus_name, *path;
+  dbus_uint32_t mask;
+  dbus_bool_t synchronous, preemptive;
+
+  dbus_message_iter_recurse (iter, &iter_struct);
+  dbus_message_iter_get_basic (&iter_struct, &bus_name);
+  dbus_message_iter_next (&iter_struct);
+  dbus_message_iter_get_basic (&iter_struct, &path);
+  dbus_message_iter_next (&iter_struct);        /* type */
+  dbus_message_iter_next (&iter_struct);        /* event types */
+  dbus_message_iter_next (&iter_struct);        /* keys */
+  dbus_message_iter_next (&iter_struct);
+  dbus_message_iter_get_basic (&iter_struct, &mask);
+  dbus_message_iter_next (&iter_struct);
+  dbus_message_iter_recurse (&iter_struct, &iter_mode);
+  dbus_message_iter_get_basic (&iter_mode, &synchronous);
+  dbus_message_iter_next (&iter_mode);
+  dbus_message_iter_get_basic (&iter_mode, &preemptive);
+
+  listener = g_new0 (SpiKeyListener, 1);
+  listener->bus_name = g_strdup (bus_name);
+  listener->path = g_strdup (path);
+  listener->mask = mask;
+  listener->preemptive = preemptive;
+  return listener;
+}
+
+static void
+remove_key_listener (const SpiKeyListener * removed)
+{
+  GList *l;
+
+  for (l = key_listeners; l; l = l->next)
+    {
+      SpiKeyListener *listener = l->data;
+
+      if (!strcmp (listener->bus_name, removed->bus_name) &&
+          !strcmp (listener->path, removed->path) &&
+          listener->mask == removed->mask)
+        {
+          key_listeners = g_list_delete_link (key_listeners, l);
+          key_listener_free (listener);
+          return;
+        }
+    }
+}
+
+/*
+ * Replaces the listeners with those in a reply to GetKeystrokeListeners.
+ * Returns FALSE, leaving them as they were, if the reply is not an array
+ * of listeners.
+ */
+gboolean
+spi_key_listeners_read (DBusMessage * reply)
+{
+  DBusMessageIter iter, iter_array;
+
+  if (strcmp (dbus_message_get_signature (reply),
+              DBUS_TYPE_ARRAY_AS_STRING SPI_KEY_LISTENER_SIGNATURE))
+    return FALSE;
+
+  spi_key_listeners_clear ();
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+    {
+      key_listeners = g_list_prepend (key_listeners,
+                                      key_listener_new_from_iter (&iter_array));
+      dbus_message_iter_next (&iter_array);
+    }
+  return TRUE;
+}
+
+/*
+ * Adds or removes the listener a KeystrokeListenerRegistered or
+ * KeystrokeListenerDeregistered signal carries. Returns FALSE if the
+ * signal does not carry one.
+ */
+gboolean
+spi_key_listeners_update (DBusMessage * signal)
+{
+  DBusMessageIter iter;
+  SpiKeyListener *listener;
+
+  if (strcmp (dbus_message_get_signature (signal), SPI_KEY_LISTENER_SIGNATURE))
+    return FALSE;
+
+  dbus_message_iter_init (signal, &iter);
+  listener = key_listener_new_from_iter (&iter);
+  if (!strcmp (dbus_message_get_member (signal), "KeystrokeListenerRegistered"))
+    key_listeners = g_list_prepend (key_listeners, listener);
+  else
+    {
+      remove_key_listener (listener);
+      key_listener_free (listener);
+    }
+  return TRUE;
+}
+
+void
+spi_key_listeners_clear (void)
+{
+  g_list_foreach (key_listeners, (GFunc) key_listener_free, NULL);
+  g_list_free (key_listeners);
+  key_listeners = NULL;
+}
+
+gboolean
+spi_key_listeners_any (void)
+{
+  return key_listeners != NULL;
+}
+
+/* Only a preemptive listener can consume a key */
+gboolean
+spi_key_listeners_may_consume (void)
+{
+  GList *l;
+
+  for (l = key_listeners; l; l = l->next)
+    if (((SpiKeyListener *) l->data)->preemptive)
+      return TRUE;
+  return FALSE;
+}
+
+/*END------------------------------------------------------------------------*/
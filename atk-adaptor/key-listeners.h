@@ -0,0 +1,52 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef KEY_LISTENERS_H
+#define KEY_LISTENERS_H
+
+#include <dbus/dbus.h>
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * The keystroke listeners clients hold with the device event controller.
+ * The controller describes each as a struct of bus name, path, listener
+ * type, event types, keys, modifier mask and (synchronous, preemptive,
+ * global) mode, both in the reply to GetKeystrokeListeners and in its
+ * KeystrokeListenerRegistered and KeystrokeListenerDeregistered signals.
+ */
+#define SPI_KEY_LISTENER_SIGNATURE "(souua(iisi)u(bbb))"
+
+gboolean spi_key_listeners_read (DBusMessage *reply);
+
+gboolean spi_key_listeners_update (DBusMessage *signal);
+
+void spi_key_listeners_clear (void);
+
+gboolean spi_key_listeners_any (void);
+
+gboolean spi_key_listeners_may_consume (void);
+
+G_END_DECLS
+
+#endif /* KEY_LISTENERS_H */
@@ -29,6 +29,7 @@
  * and supported interfaces to a D-Bus message.
  */
 
+#include <string.h>
 #include <atk/atk.h>
 #include <common/spi-types.h>
 #include <common/spi-dbus.h>
@@ -94,7 +95,8 @@ spi_object_append_reference (DBusMessageIter * iter, AtkObject * obj)
 {
   DBusMessageIter iter_struct;
   const gchar *name;
-  gchar *path;
+  const gchar *path;
+  gchar buf[SPI_REGISTER_PATH_MAX];
 
   if (!obj) {
     spi_object_append_null_reference (iter);
@@ -104,18 +106,16 @@ spi_object_append_reference (DBusMessageIter * iter, AtkObject * obj)
   spi_object_lease_if_needed (G_OBJECT (obj));
 
   name = dbus_bus_get_unique_name (spi_global_app_data->bus);
-  path = spi_register_object_to_path (spi_global_register, G_OBJECT (obj));
+  path = spi_register_object_path_into (spi_global_register, G_OBJECT (obj), buf);
 
   if (!path)
-    path = g_strdup (SPI_DBUS_PATH_NULL);
+    path = SPI_DBUS_PATH_NULL;
 
   dbus_message_iter_open_container (iter, DBUS_TYPE_STRUCT, NULL,
                                     &iter_struct);
   dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
   dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
   dbus_message_iter_close_container (iter, &iter_struct);
-  
-  g_free (path);
 }
 
 /* TODO: Perhaps combine with spi_object_append_reference.  Leaving separate
@@ -125,7 +125,8 @@ spi_hyperlink_append_reference (DBusMessageIter * iter, AtkHyperlink * obj)
 {
   DBusMessageIter iter_struct;
   const gchar *name;
-  gchar *path;
+  const gchar *path;
+  gchar buf[SPI_REGISTER_PATH_MAX];
 
   if (!obj) {
     spi_object_append_null_reference (iter);
@@ -135,18 +136,16 @@ spi_hyperlink_append_reference (DBusMessageIter * iter, AtkHyperlink * obj)
   spi_object_lease_if_needed (G_OBJECT (obj));
 
   name = dbus_bus_get_unique_name (spi_global_app_data->bus);
-  path = spi_register_object_to_path (spi_global_register, G_OBJECT (obj));
+  path = spi_register_object_path_into (spi_global_register, G_OBJECT (obj), buf);
 
   if (!path)
-    path = g_strdup (SPI_DBUS_PATH_NULL);
+    path = SPI_DBUS_PATH_NULL;
 
   dbus_message_iter_open_container (iter, DBUS_TYPE_STRUCT, NULL,
                                     &iter_struct);
   dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &name);
   dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
   dbus_message_iter_close_container (iter, &iter_struct);
-  
-  g_free (path);
 }
 
 void
@@ -301,6 +300,114 @@ spi_object_append_interfaces (DBusMessageIter * iter, AtkObject * obj)
     }
 }
 
+/*
+ * Interfaces in the order of their bits in spi_object_get_interface_mask.
+ */
+static const gchar * const interface_bits[] = {
+  SPI_DBUS_INTERFACE_ACCESSIBLE,
+  SPI_DBUS_INTERFACE_ACTION,
+  SPI_DBUS_INTERFACE_APPLICATION,
+  SPI_DBUS_INTERFACE_COMPONENT,
+  SPI_DBUS_INTERFACE_EDITABLE_TEXT,
+  SPI_DBUS_INTERFACE_TEXT,
+  SPI_DBUS_INTERFACE_HYPERTEXT,
+  SPI_DBUS_INTERFACE_IMAGE,
+  SPI_DBUS_INTERFACE_SELECTION,
+  SPI_DBUS_INTERFACE_TABLE,
+  SPI_DBUS_INTERFACE_VALUE,
+  SPI_DBUS_INTERFACE_COLLECTION,
+  SPI_DBUS_INTERFACE_DOCUMENT,
+  SPI_DBUS_INTERFACE_HYPERLINK,
+  NULL
+};
+
+/*
+ * Returns the interfaces that spi_object_append_interfaces would list
+ * as a bitmask, bit n being set for the nth interface appended by
+ * spi_object_append_interface_names.
+ */
+dbus_uint32_t
+spi_object_get_interface_mask (AtkObject * obj)
+{
+  dbus_uint32_t mask = 1 << 0;
+
+  if (ATK_IS_ACTION (obj))
+    mask |= 1 << 1;
+  if (atk_object_get_role (obj) == ATK_ROLE_APPLICATION)
+    mask |= 1 << 2;
+  if (ATK_IS_COMPONENT (obj))
+    mask |= 1 << 3;
+  if (ATK_IS_EDITABLE_TEXT (obj))
+    mask |= 1 << 4;
+  if (ATK_IS_TEXT (obj))
+    mask |= 1 << 5;
+  if (ATK_IS_HYPERTEXT (obj))
+    mask |= 1 << 6;
+  if (ATK_IS_IMAGE (obj))
+    mask |= 1 << 7;
+  if (ATK_IS_SELECTION (obj))
+    mask |= 1 << 8;
+  if (ATK_IS_TABLE (obj))
+    mask |= 1 << 9;
+  if (ATK_IS_VALUE (obj))
+    mask |= 1 << 10;
+  if (ATK_IS_DOCUMENT (obj))
+    mask |= (1 << 11) | (1 << 12);
+  if (ATK_IS_HYPERLINK_IMPL (obj))
+    mask |= 1 << 13;
+
+  return mask;
+}
+
+void
+spi_object_append_interface_names (DBusMessageIter * iter)
+{
+  gint i;
+
+  for (i = 0; interface_bits[i]; i++)
+    dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &interface_bits[i]);
+}
+
+/*
+ * Appends the names of the interfaces in a mask returned by
+ * spi_object_get_interface_mask.
+ */
+void
+spi_object_append_interface_mask (DBusMessageIter * iter, dbus_uint32_t mask)
+{
+  gint i;
+
+  for (i = 0; interface_bits[i]; i++)
+    if (mask & (1 << i))
+      dbus_message_iter_append_basic (iter, DBUS_TYPE_STRING, &interface_bits[i]);
+}
+
+/*
+ * The interface names for the masks spi_object_get_implemented returns,
+ * NULL terminated.
+ */
+const gchar * const *
+spi_object_get_interface_names (void)
+{
+  return interface_bits;
+}
+
+/*
+ * Tells droute which interfaces the object behind an accessible path
+ * implements, with one call for all of them. Hyperlinks are registered
+ * on the same paths as accessibles but only implement the Hyperlink
+ * interface. Interfaces not listed in interface_bits, such as Socket,
+ * are always implemented.
+ */
+guint64
+spi_object_get_implemented (void *datum)
+{
+  if (!ATK_IS_OBJECT (datum))
+    return ATK_IS_HYPERLINK (datum) ? 1 << 13 : 0;
+
+  return spi_object_get_interface_mask (ATK_OBJECT (datum));
+}
+
 /*---------------------------------------------------------------------------*/
 
 void
@@ -54,6 +54,21 @@ spi_hyperlink_return_reference (DBusMessage * msg, AtkHyperlink * obj);
 void
 spi_object_append_interfaces (DBusMessageIter * iter, AtkObject * obj);
 
+dbus_uint32_t
+spi_object_get_interface_mask (AtkObject * obj);
+
+void
+spi_object_append_interface_names (DBusMessageIter * iter);
+
+void
+spi_object_append_interface_mask (DBusMessageIter * iter, dbus_uint32_t mask);
+
+const gchar * const *
+spi_object_get_interface_names (void);
+
+guint64
+spi_object_get_implemented (void *datum);
+
 void
 spi_object_append_attribute_set (DBusMessageIter * iter, AtkAttributeSet * attr);
 
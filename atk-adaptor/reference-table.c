@@ -0,0 +1,302 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "reference-table.h"
+
+/*
+ * The low bits of a reference hold the slot index plus one, so that a
+ * reference is never 0. The high bits hold the generation of the slot.
+ * Each slot can give out 256 references before it is retired, which
+ * is as many in all as a 32 bit counter.
+ */
+#define SPI_REF_INDEX_BITS      24
+#define SPI_REF_INDEX_MASK      ((1 << SPI_REF_INDEX_BITS) - 1)
+#define SPI_REF_GENERATION_MASK 0xff
+
+#define SPI_REF_MAKE(index, generation) \
+        ((((generation) & SPI_REF_GENERATION_MASK) << SPI_REF_INDEX_BITS) | ((index) + 1))
+#define SPI_REF_INDEX(ref)      (((ref) & SPI_REF_INDEX_MASK) - 1)
+#define SPI_REF_GENERATION(ref) ((ref) >> SPI_REF_INDEX_BITS)
+
+#define SPI_REF_MIN_SLOTS   64
+#define SPI_REF_MIN_BUCKETS 128
+
+typedef struct _SpiRefSlot
+{
+  gpointer object;
+  guint generation;
+  guint next_free;              /* Index plus one of the next free slot */
+} SpiRefSlot;
+
+typedef struct _SpiRefBucket
+{
+  gconstpointer object;
+  guint ref;
+} SpiRefBucket;
+
+struct _SpiRefTable
+{
+  SpiRefSlot *slots;
+  guint n_slots;
+  guint slots_allocated;
+  guint free_head;
+
+  SpiRefBucket *buckets;
+  guint bucket_mask;
+  guint n_objects;
+};
+
+/*---------------------------------------------------------------------------*/
+
+static inline guint
+object_hash (gconstpointer object)
+{
+  guint64 h = (guint64) GPOINTER_TO_SIZE (object);
+
+  return (guint) ((h * G_GUINT64_CONSTANT (0x9E3779B97F4A7C15)) >> 32);
+}
+
+static void
+buckets_insert (SpiRefBucket * buckets, guint mask,
+                gconstpointer object, guint ref)
+{
+  guint i = object_hash (object) & mask;
+
+  while (buckets[i].object != NULL)
+    i = (i + 1) & mask;
+
+  buckets[i].object = object;
+  buckets[i].ref = ref;
+}
+
+static void
+buckets_grow (SpiRefTable * table)
+{
+  SpiRefBucket *old = table->buckets;
+  guint old_size = table->bucket_mask + 1;
+  guint new_mask = (old_size << 1) - 1;
+  guint i;
+
+  table->buckets = g_new0 (SpiRefBucket, new_mask + 1);
+  table->bucket_mask = new_mask;
+
+  for (i = 0; i < old_size; i++)
+    {
+      if (old[i].object)
+        buckets_insert (table->buckets, new_mask, old[i].object, old[i].ref);
+    }
+  g_free (old);
+}
+
+static gint
+buckets_find (SpiRefTable * table, gconstpointer object)
+{
+  guint mask = table->bucket_mask;
+  guint i = object_hash (object) & mask;
+
+  while (table->buckets[i].object != NULL)
+    {
+      if (table->buckets[i].object == object)
+        return i;
+      i = (i + 1) & mask;
+    }
+  return -1;
+}
+
+/*
+ * Removes the bucket at index i, shifting later entries of the same
+ * probe sequence back so that no tombstones are needed.
+ */
+static void
+buckets_delete (SpiRefTable * table, guint i)
+{
+  SpiRefBucket *buckets = table->buckets;
+  guint mask = table->bucket_mask;
+  guint j = i;
+  guint home;
+
+  for (;;)
+    {
+      j = (j + 1) & mask;
+      if (buckets[j].object == NULL)
+        break;
+
+      home = object_hash (buckets[j].object) & mask;
+      /* Leave the entry if its home lies cyclically within (i, j] */
+      if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+        continue;
+
+      buckets[i] = buckets[j];
+      i = j;
+    }
+  buckets[i].object = NULL;
+  buckets[i].ref = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+SpiRefTable *
+spi_ref_table_new (void)
+{
+  SpiRefTable *table;
+
+  table = g_new0 (SpiRefTable, 1);
+  table->slots_allocated = SPI_REF_MIN_SLOTS;
+  table->slots = g_new (SpiRefSlot, table->slots_allocated);
+  table->buckets = g_new0 (SpiRefBucket, SPI_REF_MIN_BUCKETS);
+  table->bucket_mask = SPI_REF_MIN_BUCKETS - 1;
+  return table;
+}
+
+void
+spi_ref_table_free (SpiRefTable * table)
+{
+  g_free (table->slots);
+  g_free (table->buckets);
+  g_free (table);
+}
+
+/*
+ * Assigns a new reference to the object.
+ *
+ * The object must not already be in the table.
+ * Returns 0 if the table is full.
+ */
+guint
+spi_ref_table_insert (SpiRefTable * table, gpointer object)
+{
+  SpiRefSlot *slot;
+  guint index, ref;
+
+  g_return_val_if_fail (object != NULL, 0);
+
+  if (table->free_head)
+    {
+      index = table->free_head - 1;
+      slot = &table->slots[index];
+      table->free_head = slot->next_free;
+    }
+  else
+    {
+      if (table->n_slots == SPI_REF_INDEX_MASK)
+        return 0;
+      if (table->n_slots == table->slots_allocated)
+        {
+          table->slots_allocated *= 2;
+          table->slots = g_renew (SpiRefSlot, table->slots,
+                                  table->slots_allocated);
+        }
+      index = table->n_slots++;
+      slot = &table->slots[index];
+      slot->generation = 0;
+    }
+
+  slot->object = object;
+  slot->next_free = 0;
+  ref = SPI_REF_MAKE (index, slot->generation);
+
+  /* Keep the load factor of the reverse table at or below one half */
+  if ((table->n_objects + 1) * 2 > table->bucket_mask + 1)
+    buckets_grow (table);
+  buckets_insert (table->buckets, table->bucket_mask, object, ref);
+  table->n_objects++;
+
+  return ref;
+}
+
+/*
+ * Removes the object from the table, returning the reference
+ * it had, or 0 if it was not present.
+ */
+guint
+spi_ref_table_remove (SpiRefTable * table, gconstpointer object)
+{
+  SpiRefSlot *slot;
+  gint i;
+  guint ref, index;
+
+  i = buckets_find (table, object);
+  if (i < 0)
+    return 0;
+
+  ref = table->buckets[i].ref;
+  buckets_delete (table, i);
+  table->n_objects--;
+
+  index = SPI_REF_INDEX (ref);
+  slot = &table->slots[index];
+  slot->object = NULL;
+
+  /*
+   * A slot whose generation is used up is retired rather than wrapped,
+   * so that no reference is ever handed out twice.
+   */
+  if (slot->generation == SPI_REF_GENERATION_MASK)
+    return ref;
+
+  slot->generation++;
+  slot->next_free = table->free_head;
+  table->free_head = index + 1;
+
+  return ref;
+}
+
+gpointer
+spi_ref_table_lookup_object (SpiRefTable * table, guint ref)
+{
+  SpiRefSlot *slot;
+  guint index;
+
+  if ((ref & SPI_REF_INDEX_MASK) == 0)
+    return NULL;
+
+  index = SPI_REF_INDEX (ref);
+  if (index >= table->n_slots)
+    return NULL;
+
+  slot = &table->slots[index];
+  if ((slot->generation & SPI_REF_GENERATION_MASK) != SPI_REF_GENERATION (ref))
+    return NULL;
+  return slot->object;
+}
+
+guint
+spi_ref_table_lookup_ref (SpiRefTable * table, gconstpointer object)
+{
+  gint i;
+
+  if (object == NULL)
+    return 0;
+
+  i = buckets_find (table, object);
+  if (i < 0)
+    return 0;
+  return table->buckets[i].ref;
+}
+
+guint
+spi_ref_table_size (SpiRefTable * table)
+{
+  return table->n_objects;
+}
+
+/*END------------------------------------------------------------------------*/
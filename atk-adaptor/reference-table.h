@@ -0,0 +1,64 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef REFERENCE_TABLE_H
+#define REFERENCE_TABLE_H
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A two way mapping between objects and the integer references used
+ * in their D-Bus object paths.
+ *
+ * References index a dense slot array and carry a small generation
+ * count, so that a stale reference to a slot that has since been
+ * reused does not resolve to the new object. A reference is never
+ * handed out twice. The reverse mapping is
+ * an open-addressing hash table keyed on the object pointer.
+ */
+typedef struct _SpiRefTable SpiRefTable;
+
+SpiRefTable *
+spi_ref_table_new (void);
+
+void
+spi_ref_table_free (SpiRefTable * table);
+
+guint
+spi_ref_table_insert (SpiRefTable * table, gpointer object);
+
+guint
+spi_ref_table_remove (SpiRefTable * table, gconstpointer object);
+
+gpointer
+spi_ref_table_lookup_object (SpiRefTable * table, guint ref);
+
+guint
+spi_ref_table_lookup_ref (SpiRefTable * table, gconstpointer object);
+
+guint
+spi_ref_table_size (SpiRefTable * table);
+
+G_END_DECLS
+#endif /* REFERENCE_TABLE_H */
@@ -0,0 +1,205 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Compares the object register lookups of SpiRefTable against the
+ * previous implementation, a GHashTable mapping references to objects
+ * with the reverse mapping held as GObject data on each object.
+ *
+ * Run with no arguments. Times are in nanoseconds per operation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <glib.h>
+#include <glib-object.h>
+
+#include "reference-table.h"
+
+#define SPI_DBUS_ID "spi-dbus-id"
+
+/*
+ * Real accessibles carry other object data, which the GData
+ * lookup has to walk past.
+ */
+static const gchar *extra_keys[] = {
+  "gail-focus-object", "gtk-accessible", "atk-relation-set", "atk-parent", NULL
+};
+
+static GObject **objects;
+static guint *refs;
+static guint *order;
+
+static gdouble
+ns_per_op (GTimer * timer, guint n)
+{
+  return g_timer_elapsed (timer, NULL) * 1e9 / n;
+}
+
+static void
+make_objects (guint n)
+{
+  guint i, j;
+
+  objects = g_new (GObject *, n);
+  refs = g_new (guint, n);
+  order = g_new (guint, n);
+
+  for (i = 0; i < n; i++)
+    {
+      objects[i] = g_object_new (G_TYPE_OBJECT, NULL);
+      for (j = 0; extra_keys[j]; j++)
+        g_object_set_data (objects[i], extra_keys[j], GINT_TO_POINTER (j + 1));
+      order[i] = i;
+    }
+
+  /* Lookups are done in a random order */
+  for (i = n - 1; i > 0; i--)
+    {
+      guint k = g_random_int_range (0, i + 1);
+      guint t = order[i];
+      order[i] = order[k];
+      order[k] = t;
+    }
+}
+
+static void
+free_objects (guint n)
+{
+  guint i;
+
+  for (i = 0; i < n; i++)
+    g_object_unref (objects[i]);
+  g_free (objects);
+  g_free (refs);
+  g_free (order);
+}
+
+static void
+bench_hash_table (guint n)
+{
+  GHashTable *ref2ptr;
+  GTimer *timer;
+  guint i;
+  gsize sum = 0;
+  gdouble insert, to_object, to_ref, remove;
+
+  ref2ptr = g_hash_table_new (g_direct_hash, g_direct_equal);
+  timer = g_timer_new ();
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    {
+      refs[i] = i + 1;
+      g_hash_table_insert (ref2ptr, GINT_TO_POINTER (refs[i]), objects[i]);
+      g_object_set_data (objects[i], SPI_DBUS_ID, GINT_TO_POINTER (refs[i]));
+    }
+  insert = ns_per_op (timer, n);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    sum += GPOINTER_TO_SIZE (g_hash_table_lookup (ref2ptr,
+                                                  GINT_TO_POINTER (refs[order[i]])));
+  to_object = ns_per_op (timer, n);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    sum += GPOINTER_TO_INT (g_object_get_data (objects[order[i]], SPI_DBUS_ID));
+  to_ref = ns_per_op (timer, n);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    {
+      GObject *obj = objects[order[i]];
+      guint ref = GPOINTER_TO_INT (g_object_get_data (obj, SPI_DBUS_ID));
+      g_hash_table_remove (ref2ptr, GINT_TO_POINTER (ref));
+      g_object_set_data (obj, SPI_DBUS_ID, NULL);
+    }
+  remove = ns_per_op (timer, n);
+
+  printf ("%-10s %8u %10.1f %10.1f %10.1f %10.1f (%lu)\n",
+          "GHashTable", n, insert, to_object, to_ref, remove, (gulong) (sum & 1));
+
+  g_timer_destroy (timer);
+  g_hash_table_destroy (ref2ptr);
+}
+
+static void
+bench_ref_table (guint n)
+{
+  SpiRefTable *table;
+  GTimer *timer;
+  guint i;
+  gsize sum = 0;
+  gdouble insert, to_object, to_ref, remove;
+
+  table = spi_ref_table_new ();
+  timer = g_timer_new ();
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    refs[i] = spi_ref_table_insert (table, objects[i]);
+  insert = ns_per_op (timer, n);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    sum += GPOINTER_TO_SIZE (spi_ref_table_lookup_object (table, refs[order[i]]));
+  to_object = ns_per_op (timer, n);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    sum += spi_ref_table_lookup_ref (table, objects[order[i]]);
+  to_ref = ns_per_op (timer, n);
+
+  g_timer_start (timer);
+  for (i = 0; i < n; i++)
+    spi_ref_table_remove (table, objects[order[i]]);
+  remove = ns_per_op (timer, n);
+
+  printf ("%-10s %8u %10.1f %10.1f %10.1f %10.1f (%lu)\n",
+          "SpiRefTable", n, insert, to_object, to_ref, remove, (gulong) (sum & 1));
+
+  g_timer_destroy (timer);
+  spi_ref_table_free (table);
+}
+
+int
+main (int argc, char **argv)
+{
+  guint n;
+
+  g_type_init ();
+
+  printf ("%-10s %8s %10s %10s %10s %10s\n",
+          "", "objects", "insert", "ref->obj", "obj->ref", "remove");
+
+  for (n = 10000; n <= 1000000; n *= 10)
+    {
+      make_objects (n);
+      bench_hash_table (n);
+      bench_ref_table (n);
+      free_objects (n);
+    }
+
+  return 0;
+}
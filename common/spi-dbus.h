@@ -37,12 +37,22 @@ extern int _dbg;
 
 #define SPI_DBUS_PATH_NULL "/org/a11y/atspi/null"
 #define SPI_DBUS_PATH_ROOT "/org/a11y/atspi/accessible/root"
+#define SPI_DBUS_PATH_ACCESSIBLE_PREFIX "/org/a11y/atspi/accessible/"
+
+/*
+ * References in the compact cache encoding, Cache.GetItemsCompact,
+ * are appended to the path prefix except for these reserved values.
+ */
+#define SPI_CACHE_COMPACT_REF_NULL    0
+#define SPI_CACHE_COMPACT_REF_DESKTOP 0xfffffffe
+#define SPI_CACHE_COMPACT_REF_ROOT    0xffffffff
 
 #define SPI_DBUS_PATH_DEC "/org/a11y/atspi/registry/deviceeventcontroller"
 #define SPI_DBUS_INTERFACE_DEC "org.a11y.atspi.DeviceEventController"
 #define SPI_DBUS_INTERFACE_DEVICE_EVENT_LISTENER "org.a11y.atspi.DeviceEventListener"
 
 #define SPI_DBUS_INTERFACE_CACHE "org.a11y.atspi.Cache"
+#define SPI_DBUS_INTERFACE_STATS "org.a11y.atspi.Stats"
 #define SPI_DBUS_INTERFACE_ACCESSIBLE "org.a11y.atspi.Accessible"
 #define SPI_DBUS_INTERFACE_ACTION "org.a11y.atspi.Action"
 #define SPI_DBUS_INTERFACE_APPLICATION "org.a11y.atspi.Application"
@@ -339,6 +339,37 @@ cspi_internal_event_get_text (const InternalEvent *e)
   return NULL;
 }
 
+/*
+ * Reads the text of a change too long to be sent with its event, which
+ * carries the source's text change serial instead. Inserted text is read
+ * back while the serial still matches, checked by the application in the
+ * same call; deleted text is gone.
+ */
+static char *
+cspi_internal_event_fetch_text (const InternalEvent *e)
+{
+  dbus_uint32_t serial;
+  dbus_int32_t start, end;
+  dbus_bool_t current = FALSE;
+  char *text = NULL;
+
+  g_return_val_if_fail (e, NULL);
+  if (!e->event.source || !strstr (e->event.type, ":insert"))
+    return NULL;
+  serial = e->event.v.token;
+  start = e->event.detail1;
+  end = e->event.detail1 + e->event.detail2;
+  if (!cspi_dbus_call (e->event.source, spi_interface_text, "GetTextAtSerial",
+                       NULL, "uii=>bs", serial, start, end, &current, &text))
+    return NULL;
+  if (!current)
+  {
+    g_free (text);
+    return NULL;
+  }
+  return text;
+}
+
 static Accessible *
 cspi_internal_event_get_object (const InternalEvent *e)
 {
@@ -480,14 +511,21 @@ SPIBoolean   AccessibleEvent_getSourceDetails (const AccessibleEvent *e,
  * Queries an #AccessibleEvent of type "object:text-changed", 
  *         returning the text inserted or deleted.
  *
+ * Text longer than the application's limit is not sent with the event.
+ * Inserted text is then read from the source if it has not changed since,
+ * and deleted text is not available.
+ *
  * Returns: a UTF-8 text string indicating the text inserted,
- *          deleted, or substituted by this event.
+ *          deleted, or substituted by this event, or NULL if the text
+ *          is no longer available.
  **/
 char *
 AccessibleTextChangedEvent_getChangeString (const AccessibleEvent *e)
 {
   const InternalEvent *foo = (InternalEvent *) e;
   /* TODO: check the event type. */
+  if (e->v_type == EVENT_DATA_TOKEN)
+    return cspi_internal_event_fetch_text (foo);
   return cspi_internal_event_get_text (foo);
 }
 
@@ -851,6 +889,7 @@ AccessibleEvent_unref (const AccessibleEvent *e)
 typedef struct
 {
   CSpiEventListener *listener;
+  char *event_type;
   char *category;
   char *name;
   char *detail;
@@ -930,14 +969,63 @@ oom:
   return FALSE;
 }
 
+/*
+ * The bridge only sends PropertiesChanged along with property-change
+ * events, and only while someone listens for them, so property values are
+ * cached only while we listen for every property-change event. The epoch
+ * moves on each time we start, so that values kept before are not trusted.
+ */
+static int property_listeners = 0;
+static guint property_epoch = 0;
+
+static void
+property_listeners_add (const char *category, const char *name, const char *detail, int n)
+{
+  if (strcmp (category, "object") || strcmp (name, "property_change") || detail)
+    return;
+  if (property_listeners == 0 && n > 0)
+    property_epoch++;
+  property_listeners += n;
+}
+
+/* Returns 0 while property values must not be cached */
+guint
+cspi_property_cache_epoch (void)
+{
+  return property_listeners ? property_epoch : 0;
+}
+
 static void listener_data_free (CSpiEventListenerEntry *e)
 {
+  g_free (e->event_type);
   g_free (e->category);
   g_free (e->name);
   if (e->detail) g_free (e->detail);
   g_free (e);
 }
 
+/*
+ * Tells the registry which events we listen for, so that applications
+ * need not send events nobody wants. No reply is awaited, as a registry
+ * that does not track listeners will not give one.
+ */
+static void
+notify_registry (const char *method, const char *eventType)
+{
+  DBusMessage *message;
+
+  message = dbus_message_new_method_call (spi_bus_registry,
+                                          SPI_DBUS_PATH_REGISTRY,
+                                          SPI_DBUS_INTERFACE_REGISTRY,
+                                          method);
+  if (!message)
+    return;
+  dbus_message_append_args (message, DBUS_TYPE_STRING, &eventType, DBUS_TYPE_INVALID);
+  dbus_message_set_no_reply (message, TRUE);
+  dbus_connection_send (SPI_bus (), message, NULL);
+  dbus_message_unref (message);
+}
+
 /**
  * SPI_registerGlobalEventListener:
  * @listener: the #AccessibleEventListener to be registered against an
@@ -1049,6 +1137,7 @@ SPI_registerGlobalEventListener (AccessibleEventListener *listener,
     g_free (e);
     return FALSE;
   }
+  e->event_type = g_strdup (eventType);
   new_list = g_list_prepend (event_listeners, e);
   if (!new_list)
   {
@@ -1056,12 +1145,14 @@ SPI_registerGlobalEventListener (AccessibleEventListener *listener,
     return FALSE;
   }
   event_listeners = new_list;
+  property_listeners_add (e->category, e->name, e->detail, 1);
   dbus_error_init (&error);
   dbus_bus_add_match (SPI_bus(), matchrule, &error);
   if (error.message)
   {
     g_warning ("Adding match: %s", error.message);
   }
+  notify_registry ("RegisterEvent", eventType);
   return TRUE;
 }
 
@@ -1092,6 +1183,8 @@ SPI_deregisterGlobalEventListenerAll (AccessibleEventListener *listener)
     CSpiEventListenerEntry *e = l->data;
     if (e->listener == listener)
     {
+      notify_registry ("DeregisterEvent", e->event_type);
+      property_listeners_add (e->category, e->name, e->detail, -1);
       listener_data_free (e);
       l = g_list_remove (l, e);
     }
@@ -1133,6 +1226,8 @@ SPI_deregisterGlobalEventListener (AccessibleEventListener *listener,
     if (e->listener == listener && !strcmp (e->category, category) && !strcmp (e->name, name) && (e->detail == detail || !strcmp (e->detail, detail)))
     {
       DBusError error;
+      notify_registry ("DeregisterEvent", e->event_type);
+      property_listeners_add (e->category, e->name, e->detail, -1);
       listener_data_free (e);
       l = g_list_remove (l, e);
       dbus_error_init (&error);
@@ -1229,6 +1324,8 @@ cspi_dbus_handle_event (DBusConnection *bus, DBusMessage *message, void *data)
   }
     while ((p = strchr (e.type, '_'))) *p = '-';
   e.source = cspi_ref_accessible (dbus_message_get_sender(message), dbus_message_get_path(message));
+  /* Any change to the object may have changed its properties */
+  cspi_properties_invalidate (e.source);
   dbus_message_iter_recurse (&iter, &iter_variant);
   switch (dbus_message_iter_get_arg_type (&iter_variant))
   {
@@ -1246,6 +1343,15 @@ cspi_dbus_handle_event (DBusConnection *bus, DBusMessage *message, void *data)
       e.v.text = g_strdup (p);
       break;
     }
+    case DBUS_TYPE_UINT32:
+    {
+      dbus_uint32_t token;
+
+      dbus_message_iter_get_basic (&iter_variant, &token);
+      e.v_type = EVENT_DATA_TOKEN;
+      e.v.token = token;
+      break;
+    }
     case DBUS_TYPE_STRUCT:
     {
       if (demarshal_rect (&iter_variant, &e.v.rect))
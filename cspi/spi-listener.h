@@ -36,7 +36,8 @@ typedef enum
 {
   EVENT_DATA_STRING,
   EVENT_DATA_OBJECT,
-  EVENT_DATA_RECT
+  EVENT_DATA_RECT,
+  EVENT_DATA_TOKEN
 } EVENT_DATA_TYPE;
 
 /**
@@ -62,6 +63,7 @@ typedef struct {
     char *text;
     Accessible *accessible;
     SPIRect rect;
+    unsigned int token;
   } v;
 } AccessibleEvent;
 
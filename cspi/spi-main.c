@@ -221,6 +221,8 @@ cspi_object_unref_internal (Accessible *accessible, gboolean defunct)
     }
     if (accessible->states)
       spi_state_set_cache_unref (accessible->states);
+    if (accessible->properties)
+      g_hash_table_destroy (accessible->properties);
     g_free (accessible->description);
     g_free (accessible->name);
     g_free(accessible);
@@ -255,10 +257,10 @@ static GHashTable *app_hash = NULL;
 static Accessible *
 ref_accessible (CSpiApplication *app, const char *path)
 {
-  int id;
+  guint id;
   guint *id_val;
 
-  if (sscanf (path, "/org/a11y/atspi/accessible/%d", &id) != 1)
+  if (sscanf (path, "/org/a11y/atspi/accessible/%u", &id) != 1)
   {
     return NULL;
   }
@@ -334,6 +336,17 @@ handle_addition (CSpiApplication*app, CACHE_ADDITION *ca)
   GList *new_list;
 
   Accessible *a = ref_accessible (app, ca->path);
+  if (!a)
+  {
+    for (i = 0; i < ca->interfaces->len; i++)
+      g_free (g_array_index (ca->interfaces, char *, i));
+    g_array_free (ca->interfaces, TRUE);
+    g_array_free (ca->children, TRUE);
+    g_array_free (ca->state_bitflags, TRUE);
+    g_free (ca->name);
+    g_free (ca->description);
+    return;
+  }
   /* Note: children don't hold refs for their parents or vice versa */
   a->parent = ref_accessible (app, ca->parent);
   if (a->parent) cspi_object_unref (a->parent);
@@ -394,6 +407,287 @@ handle_additions (CSpiApplication*app, GArray *additions)
   }
 }
 
+/*
+ * Decoding of the compact cache encoding returned by
+ * Cache.GetItemsCompact.
+ */
+static const char *compactSignature = "ssasa(uuauuuuuau)a((so)(so)(so)a(so)assusau)as";
+
+typedef struct
+{
+  dbus_uint32_t ref;
+  dbus_uint32_t parent;
+  GArray *children;
+  dbus_uint32_t interfaces;
+  dbus_uint32_t name;
+  dbus_uint32_t role;
+  dbus_uint32_t description;
+  GArray *state_bitflags;
+} COMPACT_ITEM;
+
+static char *
+compact_path (const char *prefix, dbus_uint32_t ref)
+{
+  switch (ref)
+  {
+    case SPI_CACHE_COMPACT_REF_NULL:
+      return g_strdup (SPI_DBUS_PATH_NULL);
+    case SPI_CACHE_COMPACT_REF_DESKTOP:
+      return g_strdup (spi_path_registry);
+    case SPI_CACHE_COMPACT_REF_ROOT:
+      return g_strdup (SPI_DBUS_PATH_ROOT);
+    default:
+      return g_strdup_printf ("%s%u", prefix, ref);
+  }
+}
+
+static dbus_uint32_t
+read_uint (DBusMessageIter *iter)
+{
+  dbus_uint32_t v;
+
+  dbus_message_iter_get_basic (iter, &v);
+  dbus_message_iter_next (iter);
+  return v;
+}
+
+static char *
+read_string (DBusMessageIter *iter)
+{
+  const char *str;
+
+  dbus_message_iter_get_basic (iter, &str);
+  dbus_message_iter_next (iter);
+  return g_strdup (str);
+}
+
+static GArray *
+read_uint_array (DBusMessageIter *iter)
+{
+  DBusMessageIter iter_array;
+  GArray *array = g_array_new (FALSE, FALSE, sizeof (dbus_uint32_t));
+
+  dbus_message_iter_recurse (iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_UINT32)
+  {
+    dbus_uint32_t v = read_uint (&iter_array);
+    g_array_append_val (array, v);
+  }
+  dbus_message_iter_next (iter);
+  return array;
+}
+
+/* Returns the path of an (so) reference */
+static char *
+read_reference_path (DBusMessageIter *iter)
+{
+  DBusMessageIter iter_struct;
+  char *path;
+
+  dbus_message_iter_recurse (iter, &iter_struct);
+  dbus_message_iter_next (&iter_struct);
+  path = read_string (&iter_struct);
+  dbus_message_iter_next (iter);
+  return path;
+}
+
+/* Reads an item in the GetItems format, as sent for plugs and sockets */
+static void
+read_full_item (DBusMessageIter *iter, CACHE_ADDITION *ca)
+{
+  DBusMessageIter iter_struct, iter_array;
+
+  dbus_message_iter_recurse (iter, &iter_struct);
+  ca->path = read_reference_path (&iter_struct);
+  g_free (read_reference_path (&iter_struct));	/* application */
+  ca->parent = read_reference_path (&iter_struct);
+
+  ca->children = g_array_new (FALSE, FALSE, sizeof (char *));
+  dbus_message_iter_recurse (&iter_struct, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRUCT)
+  {
+    char *child = read_reference_path (&iter_array);
+    g_array_append_val (ca->children, child);
+  }
+  dbus_message_iter_next (&iter_struct);
+
+  ca->interfaces = g_array_new (FALSE, FALSE, sizeof (char *));
+  dbus_message_iter_recurse (&iter_struct, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRING)
+  {
+    char *iface = read_string (&iter_array);
+    g_array_append_val (ca->interfaces, iface);
+  }
+  dbus_message_iter_next (&iter_struct);
+
+  ca->name = read_string (&iter_struct);
+  ca->role = read_uint (&iter_struct);
+  ca->description = read_string (&iter_struct);
+  ca->state_bitflags = read_uint_array (&iter_struct);
+  dbus_message_iter_next (iter);
+}
+
+/*
+ * Hands a decoded item to handle_addition and frees the paths, which
+ * it does not take ownership of.
+ */
+static void
+add_decoded_item (CSpiApplication *app, CACHE_ADDITION *ca)
+{
+  GPtrArray *paths = g_ptr_array_new ();
+  gint i;
+
+  g_ptr_array_add (paths, ca->path);
+  g_ptr_array_add (paths, ca->parent);
+  for (i = 0; i < ca->children->len; i++)
+    g_ptr_array_add (paths, g_array_index (ca->children, char *, i));
+
+  handle_addition (app, ca);
+
+  for (i = 0; i < paths->len; i++)
+    g_free (g_ptr_array_index (paths, i));
+  g_ptr_array_free (paths, TRUE);
+}
+
+static gboolean
+handle_compact_items (CSpiApplication *app, DBusMessage *reply)
+{
+  DBusMessageIter iter, iter_array;
+  char *prefix;
+  GPtrArray *iface_names, *strings;
+  GArray *items;
+  gint i, j;
+
+  if (strcmp (dbus_message_get_signature (reply), compactSignature) != 0)
+  {
+    g_warning ("GetItemsCompact: unexpected signature %s", dbus_message_get_signature (reply));
+    return FALSE;
+  }
+
+  dbus_message_iter_init (reply, &iter);
+  dbus_message_iter_next (&iter);	/* bus name, known from the sender */
+  prefix = read_string (&iter);
+
+  iface_names = g_ptr_array_new ();
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRING)
+    g_ptr_array_add (iface_names, read_string (&iter_array));
+  dbus_message_iter_next (&iter);
+
+  /* The string table comes last, so items are decoded before being added */
+  items = g_array_new (FALSE, FALSE, sizeof (COMPACT_ITEM));
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRUCT)
+  {
+    DBusMessageIter iter_struct;
+    COMPACT_ITEM item;
+
+    dbus_message_iter_recurse (&iter_array, &iter_struct);
+    item.ref = read_uint (&iter_struct);
+    item.parent = read_uint (&iter_struct);
+    item.children = read_uint_array (&iter_struct);
+    item.interfaces = read_uint (&iter_struct);
+    item.name = read_uint (&iter_struct);
+    item.role = read_uint (&iter_struct);
+    item.description = read_uint (&iter_struct);
+    item.state_bitflags = read_uint_array (&iter_struct);
+    g_array_append_val (items, item);
+    dbus_message_iter_next (&iter_array);
+  }
+  dbus_message_iter_next (&iter);
+
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRUCT)
+  {
+    CACHE_ADDITION ca;
+
+    read_full_item (&iter_array, &ca);
+    add_decoded_item (app, &ca);
+  }
+  dbus_message_iter_next (&iter);
+
+  strings = g_ptr_array_new ();
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (dbus_message_iter_get_arg_type (&iter_array) == DBUS_TYPE_STRING)
+    g_ptr_array_add (strings, read_string (&iter_array));
+
+  for (i = 0; i < items->len; i++)
+  {
+    COMPACT_ITEM *item = &g_array_index (items, COMPACT_ITEM, i);
+    CACHE_ADDITION ca;
+
+    ca.path = compact_path (prefix, item->ref);
+    ca.parent = compact_path (prefix, item->parent);
+    ca.children = g_array_new (FALSE, FALSE, sizeof (char *));
+    for (j = 0; j < item->children->len; j++)
+    {
+      char *child = compact_path (prefix, g_array_index (item->children, dbus_uint32_t, j));
+      g_array_append_val (ca.children, child);
+    }
+    g_array_free (item->children, TRUE);
+
+    ca.interfaces = g_array_new (FALSE, FALSE, sizeof (char *));
+    for (j = 0; j < iface_names->len && j < 32; j++)
+    {
+      if (item->interfaces & (1 << j))
+      {
+        char *iface = g_strdup (g_ptr_array_index (iface_names, j));
+        g_array_append_val (ca.interfaces, iface);
+      }
+    }
+
+    ca.name = g_strdup (item->name < strings->len ? g_ptr_array_index (strings, item->name) : "");
+    ca.role = item->role;
+    ca.description = g_strdup (item->description < strings->len ? g_ptr_array_index (strings, item->description) : "");
+    ca.state_bitflags = item->state_bitflags;
+    add_decoded_item (app, &ca);
+  }
+
+  g_array_free (items, TRUE);
+  for (i = 0; i < strings->len; i++)
+    g_free (g_ptr_array_index (strings, i));
+  g_ptr_array_free (strings, TRUE);
+  for (i = 0; i < iface_names->len; i++)
+    g_free (g_ptr_array_index (iface_names, i));
+  g_ptr_array_free (iface_names, TRUE);
+  g_free (prefix);
+  return TRUE;
+}
+
+/*
+ * Milliseconds to wait for an application's compact cache before
+ * falling back to getTree.
+ */
+#define SPI_COMPACT_TIMEOUT 10000
+
+/*
+ * Fetches the cache of an application in the compact encoding.
+ * Returns FALSE if the application does not support it or does not
+ * answer in time.
+ */
+static gboolean
+get_items_compact (CSpiApplication *app, const char *bus_name)
+{
+  DBusMessage *message, *reply;
+  DBusError error;
+  gboolean ret;
+
+  message = dbus_message_new_method_call (bus_name, "/org/a11y/atspi/cache", SPI_DBUS_INTERFACE_CACHE, "GetItemsCompact");
+  if (!message)
+    return FALSE;
+  dbus_error_init (&error);
+  reply = dbind_send_and_allow_reentry (bus, message, SPI_COMPACT_TIMEOUT, &error);
+  dbus_message_unref (message);
+  if (!reply)
+  {
+    dbus_error_free (&error);
+    return FALSE;
+  }
+  ret = handle_compact_items (app, reply);
+  dbus_message_unref (reply);
+  return ret;
+}
+
 static DBusHandlerResult
 cspi_dbus_handle_remove_accessible (DBusConnection *bus, DBusMessage *message, void *user_data)
 {
@@ -531,14 +825,17 @@ ref_accessible_desktop (CSpiApplication *app)
       continue;
     }
     CSpiApplication *app = cspi_get_application (app_name);
-    additions = NULL;
-    dbus_error_init (&error);
-    dbind_method_call_reentrant (bus, app_name, "/org/a11y/atspi/tree", spi_interface_tree, "getTree", &error, "=>a(ooaoassusau)", &additions);
-    if (error.message)
+    if (!get_items_compact (app, app_name))
     {
-      g_warning ("getTree (%s): %s", app_name, error.message);
+      additions = NULL;
+      dbus_error_init (&error);
+      dbind_method_call_reentrant (bus, app_name, "/org/a11y/atspi/tree", spi_interface_tree, "getTree", &error, "=>a(ooaoassusau)", &additions);
+      if (error.message)
+      {
+        g_warning ("getTree (%s): %s", app_name, error.message);
+      }
+      handle_additions (app, additions);
     }
-    handle_additions (app, additions);
     add_app_to_desktop (desktop, app_name);
   }
   g_array_free (apps, TRUE);
@@ -627,6 +924,236 @@ cspi_dbus_handle_deregister_application (DBusConnection *bus, DBusMessage *messa
 }
 
 
+/*
+ * Property values read from an application are kept on the object,
+ * keyed by interface and property name, and served from there until the
+ * application sends PropertiesChanged for them or any event from the
+ * object. Names are compared without case, as older clients ask for
+ * "characterCount" where the bridge announces "CharacterCount".
+ *
+ * Only properties the bridge announces changes to are kept, and only
+ * while the announcements reach us, see cspi_property_cache_epoch.
+ */
+typedef struct
+{
+  int type;
+  guint epoch;
+  union
+  {
+    dbus_int16_t n;
+    dbus_int32_t i;
+    dbus_uint32_t u;
+    double d;
+    char *s;
+  } v;
+} CachedProperty;
+
+static const char *announced_properties[] =
+{
+  SPI_DBUS_INTERFACE_ACCESSIBLE ".name",
+  SPI_DBUS_INTERFACE_ACCESSIBLE ".description",
+  SPI_DBUS_INTERFACE_ACCESSIBLE ".parent",
+  SPI_DBUS_INTERFACE_VALUE ".currentvalue",
+  SPI_DBUS_INTERFACE_TABLE ".caption",
+  SPI_DBUS_INTERFACE_TABLE ".summary",
+  NULL
+};
+
+static void
+cached_property_free (gpointer data)
+{
+  CachedProperty *prop = data;
+
+  if (prop->type == DBUS_TYPE_STRING || prop->type == DBUS_TYPE_OBJECT_PATH)
+    g_free (prop->v.s);
+  g_free (prop);
+}
+
+static char *
+property_key (const char *interface, const char *name)
+{
+  char *lower = g_ascii_strdown (name, -1);
+  char *key = g_strconcat (interface, ".", lower, NULL);
+
+  g_free (lower);
+  return key;
+}
+
+/* Keeps the value in a variant, or forgets the property if it is not basic */
+static void
+property_cache_store (Accessible *obj, const char *interface, const char *name, DBusMessageIter *iter_variant)
+{
+  int type = dbus_message_iter_get_arg_type (iter_variant);
+  guint epoch = cspi_property_cache_epoch ();
+  CachedProperty *prop;
+
+  if (!epoch)
+    return;
+  if (!obj->properties)
+    obj->properties = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, cached_property_free);
+
+  if (type != DBUS_TYPE_STRING && type != DBUS_TYPE_OBJECT_PATH &&
+      type != DBUS_TYPE_INT16 && type != DBUS_TYPE_INT32 &&
+      type != DBUS_TYPE_UINT32 && type != DBUS_TYPE_DOUBLE)
+  {
+    char *key = property_key (interface, name);
+    g_hash_table_remove (obj->properties, key);
+    g_free (key);
+    return;
+  }
+
+  prop = g_new0 (CachedProperty, 1);
+  prop->type = type;
+  prop->epoch = epoch;
+  dbus_message_iter_get_basic (iter_variant, &prop->v);
+  if (type == DBUS_TYPE_STRING || type == DBUS_TYPE_OBJECT_PATH)
+    prop->v.s = g_strdup (prop->v.s);
+  g_hash_table_replace (obj->properties, property_key (interface, name), prop);
+}
+
+static gboolean
+property_is_announced (const char *interface, const char *name)
+{
+  char *key = property_key (interface, name);
+  gboolean announced = FALSE;
+  int i;
+
+  for (i = 0; announced_properties[i]; i++)
+    if (!strcmp (announced_properties[i], key))
+      announced = TRUE;
+  g_free (key);
+  return announced;
+}
+
+static dbus_bool_t
+property_cache_lookup (Accessible *obj, const char *interface, const char *name, const char *type, void *data)
+{
+  CachedProperty *prop;
+  char *key;
+
+  if (!obj->properties)
+    return FALSE;
+  key = property_key (interface, name);
+  prop = g_hash_table_lookup (obj->properties, key);
+  g_free (key);
+  if (!prop || prop->type != type[0] ||
+      prop->epoch != cspi_property_cache_epoch ())
+    return FALSE;
+
+  switch (prop->type)
+  {
+    case DBUS_TYPE_STRING:
+    case DBUS_TYPE_OBJECT_PATH:
+      *(char **)data = g_strdup (prop->v.s);
+      break;
+    case DBUS_TYPE_INT16:
+      *(dbus_int16_t *)data = prop->v.n;
+      break;
+    case DBUS_TYPE_INT32:
+      *(dbus_int32_t *)data = prop->v.i;
+      break;
+    case DBUS_TYPE_UINT32:
+      *(dbus_uint32_t *)data = prop->v.u;
+      break;
+    case DBUS_TYPE_DOUBLE:
+      *(double *)data = prop->v.d;
+      break;
+  }
+  return TRUE;
+}
+
+void
+cspi_properties_invalidate (Accessible *accessible)
+{
+  if (accessible && accessible->properties)
+    g_hash_table_remove_all (accessible->properties);
+}
+
+/* Finds an object we already know of, without creating it */
+static Accessible *
+lookup_accessible (const char *bus_name, const char *path)
+{
+  CSpiApplication *app;
+  guint id;
+
+  if (!app_hash || !bus_name || !path)
+    return NULL;
+  app = g_hash_table_lookup (app_hash, bus_name);
+  if (!app)
+    return NULL;
+  if (APP_IS_REGISTRY (app))
+    return g_hash_table_lookup (app->hash, path);
+  if (sscanf (path, "/org/a11y/atspi/accessible/%u", &id) != 1)
+    return NULL;
+  return g_hash_table_lookup (app->hash, &id);
+}
+
+static void
+update_accessible_string (char **field, DBusMessageIter *iter_variant)
+{
+  const char *str;
+
+  if (dbus_message_iter_get_arg_type (iter_variant) != DBUS_TYPE_STRING)
+    return;
+  dbus_message_iter_get_basic (iter_variant, &str);
+  g_free (*field);
+  *field = g_strdup (str);
+}
+
+static DBusHandlerResult
+cspi_dbus_handle_properties_changed (DBusConnection *bus, DBusMessage *message, void *user_data)
+{
+  DBusMessageIter iter, iter_dict, iter_dict_entry, iter_variant, iter_array;
+  const char *interface, *name;
+  Accessible *a;
+
+  if (strcmp (dbus_message_get_signature (message), "sa{sv}as") != 0)
+  {
+    g_warning ("Received PropertiesChanged with invalid arguments");
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+  }
+
+  a = lookup_accessible (dbus_message_get_sender (message), dbus_message_get_path (message));
+  if (!a)
+    return DBUS_HANDLER_RESULT_HANDLED;
+
+  dbus_message_iter_init (message, &iter);
+  dbus_message_iter_get_basic (&iter, &interface);
+  dbus_message_iter_next (&iter);
+
+  dbus_message_iter_recurse (&iter, &iter_dict);
+  while (dbus_message_iter_get_arg_type (&iter_dict) != DBUS_TYPE_INVALID)
+  {
+    dbus_message_iter_recurse (&iter_dict, &iter_dict_entry);
+    dbus_message_iter_get_basic (&iter_dict_entry, &name);
+    dbus_message_iter_next (&iter_dict_entry);
+    dbus_message_iter_recurse (&iter_dict_entry, &iter_variant);
+    property_cache_store (a, interface, name, &iter_variant);
+    if (!strcmp (interface, spi_interface_accessible))
+    {
+      if (!strcmp (name, "Name"))
+        update_accessible_string (&a->name, &iter_variant);
+      else if (!strcmp (name, "Description"))
+        update_accessible_string (&a->description, &iter_variant);
+    }
+    dbus_message_iter_next (&iter_dict);
+  }
+  dbus_message_iter_next (&iter);
+
+  dbus_message_iter_recurse (&iter, &iter_array);
+  while (a->properties && dbus_message_iter_get_arg_type (&iter_array) != DBUS_TYPE_INVALID)
+  {
+    char *key;
+
+    dbus_message_iter_get_basic (&iter_array, &name);
+    key = property_key (interface, name);
+    g_hash_table_remove (a->properties, key);
+    g_free (key);
+    dbus_message_iter_next (&iter_array);
+  }
+  return DBUS_HANDLER_RESULT_HANDLED;
+}
+
 static DBusHandlerResult
 cspi_dbus_filter (DBusConnection *bus, DBusMessage *message, void *data)
 {
@@ -645,6 +1172,10 @@ cspi_dbus_filter (DBusConnection *bus, DBusMessage *message, void *data)
   {
     return cspi_dbus_handle_deviceEvent (bus, message, data);
   }
+  if (dbus_message_is_signal (message, DBUS_INTERFACE_PROPERTIES, "PropertiesChanged"))
+  {
+    return cspi_dbus_handle_properties_changed (bus, message, data);
+  }
   if (dbus_message_is_signal (message, spi_interface_tree, "updateAccessible"))
   {
     return cspi_dbus_handle_update_accessible (bus, message, data);
@@ -719,6 +1250,9 @@ SPI_init (void)
   dbus_error_init (&error);
   dbus_bus_add_match (bus, match, &error);
   g_free (match);
+  match = g_strdup_printf ("type='signal',interface='%s',member='PropertiesChanged'", DBUS_INTERFACE_PROPERTIES);
+  dbus_bus_add_match (bus, match, &error);
+  g_free (match);
   match = g_strdup_printf ("type='method_call',interface='%s'", spi_interface_registry);
   dbus_bus_add_match (bus, match, &error);
   g_free (match);
@@ -1037,7 +1571,7 @@ get_path (Accessible *obj)
   {
     return g_strdup_printf (SPI_DBUS_PATH_REGISTRY);
   }
-  return g_strdup_printf ("/org/a11y/atspi/accessible/%d", obj->v.id);
+  return g_strdup_printf ("/org/a11y/atspi/accessible/%u", obj->v.id);
 }
 
 dbus_bool_t
@@ -1075,6 +1609,12 @@ cspi_dbus_get_property (Accessible *obj, const char *interface, const char *name
   DBusError err;
   dbus_bool_t retval = FALSE;
 
+  if (property_cache_lookup (obj, interface, name, type, data))
+  {
+    g_free (path);
+    return TRUE;
+  }
+
   message = dbus_message_new_method_call (obj->app->bus_name, path, "org.freedesktop.DBus.Properties", "Get");
   if (!message)
   {
@@ -1098,9 +1638,11 @@ cspi_dbus_get_property (Accessible *obj, const char *interface, const char *name
     g_warning ("cspi_dbus_get_property: Wrong type: expected %s, got %c\n", type, dbus_message_iter_get_arg_type (&iter_variant));
     goto done;
   }
+  if (property_is_announced (interface, name))
+    property_cache_store (obj, interface, name, &iter_variant);
   dbus_message_iter_get_basic (&iter_variant, data);
+  if (type[0] == 's' || type[0] == 'o') *(char **)data = g_strdup (*(char **)data);
   dbus_message_unref (reply);
-  if (type[0] == 's') *(char **)data = g_strdup (*(char **)data);
   retval = TRUE;
 done:
   g_free (path);
@@ -50,7 +50,7 @@ struct _Accessible {
 	CSpiApplication *app;
 	union
 	{
-	  gint id;
+	  guint id;
 	  char *path;
 	} v;
   gint role : 8;
@@ -58,6 +58,7 @@ struct _Accessible {
   char *name;
   char *description;
   AtkStateSet *states;
+  GHashTable *properties;
 };
 
 #define SPI_INTERNAL_EVENT_MAGIC 0xc3
@@ -90,6 +91,8 @@ SPIBoolean             cspi_accessible_is_a   (Accessible  *accessible,
 AccessibleRole         cspi_role_from_spi_role (Accessibility_Role role);
 void                   cspi_streams_close_all (void);
 gboolean               cspi_exception_throw (DBusError *error, const char *desc_prefix);
+void                   cspi_properties_invalidate (Accessible *accessible);
+guint                  cspi_property_cache_epoch (void);
 
 AccessibleAttributeSet 
                      *_cspi_attribute_set_from_sequence (const GArray *seq);
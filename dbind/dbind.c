@@ -22,20 +22,90 @@ set_reply (DBusPendingCall *pending, void *user_data)
     *replyptr = dbus_pending_call_steal_reply (pending);
 }
 
+/*
+ * Pending call timeouts only fire from a main loop, so a finite timeout
+ * is kept here by dispatching for no longer than the time left.
+ */
 static DBusMessage *
-send_and_allow_reentry (DBusConnection *bus, DBusMessage *message, DBusError *error)
+send_and_allow_reentry (DBusConnection *bus, DBusMessage *message, int timeout, DBusError *error)
 {
     DBusPendingCall *pending;
     DBusMessage *reply = NULL;
+    gint64 deadline = 0;
+    int wait = -1;
 
-    if (!dbus_connection_send_with_reply (bus, message, &pending, -1))
+    if (!dbus_connection_send_with_reply (bus, message, &pending, timeout) ||
+        !pending)
     {
         return NULL;
     }
     dbus_pending_call_set_notify (pending, set_reply, (void *)&reply, NULL);
+    if (timeout >= 0)
+        deadline = g_get_monotonic_time () + (gint64) timeout * 1000;
     while (!reply)
     {
-      if (!dbus_connection_read_write_dispatch (bus, -1)) return NULL;
+      if (timeout >= 0)
+      {
+        gint64 left = deadline - g_get_monotonic_time ();
+
+        if (left <= 0)
+        {
+          dbus_set_error_const (error, DBUS_ERROR_NO_REPLY,
+                                "Did not receive a reply in time");
+          break;
+        }
+        wait = (left + 999) / 1000;
+      }
+      if (!dbus_connection_read_write_dispatch (bus, wait))
+        break;
+    }
+    if (!reply)
+    {
+      /* The notify must not write to reply once we have returned */
+      dbus_pending_call_cancel (pending);
+    }
+    dbus_pending_call_unref (pending);
+    return reply;
+}
+
+/**
+ * dbind_send_and_allow_reentry:
+ *
+ * @cnx:       A D-Bus Connection used to send the message.
+ * @message:   The method call to send.
+ * @timeout:   Milliseconds to wait for the reply, or -1 to wait for as
+ *             long as it takes.
+ * @opt_error: D-Bus error.
+ *
+ * Sends a method call and returns its reply, dispatching other messages
+ * while it waits, as dbind_method_call_reentrant does. For replies that
+ * are read directly rather than demarshalled by type.
+ *
+ * Returns the method return, or NULL with opt_error set if the call
+ * failed, was answered with an error or timed out.
+ **/
+DBusMessage *
+dbind_send_and_allow_reentry (DBusConnection *cnx,
+                              DBusMessage    *message,
+                              int             timeout,
+                              DBusError      *opt_error)
+{
+    DBusMessage *reply;
+
+    reply = send_and_allow_reentry (cnx, message, timeout, opt_error);
+    if (!reply)
+    {
+        if (opt_error && !dbus_error_is_set (opt_error))
+            dbus_set_error_const (opt_error, DBUS_ERROR_FAILED,
+                                  "No reply could be read");
+        return NULL;
+    }
+    if (dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR)
+    {
+        if (opt_error)
+            dbus_set_error_from_message (opt_error, reply);
+        dbus_message_unref (reply);
+        return NULL;
     }
     return reply;
 }
@@ -71,7 +141,7 @@ dbind_method_call_reentrant_va (DBusConnection *cnx,
     dbus_message_iter_init_append (msg, &iter);
     dbind_any_marshal_va (&iter, &p, args);
 
-    reply = send_and_allow_reentry (cnx, msg, err);
+    reply = send_and_allow_reentry (cnx, msg, -1, err);
     if (!reply)
         goto out;
 
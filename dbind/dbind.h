@@ -25,6 +25,12 @@ dbind_method_call_reentrant (DBusConnection *cnx,
                              const char     *arg_types,
                              ...);
 
+DBusMessage *
+dbind_send_and_allow_reentry (DBusConnection *cnx,
+                              DBusMessage    *message,
+                              int             timeout,
+                              DBusError      *opt_error);
+
 dbus_bool_t
 dbind_emit_signal_va (DBusConnection *cnx,
                       const char     *path,
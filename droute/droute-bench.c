@@ -0,0 +1,393 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/*
+ * Measures how long droute takes to find the handler for an incoming
+ * method call, and how much memory a path's tables take, against the
+ * string pair tables it used to dispatch with.
+ *
+ * Usage: droute-bench [iterations]
+ *
+ * The calls are spread over the bridge's busiest interfaces and include
+ * property reads. Names are copied so that, as with names read from a
+ * message, no lookup can succeed by comparing pointers.
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* The dispatch functions are private to droute.c */
+#include "droute.c"
+#include "droute-pairhash.h"
+
+#define BENCH_DEFAULT_ITERATIONS 10000000
+#define BENCH_PATHS              1000
+
+typedef struct _BenchInterface
+{
+    const char *name;
+    const char *methods[16];
+    const char *properties[8];
+} BenchInterface;
+
+static const BenchInterface bench_interfaces[] =
+{
+    {"org.a11y.atspi.Accessible",
+      {"GetChildAtIndex", "GetChildren", "GetIndexInParent",
+       "GetRelationSet", "GetRole", "GetRoleName", "GetLocalizedRoleName",
+       "GetState", "GetAttributes", "GetApplication", NULL},
+      {"Name", "Description", "Parent", "ChildCount", NULL}},
+    {"org.a11y.atspi.Component",
+      {"Contains", "GetAccessibleAtPoint", "GetExtents", "GetPosition",
+       "GetSize", "GetLayer", "GetMDIZOrder", "GrabFocus", "GetAlpha", NULL},
+      {NULL}},
+    {"org.a11y.atspi.Text",
+      {"GetText", "SetCaretOffset", "GetTextBeforeOffset",
+       "GetTextAtOffset", "GetTextAfterOffset", "GetCharacterAtOffset",
+       "GetAttributeValue", "GetAttributes", "GetDefaultAttributes",
+       "GetCharacterExtents", "GetOffsetAtPoint", "GetNSelections",
+       "GetSelection", "GetRangeExtents", NULL},
+      {"CharacterCount", "CaretOffset", NULL}},
+    {"org.a11y.atspi.Action",
+      {"GetDescription", "GetName", "GetKeyBinding", "GetActions",
+       "DoAction", NULL},
+      {"NActions", NULL}},
+    {"org.a11y.atspi.Cache",
+      {"GetItems", NULL},
+      {NULL}},
+    {DBUS_INTERFACE_PROPERTIES,
+      {"Get", "GetAll", NULL},
+      {NULL}}
+};
+
+/* The method and property tables, static as the adaptors' are */
+static DRouteMethod *bench_methods[G_N_ELEMENTS (bench_interfaces)];
+static DRouteProperty *bench_properties[G_N_ELEMENTS (bench_interfaces)];
+
+/* How droute kept a path's members before */
+typedef struct _PairPath
+{
+    GStringChunk *chunks;
+    GHashTable   *methods;
+    GHashTable   *properties;
+} PairPath;
+
+typedef struct PropertyPair
+{
+    DRoutePropertyFunction get;
+    DRoutePropertyFunction set;
+} PropertyPair;
+
+typedef struct _BenchCall
+{
+    gchar *iface;
+    gchar *member;
+} BenchCall;
+
+static volatile guint bench_sink;
+
+/*---------------------------------------------------------------------------*/
+
+static DBusMessage *
+impl_bench (DBusConnection *bus, DBusMessage *message, void *user_data)
+{
+    return NULL;
+}
+
+static dbus_bool_t
+impl_bench_property (DBusMessageIter *iter, void *user_data)
+{
+    return TRUE;
+}
+
+static void
+tables_init (void)
+{
+    gint i, j;
+
+    for (i = 0; i < G_N_ELEMENTS (bench_interfaces); i++)
+      {
+        const BenchInterface *itf = &bench_interfaces[i];
+
+        bench_methods[i] = g_new0 (DRouteMethod, G_N_ELEMENTS (itf->methods));
+        for (j = 0; itf->methods[j] != NULL; j++)
+          {
+            bench_methods[i][j].func = impl_bench;
+            bench_methods[i][j].name = itf->methods[j];
+          }
+
+        bench_properties[i] = g_new0 (DRouteProperty,
+                                      G_N_ELEMENTS (itf->properties));
+        for (j = 0; itf->properties[j] != NULL; j++)
+          {
+            bench_properties[i][j].get = impl_bench_property;
+            bench_properties[i][j].name = itf->properties[j];
+          }
+      }
+}
+
+static GPtrArray *
+calls_new (void)
+{
+    GPtrArray *calls = g_ptr_array_new ();
+    gint i, j;
+
+    for (i = 0; i < G_N_ELEMENTS (bench_interfaces); i++)
+        for (j = 0; bench_interfaces[i].methods[j] != NULL; j++)
+          {
+            BenchCall *call = g_new (BenchCall, 1);
+
+            call->iface = g_strdup (bench_interfaces[i].name);
+            call->member = g_strdup (bench_interfaces[i].methods[j]);
+            g_ptr_array_add (calls, call);
+          }
+    return calls;
+}
+
+/* The tables built by droute_path_add_interface */
+static DRoutePath *
+dispatch_path_new (void)
+{
+    DRoutePath *path;
+    gint i;
+
+    path = path_new (NULL, NULL, NULL, NULL, NULL);
+    for (i = 0; i < G_N_ELEMENTS (bench_interfaces); i++)
+      {
+        if (!strcmp (bench_interfaces[i].name, DBUS_INTERFACE_PROPERTIES))
+            continue;
+        droute_path_add_interface (path, bench_interfaces[i].name, "",
+                                   bench_methods[i], bench_properties[i]);
+      }
+
+    /* Built on the first message */
+    name_table_prepare (path->interfaces);
+    for (i = 0; i < G_N_ELEMENTS (bench_interfaces); i++)
+      {
+        DRouteInterface *itf;
+
+        itf = name_table_lookup (path->interfaces, bench_interfaces[i].name);
+        name_table_prepare (itf->methods);
+        name_table_prepare (itf->properties);
+      }
+    return path;
+}
+
+/* The string pair tables droute used before */
+static PairPath *
+pair_path_new (void)
+{
+    PairPath *path;
+    gint i, j;
+
+    path = g_new0 (PairPath, 1);
+    path->chunks = g_string_chunk_new (512);
+    path->methods = g_hash_table_new_full ((GHashFunc) str_pair_hash,
+                                           str_pair_equal, g_free, NULL);
+    path->properties = g_hash_table_new_full ((GHashFunc) str_pair_hash,
+                                              str_pair_equal, g_free, g_free);
+
+    for (i = 0; i < G_N_ELEMENTS (bench_interfaces); i++)
+      {
+        const BenchInterface *itf = &bench_interfaces[i];
+        gchar *name = g_string_chunk_insert (path->chunks, itf->name);
+
+        for (j = 0; itf->methods[j] != NULL; j++)
+          {
+            gchar *meth = g_string_chunk_insert (path->chunks, itf->methods[j]);
+
+            g_hash_table_insert (path->methods, str_pair_new (name, meth),
+                                 impl_bench);
+          }
+
+        for (j = 0; itf->properties[j] != NULL; j++)
+          {
+            gchar *prop = g_string_chunk_insert (path->chunks,
+                                                 itf->properties[j]);
+            PropertyPair *pair = g_new (PropertyPair, 1);
+
+            pair->get = impl_bench_property;
+            pair->set = NULL;
+            g_hash_table_insert (path->properties, str_pair_new (name, prop),
+                                 pair);
+          }
+      }
+    return path;
+}
+
+static void
+pair_path_free (PairPath *path)
+{
+    g_hash_table_destroy (path->methods);
+    g_hash_table_destroy (path->properties);
+    g_string_chunk_free (path->chunks);
+    g_free (path);
+}
+
+/*---------------------------------------------------------------------------*/
+
+static gdouble
+time_dispatch_table (DRoutePath *path, GPtrArray *calls, guint iterations)
+{
+    GTimer *timer = g_timer_new ();
+    guint found = 0;
+    guint i;
+    gdouble elapsed;
+
+    for (i = 0; i < iterations; i++)
+      {
+        BenchCall *call = g_ptr_array_index (calls, i % calls->len);
+        DRouteInterface *itf;
+        gpointer handler = NULL;
+
+        itf = name_table_lookup (path->interfaces, call->iface);
+        if (itf && itf->handler == handle_other)
+            handler = name_table_lookup (itf->methods, call->member);
+        else if (itf)
+            handler = itf->handler;
+        found += (handler != NULL);
+      }
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+    bench_sink = found;
+    return elapsed;
+}
+
+static gdouble
+time_pair_table (PairPath *path, GPtrArray *calls, guint iterations)
+{
+    GTimer *timer = g_timer_new ();
+    guint found = 0;
+    guint i;
+    gdouble elapsed;
+
+    for (i = 0; i < iterations; i++)
+      {
+        BenchCall *call = g_ptr_array_index (calls, i % calls->len);
+        gpointer handler;
+
+        if (!strcmp (call->iface, "org.freedesktop.DBus.Properties"))
+            handler = handle_properties;
+        else if (!strcmp (call->iface, "org.freedesktop.DBus.Introspectable"))
+            handler = handle_introspection;
+        else
+          {
+            StrPair pair;
+
+            pair.one = call->iface;
+            pair.two = call->member;
+            handler = g_hash_table_lookup (path->methods, &pair);
+          }
+        found += (handler != NULL);
+      }
+
+    elapsed = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+    bench_sink = found;
+    return elapsed;
+}
+
+/*---------------------------------------------------------------------------*/
+
+static gsize
+heap_used (void)
+{
+    return mallinfo ().uordblks;
+}
+
+/* The heap taken by each of BENCH_PATHS paths with every interface */
+static gsize
+measure_dispatch_paths (void)
+{
+    DRoutePath *paths[BENCH_PATHS];
+    gsize before = heap_used ();
+    gsize used;
+    gint i;
+
+    for (i = 0; i < BENCH_PATHS; i++)
+        paths[i] = dispatch_path_new ();
+    used = heap_used () - before;
+    for (i = 0; i < BENCH_PATHS; i++)
+        path_free (paths[i], NULL);
+    return used / BENCH_PATHS;
+}
+
+static gsize
+measure_pair_paths (void)
+{
+    PairPath *paths[BENCH_PATHS];
+    gsize before = heap_used ();
+    gsize used;
+    gint i;
+
+    for (i = 0; i < BENCH_PATHS; i++)
+        paths[i] = pair_path_new ();
+    used = heap_used () - before;
+    for (i = 0; i < BENCH_PATHS; i++)
+        pair_path_free (paths[i]);
+    return used / BENCH_PATHS;
+}
+
+int
+main (int argc, char **argv)
+{
+    guint iterations = BENCH_DEFAULT_ITERATIONS;
+    GPtrArray *calls;
+    DRoutePath *path;
+    PairPath *pair_path;
+    gdouble elapsed;
+
+    if (argc > 1)
+        iterations = atoi (argv[1]);
+    if (iterations == 0)
+        iterations = 1;
+
+    tables_init ();
+    calls = calls_new ();
+    path = dispatch_path_new ();
+    pair_path = pair_path_new ();
+
+    printf ("string pair table: %7lu bytes per path\n",
+            (gulong) measure_pair_paths ());
+    printf ("dispatch table:    %7lu bytes per path\n",
+            (gulong) measure_dispatch_paths ());
+
+    /* Warm the caches for both tables */
+    time_dispatch_table (path, calls, calls->len);
+    time_pair_table (pair_path, calls, calls->len);
+
+    elapsed = time_pair_table (pair_path, calls, iterations);
+    printf ("string pair table: %7.1f ns per call\n",
+            elapsed * 1e9 / iterations);
+
+    elapsed = time_dispatch_table (path, calls, iterations);
+    printf ("dispatch table:    %7.1f ns per call\n",
+            elapsed * 1e9 / iterations);
+
+    pair_path_free (pair_path);
+    path_free (path, NULL);
+    return 0;
+}
+
+/*END------------------------------------------------------------------------*/
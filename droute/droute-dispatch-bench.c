@@ -0,0 +1,233 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+
+/*
+ * Measures how much main thread time each method call costs, with droute
+ * reading messages on the main thread and with an I/O thread.
+ *
+ * Usage: droute-dispatch-bench [inline|threaded] [calls]
+ *
+ * A client thread makes the calls one at a time over a private
+ * connection, each returning a 1 kB string. The CPU time the main thread
+ * used and the round trip seen by the client are reported per call.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dbus/dbus-glib-lowlevel.h>
+
+#include "droute.h"
+
+#define BENCH_DEFAULT_CALLS 20000
+#define BENCH_WARMUP_CALLS  1000
+#define BENCH_TEXT_LENGTH   1024
+
+#define BENCH_PATH      "/org/a11y/atspi/accessible/1"
+#define BENCH_INTERFACE "org.a11y.atspi.Text"
+
+static gboolean bench_threaded = FALSE;
+static guint bench_calls = BENCH_DEFAULT_CALLS;
+
+static gchar *bench_text;
+static gchar *bench_address;
+static pthread_t bench_main_thread;
+static GMainLoop *bench_loop;
+static DBusConnection *bench_bus;
+static DRouteContext *bench_droute;
+
+/*---------------------------------------------------------------------------*/
+
+static DBusMessage *
+impl_GetText (DBusConnection *bus, DBusMessage *message, void *user_data)
+{
+    dbus_int32_t start, end;
+    DBusMessage *reply;
+
+    if (!dbus_message_get_args (message, NULL,
+                                DBUS_TYPE_INT32, &start,
+                                DBUS_TYPE_INT32, &end,
+                                DBUS_TYPE_INVALID))
+        return droute_invalid_arguments_error (message);
+
+    reply = dbus_message_new_method_return (message);
+    dbus_message_append_args (reply, DBUS_TYPE_STRING, &bench_text,
+                              DBUS_TYPE_INVALID);
+    return reply;
+}
+
+static DRouteMethod bench_methods[] =
+{
+    {impl_GetText, "GetText"},
+    {NULL, NULL}
+};
+
+static void *
+bench_get_datum (const char *path, void *user_data)
+{
+    return user_data;
+}
+
+static void
+new_connection_cb (DBusServer *server, DBusConnection *bus, void *data)
+{
+    DRoutePath *path;
+
+    bench_bus = dbus_connection_ref (bus);
+    dbus_connection_setup_with_g_main (bus, NULL);
+
+    bench_droute = droute_new (bus);
+    path = droute_add_many (bench_droute, "/org/a11y/atspi/accessible",
+                            bench_text, NULL, NULL, bench_get_datum);
+    droute_path_add_interface (path, BENCH_INTERFACE, "", bench_methods, NULL);
+
+    if (bench_threaded && !droute_start_io_thread (bench_droute))
+        g_error ("Could not start the I/O thread");
+}
+
+/*---------------------------------------------------------------------------*/
+
+static void
+make_calls (DBusConnection *bus, guint n)
+{
+    dbus_int32_t start = 0, end = -1;
+    DBusError error;
+    guint i;
+
+    dbus_error_init (&error);
+    for (i = 0; i < n; i++)
+      {
+        DBusMessage *message, *reply;
+
+        message = dbus_message_new_method_call (NULL, BENCH_PATH,
+                                                BENCH_INTERFACE, "GetText");
+        dbus_message_append_args (message,
+                                  DBUS_TYPE_INT32, &start,
+                                  DBUS_TYPE_INT32, &end,
+                                  DBUS_TYPE_INVALID);
+        reply = dbus_connection_send_with_reply_and_block (bus, message, -1,
+                                                           &error);
+        if (!reply)
+            g_error ("GetText failed: %s", error.message);
+        dbus_message_unref (reply);
+        dbus_message_unref (message);
+      }
+}
+
+static gdouble
+cpu_seconds (clockid_t clock)
+{
+    struct timespec now;
+
+    clock_gettime (clock, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static gpointer
+client_run (gpointer data)
+{
+    DBusConnection *bus;
+    DBusError error;
+    clockid_t main_clock;
+    GTimer *timer;
+    gdouble cpu, round_trip;
+
+    dbus_error_init (&error);
+    bus = dbus_connection_open_private (bench_address, &error);
+    if (!bus)
+        g_error ("Could not connect: %s", error.message);
+    pthread_getcpuclockid (bench_main_thread, &main_clock);
+
+    make_calls (bus, BENCH_WARMUP_CALLS);
+
+    timer = g_timer_new ();
+    cpu = cpu_seconds (main_clock);
+    make_calls (bus, bench_calls);
+    cpu = cpu_seconds (main_clock) - cpu;
+    round_trip = g_timer_elapsed (timer, NULL);
+    g_timer_destroy (timer);
+
+    printf ("%-8s %6u calls: main thread %6.1f us, round trip %6.1f us per call\n",
+            bench_threaded ? "threaded" : "inline", bench_calls,
+            cpu * 1e6 / bench_calls, round_trip * 1e6 / bench_calls);
+
+    dbus_connection_close (bus);
+    dbus_connection_unref (bus);
+    g_main_loop_quit (bench_loop);
+    return NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
+int
+main (int argc, char **argv)
+{
+    DBusServer *server;
+    DBusError error;
+
+    if (argc > 1)
+        bench_threaded = !strcmp (argv[1], "threaded");
+    if (argc > 2)
+        bench_calls = atoi (argv[2]);
+    if (bench_calls == 0)
+        bench_calls = 1;
+
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    dbus_threads_init_default ();
+
+    bench_text = g_strnfill (BENCH_TEXT_LENGTH, 'x');
+
+    dbus_error_init (&error);
+    server = dbus_server_listen ("unix:tmpdir=/tmp", &error);
+    if (!server)
+        g_error ("Could not listen: %s", error.message);
+    dbus_server_set_new_connection_function (server, new_connection_cb,
+                                             NULL, NULL);
+    dbus_server_setup_with_g_main (server, NULL);
+    bench_address = dbus_server_get_address (server);
+
+    bench_main_thread = pthread_self ();
+    bench_loop = g_main_loop_new (NULL, FALSE);
+    g_thread_create (client_run, NULL, FALSE, NULL);
+    g_main_loop_run (bench_loop);
+
+    if (bench_droute)
+        droute_free (bench_droute);
+    if (bench_bus)
+      {
+        dbus_connection_close (bench_bus);
+        dbus_connection_unref (bench_bus);
+      }
+    dbus_server_disconnect (server);
+    dbus_server_unref (server);
+    dbus_free (bench_address);
+    g_main_loop_unref (bench_loop);
+    g_free (bench_text);
+    return 0;
+}
+
+/*END------------------------------------------------------------------------*/
@@ -0,0 +1,164 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "droute-handoff.h"
+
+typedef struct _HandoffSource
+{
+    GSource       source;
+    HandoffQueue *queue;
+} HandoffSource;
+
+struct _HandoffQueue
+{
+    HandoffNode  *head;     /* Newest first */
+    GMainContext *context;
+    GSource      *source;
+    HandoffFunc   func;
+    gpointer      data;
+};
+
+/*---------------------------------------------------------------------------*/
+
+/* Takes every node from the queue, oldest first */
+static HandoffNode *
+queue_take_all (HandoffQueue *queue)
+{
+    HandoffNode *head, *oldest = NULL;
+
+    do
+        head = g_atomic_pointer_get (&queue->head);
+    while (head &&
+           !g_atomic_pointer_compare_and_exchange ((gpointer *) &queue->head,
+                                                   head, NULL));
+
+    while (head)
+      {
+        HandoffNode *next = head->next;
+
+        head->next = oldest;
+        oldest = head;
+        head = next;
+      }
+    return oldest;
+}
+
+static void
+queue_run (HandoffQueue *queue)
+{
+    HandoffNode *node, *next;
+
+    /* The function may free the node */
+    for (node = queue_take_all (queue); node; node = next)
+      {
+        next = node->next;
+        (queue->func) (node, queue->data);
+      }
+}
+
+static gboolean
+source_prepare (GSource *source, gint *timeout)
+{
+    HandoffQueue *queue = ((HandoffSource *) source)->queue;
+
+    *timeout = -1;
+    return g_atomic_pointer_get (&queue->head) != NULL;
+}
+
+static gboolean
+source_check (GSource *source)
+{
+    HandoffQueue *queue = ((HandoffSource *) source)->queue;
+
+    return g_atomic_pointer_get (&queue->head) != NULL;
+}
+
+static gboolean
+source_dispatch (GSource *source, GSourceFunc callback, gpointer user_data)
+{
+    queue_run (((HandoffSource *) source)->queue);
+    return TRUE;
+}
+
+static GSourceFuncs handoff_source_funcs =
+{
+    source_prepare,
+    source_check,
+    source_dispatch,
+    NULL
+};
+
+/*---------------------------------------------------------------------------*/
+
+/* A NULL context is the default main context */
+HandoffQueue *
+handoff_queue_new (GMainContext *context, HandoffFunc func, gpointer data)
+{
+    HandoffQueue *queue;
+
+    if (context == NULL)
+        context = g_main_context_default ();
+
+    queue = g_new0 (HandoffQueue, 1);
+    queue->context = g_main_context_ref (context);
+    queue->func = func;
+    queue->data = data;
+
+    queue->source = g_source_new (&handoff_source_funcs, sizeof (HandoffSource));
+    ((HandoffSource *) queue->source)->queue = queue;
+    g_source_attach (queue->source, context);
+    return queue;
+}
+
+/*
+ * Nodes still queued are handed to the function from the calling thread.
+ * Nothing may push to the queue once this has been called.
+ */
+void
+handoff_queue_free (HandoffQueue *queue)
+{
+    g_source_destroy (queue->source);
+    g_source_unref (queue->source);
+    queue_run (queue);
+    g_main_context_unref (queue->context);
+    g_free (queue);
+}
+
+void
+handoff_queue_push (HandoffQueue *queue, HandoffNode *node)
+{
+    HandoffNode *head;
+
+    do
+      {
+        head = g_atomic_pointer_get (&queue->head);
+        node->next = head;
+      }
+    while (!g_atomic_pointer_compare_and_exchange ((gpointer *) &queue->head,
+                                                   head, node));
+
+    /* Whoever pushed onto the empty queue has already woken the context */
+    if (head == NULL)
+        g_main_context_wakeup (queue->context);
+}
+
+/*END------------------------------------------------------------------------*/
@@ -0,0 +1,57 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef _DROUTE_HANDOFF_H
+#define _DROUTE_HANDOFF_H
+
+#include <glib.h>
+
+/*
+ * Passes work from any number of threads to the one thread running a
+ * main context.
+ *
+ * Pushing takes a single compare and exchange, and wakes the context
+ * only when the queue was empty. The context takes everything queued at
+ * once and hands the nodes to a function in the order they were pushed.
+ *
+ * Nodes are embedded at the start of the caller's own structures, so the
+ * queue allocates nothing.
+ */
+typedef struct _HandoffNode HandoffNode;
+struct _HandoffNode
+{
+    HandoffNode *next;
+};
+
+typedef void (*HandoffFunc) (HandoffNode *node, gpointer data);
+
+typedef struct _HandoffQueue HandoffQueue;
+
+HandoffQueue *handoff_queue_new  (GMainContext *context,
+                                  HandoffFunc   func,
+                                  gpointer      data);
+
+void          handoff_queue_free (HandoffQueue *queue);
+
+void          handoff_queue_push (HandoffQueue *queue,
+                                  HandoffNode  *node);
+
+#endif /* _DROUTE_HANDOFF_H */
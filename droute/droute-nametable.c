@@ -0,0 +1,275 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include <string.h>
+
+#include "droute-nametable.h"
+
+/* Character positions tried, counted from either end of the names */
+#define POSITIONS_MAX (24)
+
+typedef struct _NameEntry
+{
+    const gchar *name;
+    guint        len;
+    gpointer     value;
+} NameEntry;
+
+/*
+ * Once built, the entries and the slots share one exactly sized block,
+ * so a lookup touches at most two nearby allocations.
+ */
+struct _NameTable
+{
+    NameEntry *entries;
+    guint16   *slots;       /* Index into entries plus one, 0 if empty */
+    guint      n_entries;
+    guint      mask;
+    gint       first;
+    gint       second;
+    gboolean   stale;
+};
+
+/*---------------------------------------------------------------------------*/
+
+static inline guint
+name_char (const gchar *name, guint len, gint position)
+{
+    if (position < 0)
+        position += len;
+    if (position < 0 || (guint) position >= len)
+        return 0;
+    return (guchar) name[position];
+}
+
+static inline guint
+name_slot (const gchar *name, guint len, gint first, gint second, guint mask)
+{
+    guint h;
+
+    h  = len * 0x9E3779B1u;
+    h ^= name_char (name, len, first) * 0x85EBCA6Bu;
+    h ^= name_char (name, len, second) * 0xC2B2AE35u;
+    return ((h * 0x9E3779B1u) >> 16) & mask;
+}
+
+/*
+ * Places every entry into slots and returns the number of probes that
+ * did not find their slot on the first try.
+ */
+static guint
+place_entries (NameTable *table, guint16 *slots, guint mask, gint first, gint second)
+{
+    guint probes = 0;
+    guint i;
+
+    memset (slots, 0, (mask + 1) * sizeof (guint16));
+    for (i = 0; i < table->n_entries; i++)
+      {
+        NameEntry *entry = &table->entries[i];
+        guint s = name_slot (entry->name, entry->len, first, second, mask);
+
+        while (slots[s])
+          {
+            s = (s + 1) & mask;
+            probes++;
+          }
+        slots[s] = i + 1;
+      }
+    return probes;
+}
+
+/*
+ * Picks the table size and character positions that place the most
+ * names first time, stopping at the first choice that places them all.
+ */
+static void
+name_table_build (NameTable *table)
+{
+    guint best = G_MAXUINT;
+    guint best_mask = 0;
+    gint best_first = 0, best_second = 0;
+    guint max_len = 0;
+    guint n_slots, mask;
+    gint range, first, second;
+    guint16 *scratch;
+    NameEntry *block;
+    guint i;
+
+    for (i = 0; i < table->n_entries; i++)
+        max_len = MAX (max_len, table->entries[i].len);
+    range = CLAMP (max_len, 1, POSITIONS_MAX);
+
+    /* Keep at least half the slots empty, so a missing name is found quickly */
+    for (n_slots = 4; n_slots < table->n_entries * 2; n_slots <<= 1)
+        ;
+    scratch = g_new (guint16, n_slots * 2);
+
+    for (mask = n_slots - 1; mask < n_slots * 2 && best; mask = (mask << 1) | 1)
+        for (first = -range; first < range && best; first++)
+            for (second = first; second < range && best; second++)
+              {
+                guint probes = place_entries (table, scratch, mask,
+                                              first, second);
+
+                if (probes < best)
+                  {
+                    best = probes;
+                    best_mask = mask;
+                    best_first = first;
+                    best_second = second;
+                  }
+              }
+    g_free (scratch);
+
+    block = g_malloc (table->n_entries * sizeof (NameEntry) +
+                      (best_mask + 1) * sizeof (guint16));
+    memcpy (block, table->entries, table->n_entries * sizeof (NameEntry));
+    g_free (table->entries);
+    table->entries = block;
+    table->slots = (guint16 *) (block + table->n_entries);
+    table->mask = best_mask;
+    table->first = best_first;
+    table->second = best_second;
+    place_entries (table, table->slots, best_mask, best_first, best_second);
+    table->stale = FALSE;
+}
+
+/*---------------------------------------------------------------------------*/
+
+NameTable *
+name_table_new (void)
+{
+    NameTable *table;
+
+    table = g_new0 (NameTable, 1);
+    table->stale = TRUE;
+    return table;
+}
+
+void
+name_table_free (NameTable *table, GDestroyNotify value_free)
+{
+    guint i;
+
+    if (value_free)
+        for (i = 0; i < table->n_entries; i++)
+            value_free (table->entries[i].value);
+
+    g_free (table->entries);
+    g_free (table);
+}
+
+/*
+ * Adds a name to the table, or replaces its value if it is already
+ * there. Returns the value replaced, if any, so that it may be freed.
+ */
+gpointer
+name_table_insert (NameTable *table, const gchar *name, gpointer value)
+{
+    NameEntry *entry;
+    guint i;
+
+    for (i = 0; i < table->n_entries; i++)
+      {
+        NameEntry *existing = &table->entries[i];
+
+        if (!strcmp (existing->name, name))
+          {
+            gpointer old = existing->value;
+
+            existing->value = value;
+            return old;
+          }
+      }
+
+    g_return_val_if_fail (table->n_entries < G_MAXUINT16, NULL);
+
+    /* Tables are filled once, so the block grows one entry at a time */
+    table->entries = g_renew (NameEntry, table->entries, table->n_entries + 1);
+    table->slots = NULL;
+    entry = &table->entries[table->n_entries++];
+    entry->name = name;
+    entry->len = strlen (name);
+    entry->value = value;
+    table->stale = TRUE;
+    return NULL;
+}
+
+/*
+ * Builds the table now rather than on the next lookup. Lookups on a
+ * built table do not write to it, so may then run on any thread until
+ * the next insert.
+ */
+void
+name_table_prepare (NameTable *table)
+{
+    if (table->stale)
+        name_table_build (table);
+}
+
+gpointer
+name_table_lookup (NameTable *table, const gchar *name)
+{
+    guint len = strlen (name);
+    guint s;
+
+    if (G_UNLIKELY (table->stale))
+        name_table_build (table);
+
+    for (s = name_slot (name, len, table->first, table->second, table->mask);
+         table->slots[s];
+         s = (s + 1) & table->mask)
+      {
+        NameEntry *entry = &table->entries[table->slots[s] - 1];
+
+        if (entry->len == len && !memcmp (entry->name, name, len))
+            return entry->value;
+      }
+    return NULL;
+}
+
+/*
+ * Steps through the table in the order names were added. Start with
+ * position set to 0.
+ */
+gboolean
+name_table_next (NameTable    *table,
+                 guint        *position,
+                 const gchar **name,
+                 gpointer     *value)
+{
+    NameEntry *entry;
+
+    if (*position >= table->n_entries)
+        return FALSE;
+
+    entry = &table->entries[*position];
+    if (name)
+        *name = entry->name;
+    if (value)
+        *value = entry->value;
+    (*position)++;
+    return TRUE;
+}
+
+/*END------------------------------------------------------------------------*/
@@ -0,0 +1,59 @@
+/*
+ * AT-SPI - Assistive Technology Service Provider Interface
+ * (Gnome Accessibility Project; http://developer.gnome.org/projects/gap)
+ *
+ * Copyright 2010 Codethink Ltd.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+#ifndef _DROUTE_NAMETABLE_H
+#define _DROUTE_NAMETABLE_H
+
+#include <glib.h>
+
+/*
+ * A table of D-Bus names that is filled once and then looked up on
+ * every message.
+ *
+ * When the table changes, two character positions are chosen that,
+ * with the length of a name, tell the names in the table apart. A
+ * lookup then reads those two characters rather than hashing the whole
+ * name, and confirms the match with a single comparison.
+ *
+ * Names are not copied and must outlive the table.
+ */
+typedef struct _NameTable NameTable;
+
+NameTable *name_table_new     (void);
+
+void       name_table_free    (NameTable      *table,
+                               GDestroyNotify  value_free);
+
+gpointer   name_table_insert  (NameTable      *table,
+                               const gchar    *name,
+                               gpointer        value);
+
+void       name_table_prepare (NameTable      *table);
+
+gpointer   name_table_lookup  (NameTable      *table,
+                               const gchar    *name);
+
+gboolean   name_table_next    (NameTable      *table,
+                               guint          *position,
+                               const gchar   **name,
+                               gpointer       *value);
+
+#endif /* _DROUTE_NAMETABLE_H */
@@ -2,11 +2,14 @@
 #include <glib.h>
 #include <string.h>
 #include <droute/droute.h>
+#include <droute/droute-handoff.h>
+#include <droute/droute-nametable.h>
 #include <dbind/dbind.h>
 
 #include "dbus/dbus-glib-lowlevel.h"
 
 #define TEST_OBJECT_PATH    "/test/object"
+#define TEST_MASKED_PATH    "/test/masked"
 #define TEST_INTERFACE_ONE  "test.interface.One"
 #define TEST_INTERFACE_TWO  "test.interface.Two"
 
@@ -39,7 +42,7 @@ const gchar *test_interface_One = \
 "</interface>";
 
 const gchar *test_interface_Two = \
-"<interface name=\"test.interface.One\">"
+"<interface name=\"test.interface.Two\">"
 "  <method name=\"null\"/>"
 "  <method name=\"getInt\">"
 "    <arg direction=\"out\" type=\"o\"/>"
@@ -185,11 +188,200 @@ static DRouteProperty test_properties[] = {
     {NULL, NULL, NULL}
 };
 
+/* Objects on the masked path only implement the first of these */
+static const char * const test_interface_names[] = {
+    TEST_INTERFACE_ONE,
+    TEST_INTERFACE_TWO,
+    NULL
+};
+
+static guint64
+test_interface_mask (void *datum)
+{
+    return 1 << 0;
+}
+
+static void *
+test_get_datum (const char *path, void *user_data)
+{
+    return user_data;
+}
+
+static void
+set_reply (DBusPendingCall *pending, void *user_data)
+{
+    *(DBusMessage **) user_data = dbus_pending_call_steal_reply (pending);
+}
+
+/* Sends a call to ourselves, dispatching it while waiting for the reply */
+static DBusMessage *
+call_reentrant (DBusMessage *message)
+{
+    DBusPendingCall *pending;
+    DBusMessage *reply = NULL;
+
+    if (!dbus_connection_send_with_reply (bus, message, &pending, -1))
+        return NULL;
+    dbus_pending_call_set_notify (pending, set_reply, &reply, NULL);
+    while (!reply)
+        if (!dbus_connection_read_write_dispatch (bus, -1))
+            break;
+    dbus_pending_call_unref (pending);
+    return reply;
+}
+
+static void
+append_batch_call (DBusMessageIter *iter_calls,
+                   const char      *path,
+                   const char      *iface,
+                   const char      *member,
+                   gboolean         with_batch)
+{
+    DBusMessageIter iter_struct, iter_args, iter_variant, iter_inner;
+
+    dbus_message_iter_open_container (iter_calls, DBUS_TYPE_STRUCT, NULL, &iter_struct);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_OBJECT_PATH, &path);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &iface);
+    dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &member);
+    dbus_message_iter_open_container (&iter_struct, DBUS_TYPE_ARRAY, "v", &iter_args);
+    if (with_batch)
+      {
+        /* An empty list of calls, as the argument of a nested Batch.Call */
+        dbus_message_iter_open_container (&iter_args, DBUS_TYPE_VARIANT, "a(ossav)", &iter_variant);
+        dbus_message_iter_open_container (&iter_variant, DBUS_TYPE_ARRAY, "(ossav)", &iter_inner);
+        dbus_message_iter_close_container (&iter_variant, &iter_inner);
+        dbus_message_iter_close_container (&iter_args, &iter_variant);
+      }
+    dbus_message_iter_close_container (&iter_struct, &iter_args);
+    dbus_message_iter_close_container (iter_calls, &iter_struct);
+}
+
+/*
+ * A batch holding another batch has that call rejected, while the calls
+ * around it still run. Returns the error names of the results, in order,
+ * joined by spaces.
+ */
+static gchar *
+call_nested_batch (const gchar *bus_name)
+{
+    DBusMessage *message, *reply;
+    DBusMessageIter iter, iter_calls, iter_struct;
+    GString *errors = g_string_new (NULL);
+
+    message = dbus_message_new_method_call (bus_name, TEST_OBJECT_PATH,
+                                            DROUTE_INTERFACE_BATCH, "Call");
+    dbus_message_iter_init_append (message, &iter);
+    dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(ossav)", &iter_calls);
+    append_batch_call (&iter_calls, TEST_OBJECT_PATH, DROUTE_INTERFACE_BATCH, "Call", TRUE);
+    append_batch_call (&iter_calls, TEST_OBJECT_PATH, "test.interface.Missing", "null", FALSE);
+    dbus_message_iter_close_container (&iter, &iter_calls);
+
+    reply = call_reentrant (message);
+    dbus_message_unref (message);
+    if (!reply)
+        return g_string_free (errors, FALSE);
+
+    if (dbus_message_has_signature (reply, "a(sav)"))
+      {
+        dbus_message_iter_init (reply, &iter);
+        dbus_message_iter_recurse (&iter, &iter_calls);
+        while (dbus_message_iter_get_arg_type (&iter_calls) != DBUS_TYPE_INVALID)
+          {
+            const char *error;
+
+            dbus_message_iter_recurse (&iter_calls, &iter_struct);
+            dbus_message_iter_get_basic (&iter_struct, &error);
+            g_string_append_printf (errors, errors->len ? " %s" : "%s", error);
+            dbus_message_iter_next (&iter_calls);
+          }
+      }
+    dbus_message_unref (reply);
+    return g_string_free (errors, FALSE);
+}
+
+/*
+ * Introspect must list the interfaces a call can be made on, and no
+ * others. Returns a description of the first mismatch, or NULL.
+ */
+static const gchar *
+check_implemented (const gchar *bus_name)
+{
+    DBusMessage *message, *reply;
+    const char *xml = NULL;
+    const gchar *failure = NULL;
+
+    message = dbus_message_new_method_call (bus_name, TEST_MASKED_PATH,
+                                            TEST_INTERFACE_TWO, "getInterfaceTwo");
+    reply = call_reentrant (message);
+    dbus_message_unref (message);
+    if (!reply || !dbus_message_is_error (reply, DBUS_ERROR_UNKNOWN_INTERFACE))
+        failure = "call to an unimplemented interface was not refused";
+    if (reply)
+        dbus_message_unref (reply);
+    if (failure)
+        return failure;
+
+    message = dbus_message_new_method_call (bus_name, TEST_MASKED_PATH,
+                                            DBUS_INTERFACE_INTROSPECTABLE,
+                                            "Introspect");
+    reply = call_reentrant (message);
+    dbus_message_unref (message);
+    if (!reply ||
+        !dbus_message_get_args (reply, NULL, DBUS_TYPE_STRING, &xml,
+                                DBUS_TYPE_INVALID))
+        failure = "no reply to Introspect";
+    else if (!strstr (xml, "\"" TEST_INTERFACE_ONE "\""))
+        failure = "Introspect left out an implemented interface";
+    else if (strstr (xml, "\"" TEST_INTERFACE_TWO "\""))
+        failure = "Introspect listed an unimplemented interface";
+    if (reply)
+        dbus_message_unref (reply);
+    return failure;
+}
+
+/* Adds up calls to "null", to unknown members and to anything else */
+static void
+count_stats (const DRouteStats *stats, void *data)
+{
+    guint *counts = (guint *) data;
+
+    if (!g_strcmp0 (stats->member, "null"))
+        counts[0] += stats->calls;
+    else if (!g_strcmp0 (stats->member, DROUTE_STATS_UNKNOWN))
+        counts[1] += stats->calls;
+    else
+        counts[2] += stats->calls;
+}
+
+/* Calls members that no handler serves, which should share one entry */
+static void
+call_unknown_members (const gchar *bus_name)
+{
+    DBusMessage *message, *reply;
+    gchar *member;
+    gint i;
+
+    for (i = 0; i < 3; i++)
+      {
+        member = g_strdup_printf ("unknown%d", i);
+        message = dbus_message_new_method_call (bus_name, TEST_OBJECT_PATH,
+                                                TEST_INTERFACE_ONE, member);
+        reply = call_reentrant (message);
+        if (reply)
+            dbus_message_unref (reply);
+        dbus_message_unref (message);
+        g_free (member);
+      }
+}
+
 gboolean
 do_tests_func (gpointer data)
 {
+    DRouteContext *cnx = (DRouteContext *) data;
     DBusError    error;
     const gchar *bus_name;
+    guint        counts[3] = { 0, 0, 0 };
+    const gchar *failure;
 
     gchar     *expected_string;
     gchar     *result_string;
@@ -199,6 +391,8 @@ do_tests_func (gpointer data)
 
     /* --------------------------------------------------------*/
 
+    droute_set_stats_enabled (cnx, TRUE);
+
     dbind_method_call_reentrant (bus,
                                  bus_name,
                                  TEST_OBJECT_PATH,
@@ -206,6 +400,38 @@ do_tests_func (gpointer data)
                                  "null",
                                  NULL,
                                  "");
+    call_unknown_members (bus_name);
+
+    droute_stats_foreach (cnx, count_stats, counts);
+    if (counts[0] != 1 || counts[1] != 3 || counts[2] != 0)
+    {
+            g_print ("Failed: stats counted %u null, %u unknown and %u other calls\n",
+                     counts[0], counts[1], counts[2]);
+            success = FALSE;
+    }
+    droute_set_stats_enabled (cnx, FALSE);
+
+    /* --------------------------------------------------------*/
+
+    expected_string = DBUS_ERROR_FAILED " " DBUS_ERROR_UNKNOWN_METHOD;
+    result_string = call_nested_batch (bus_name);
+    if (g_strcmp0 (expected_string, result_string))
+    {
+            g_print ("Failed: nested batch gave '%s'\n", result_string);
+            success = FALSE;
+            g_free (result_string);
+            goto out;
+    }
+    g_free (result_string);
+
+    /* --------------------------------------------------------*/
+
+    failure = check_implemented (bus_name);
+    if (failure)
+    {
+            g_print ("Failed: %s\n", failure);
+            success = FALSE;
+    }
 
     /* --------------------------------------------------------*/
 
@@ -232,6 +458,195 @@ out:
     return FALSE;
 }
 
+/* --------------------------------------------------------*/
+
+static void
+check_lookup (NameTable *table, const gchar *name, gpointer expected)
+{
+    gpointer value = name_table_lookup (table, name);
+
+    if (value != expected)
+      {
+        g_print ("Failed: name table lookup of '%s' gave %p, not %p\n",
+                 name, value, expected);
+        success = FALSE;
+      }
+}
+
+/*
+ * Names that share their length and most characters, as interface
+ * methods do, must still be told apart, and names not added or only
+ * prefixes of those added must not be found.
+ */
+static void
+test_name_table (void)
+{
+    static const gchar *names[] = {
+        "GetName", "GetRole", "GetRoleName", "GetLocalizedRoleName",
+        "GetState", "GetStateSet", "GetAttributes", "GetApplication",
+        "GetChildAtIndex", "GetChildren", "GetIndexInParent",
+        "GetRelationSet", "GetInterfaces", "a", "b", "ab", "ba", ""
+    };
+    gchar *generated[300];
+    NameTable *table;
+    const gchar *name;
+    gpointer value;
+    guint i, position;
+
+    table = name_table_new ();
+    check_lookup (table, "GetName", NULL);
+
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+        name_table_insert (table, names[i], GUINT_TO_POINTER (i + 1));
+    for (i = 0; i < G_N_ELEMENTS (names); i++)
+        check_lookup (table, names[i], GUINT_TO_POINTER (i + 1));
+    check_lookup (table, "GetNam", NULL);
+    check_lookup (table, "GetNames", NULL);
+    check_lookup (table, "GetRolf", NULL);
+    check_lookup (table, "c", NULL);
+
+    /* Replacing a value hands back the old one */
+    value = name_table_insert (table, "GetRole", GUINT_TO_POINTER (100));
+    if (value != GUINT_TO_POINTER (2))
+      {
+        g_print ("Failed: name table insert did not return the old value\n");
+        success = FALSE;
+      }
+    check_lookup (table, "GetRole", GUINT_TO_POINTER (100));
+
+    /* Names added after a lookup are found once the table is rebuilt */
+    for (i = 0; i < G_N_ELEMENTS (generated); i++)
+      {
+        generated[i] = g_strdup_printf ("Method%u", i);
+        name_table_insert (table, generated[i], GUINT_TO_POINTER (1000 + i));
+      }
+    name_table_prepare (table);
+    for (i = 0; i < G_N_ELEMENTS (generated); i++)
+        check_lookup (table, generated[i], GUINT_TO_POINTER (1000 + i));
+    check_lookup (table, "GetName", GUINT_TO_POINTER (1));
+    check_lookup (table, "Method300", NULL);
+
+    /* Names are stepped through in the order they were added */
+    position = 0;
+    for (i = 0; name_table_next (table, &position, &name, &value); i++)
+      {
+        const gchar *expected = i < G_N_ELEMENTS (names) ?
+                                names[i] : generated[i - G_N_ELEMENTS (names)];
+
+        if (strcmp (name, expected))
+          {
+            g_print ("Failed: name table stepped to '%s', not '%s'\n",
+                     name, expected);
+            success = FALSE;
+          }
+      }
+    if (i != G_N_ELEMENTS (names) + G_N_ELEMENTS (generated))
+      {
+        g_print ("Failed: name table stepped through %u names\n", i);
+        success = FALSE;
+      }
+
+    name_table_free (table, NULL);
+    for (i = 0; i < G_N_ELEMENTS (generated); i++)
+        g_free (generated[i]);
+}
+
+/* --------------------------------------------------------*/
+
+#define HANDOFF_THREADS 8
+#define HANDOFF_NODES   20000
+
+typedef struct _TestNode
+{
+    HandoffNode node;
+    guint       thread;
+    guint       sequence;
+} TestNode;
+
+typedef struct _HandoffTest
+{
+    HandoffQueue *queue;
+    guint         next[HANDOFF_THREADS];    /* Sequence expected next */
+    guint         received;
+    gboolean      in_order;
+} HandoffTest;
+
+typedef struct _HandoffPusher
+{
+    HandoffTest *test;
+    guint        thread;
+} HandoffPusher;
+
+static void
+handoff_receive (HandoffNode *node, gpointer data)
+{
+    HandoffTest *test = data;
+    TestNode *item = (TestNode *) node;
+
+    if (item->sequence != test->next[item->thread])
+        test->in_order = FALSE;
+    test->next[item->thread] = item->sequence + 1;
+    test->received++;
+    g_free (item);
+}
+
+static gpointer
+handoff_push (gpointer data)
+{
+    HandoffPusher *pusher = data;
+    guint i;
+
+    for (i = 0; i < HANDOFF_NODES; i++)
+      {
+        TestNode *item = g_new (TestNode, 1);
+
+        item->thread = pusher->thread;
+        item->sequence = i;
+        handoff_queue_push (pusher->test->queue, &item->node);
+      }
+    return NULL;
+}
+
+/*
+ * Many threads push at once while the context takes everything queued.
+ * Every node must arrive exactly once, in the order each thread pushed.
+ */
+static void
+test_handoff (void)
+{
+    GMainContext *context = g_main_context_new ();
+    HandoffTest test = { 0 };
+    HandoffPusher pushers[HANDOFF_THREADS];
+    GThread *threads[HANDOFF_THREADS];
+    guint i;
+
+    test.in_order = TRUE;
+    test.queue = handoff_queue_new (context, handoff_receive, &test);
+
+    for (i = 0; i < HANDOFF_THREADS; i++)
+      {
+        pushers[i].test = &test;
+        pushers[i].thread = i;
+        threads[i] = g_thread_create (handoff_push, &pushers[i], TRUE, NULL);
+      }
+    while (test.received < HANDOFF_THREADS * HANDOFF_NODES)
+        g_main_context_iteration (context, TRUE);
+    for (i = 0; i < HANDOFF_THREADS; i++)
+        g_thread_join (threads[i]);
+
+    if (test.received != HANDOFF_THREADS * HANDOFF_NODES || !test.in_order)
+      {
+        g_print ("Failed: handoff queue gave %u of %u nodes%s\n",
+                 test.received, HANDOFF_THREADS * HANDOFF_NODES,
+                 test.in_order ? "" : ", out of order");
+        success = FALSE;
+      }
+
+    handoff_queue_free (test.queue);
+    g_main_context_unref (context);
+}
+
+/* --------------------------------------------------------*/
 
 int main (int argc, char **argv)
 {
@@ -240,6 +655,11 @@ int main (int argc, char **argv)
     AnObject       *object;
     DBusError       error;
 
+    if (!g_thread_supported ())
+        g_thread_init (NULL);
+    test_name_table ();
+    test_handoff ();
+
     /* Setup some server object */
 
     object = g_new0(AnObject, 1);
@@ -266,7 +686,22 @@ int main (int argc, char **argv)
                                test_methods_two,
                                test_properties);
 
-    g_idle_add (do_tests_func, NULL);
+    path = droute_add_many (cnx, TEST_MASKED_PATH, object, NULL, NULL,
+                            test_get_datum);
+    droute_path_add_interface (path,
+                               TEST_INTERFACE_ONE,
+                               test_interface_One,
+                               test_methods_one,
+                               test_properties);
+    droute_path_add_interface (path,
+                               TEST_INTERFACE_TWO,
+                               test_interface_Two,
+                               test_methods_two,
+                               test_properties);
+    droute_path_set_interface_mask (path, test_interface_names,
+                                    test_interface_mask);
+
+    g_idle_add (do_tests_func, cnx);
     g_main_run(main_loop);
     if (success)
             return 0;
@@ -24,10 +24,11 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "droute.h"
-#include "droute-pairhash.h"
+#include <dbus/dbus-glib-lowlevel.h>
 
-#define CHUNKS_DEFAULT (512)
+#include "droute.h"
+#include "droute-handoff.h"
+#include "droute-nametable.h"
 
 #define oom() g_error ("D-Bus out of memory, this message will fail anyway")
 
@@ -43,41 +44,209 @@ struct _DRouteContext
     GPtrArray            *registered_paths;
 
     gchar                *introspect_string;
+
+    /* Set while messages are read on an I/O thread */
+    GThread              *io_thread;
+    GMainContext         *io_context;
+    GMainLoop            *io_loop;
+    HandoffQueue         *calls;     /* Run on the main context */
+    HandoffQueue         *replies;   /* Sent from the I/O thread */
+
+    gboolean              stats_enabled;
+    GHashTable           *stats;     /* Interface -> member -> DRouteStats */
 };
 
 struct _DRoutePath
 {
     DRouteContext        *cnx;
-    GStringChunk         *chunks;
-    GPtrArray            *interfaces;
-    GPtrArray            *introspection;
-    GHashTable           *methods;
-    GHashTable           *properties;
+    gchar                *name;
+    gboolean              fallback;
+    NameTable            *interfaces;
+    GHashTable           *introspection;  /* Interface mask -> GString */
 
     DRouteIntrospectChildrenFunction introspect_children_cb;
     void *introspect_children_data;
     void                   *user_data;
     DRouteGetDatumFunction  get_datum;
+    const char * const     *interface_names;
+    DRouteInterfaceMaskFunction interface_mask;
+    guint                   n_interfaces;
 };
 
 /*---------------------------------------------------------------------------*/
 
-typedef struct PropertyPair
+typedef struct _DRouteInterface DRouteInterface;
+
+/*
+ * Returns the reply to a call on the interface, or NULL if the interface
+ * has no such member.
+ */
+typedef DBusMessage *(*DRouteInterfaceHandler) (DBusConnection  *bus,
+                                                DBusMessage     *message,
+                                                DRoutePath      *path,
+                                                DRouteInterface *itf,
+                                                const gchar     *member,
+                                                const gchar     *pathstr);
+
+/*
+ * Everything a path knows about one interface, found with a single lookup
+ * of the interface name. The standard D-Bus interfaces are entered in the
+ * same table with their own handlers, so no message needs to be compared
+ * against their names.
+ *
+ * Names and properties point into the tables the interface was added
+ * with, so nothing is allocated for each member.
+ */
+struct _DRouteInterface
+{
+    const gchar            *name;
+    DRouteInterfaceHandler  handler;
+    NameTable              *methods;     /* Member name -> DRouteFunction */
+    NameTable              *properties;  /* Property name -> DRouteProperty */
+    gboolean                has_getters;
+    const gchar            *introspect;
+    guint64                 bit;         /* In an interface mask, or 0 */
+    guint64                 implements_bit; /* From interface_mask, or 0 */
+};
+
+/* A call read on the I/O thread, and later its reply */
+typedef struct _DRouteCall
 {
-    DRoutePropertyFunction get;
-    DRoutePropertyFunction set;
-} PropertyPair;
+    HandoffNode      node;
+    DRoutePath      *path;
+    DRouteInterface *itf;
+    DBusMessage     *message;
+    DBusMessage     *reply;
+} DRouteCall;
 
 /*---------------------------------------------------------------------------*/
 
 static DBusHandlerResult
 handle_message (DBusConnection *bus, DBusMessage *message, void *user_data);
 
+static DBusMessage *
+handle_properties (DBusConnection  *bus,
+                   DBusMessage     *message,
+                   DRoutePath      *path,
+                   DRouteInterface *itf,
+                   const gchar     *member,
+                   const gchar     *pathstr);
+
+static DBusMessage *
+handle_introspection (DBusConnection  *bus,
+                      DBusMessage     *message,
+                      DRoutePath      *path,
+                      DRouteInterface *itf,
+                      const gchar     *member,
+                      const gchar     *pathstr);
+
+static DBusMessage *
+handle_other (DBusConnection  *bus,
+              DBusMessage     *message,
+              DRoutePath      *path,
+              DRouteInterface *itf,
+              const gchar     *member,
+              const gchar     *pathstr);
+
+static DBusMessage *
+handle_batch (DBusConnection  *bus,
+              DBusMessage     *message,
+              DRoutePath      *path,
+              DRouteInterface *itf,
+              const gchar     *member,
+              const gchar     *pathstr);
+
 static DBusMessage *
 droute_object_does_not_exist_error (DBusMessage *message);
 
+static DBusMessage *
+droute_not_implemented_error (DBusMessage *message, const char *interface);
+
 /*---------------------------------------------------------------------------*/
 
+static void
+interface_free (DRouteInterface *itf)
+{
+    name_table_free (itf->methods, NULL);
+    name_table_free (itf->properties, NULL);
+    g_free (itf);
+}
+
+/* Finds the interface's bit in the masks the path's interface_mask returns */
+static void
+interface_set_implements_bit (DRouteInterface *itf, const char * const *names)
+{
+    guint i;
+
+    itf->implements_bit = 0;
+    for (i = 0; names && names[i] && i < 64; i++)
+        if (!strcmp (names[i], itf->name))
+          {
+            itf->implements_bit = G_GUINT64_CONSTANT (1) << i;
+            return;
+          }
+}
+
+/*
+ * Interfaces without a bit in the interface mask, which include those
+ * droute provides itself, are implemented by every object on the path.
+ */
+static gboolean
+interface_implemented (DRouteInterface *itf, guint64 implemented)
+{
+    return !itf->implements_bit || (implemented & itf->implements_bit);
+}
+
+/* Asks once for the interfaces an object implements */
+static guint64
+path_get_implemented (DRoutePath *path, void *datum)
+{
+    if (!path->interface_mask)
+        return G_MAXUINT64;
+    return (path->interface_mask) (datum);
+}
+
+/*
+ * Returns the entry for an interface, adding an empty one if the path
+ * does not have it yet.
+ */
+static DRouteInterface *
+path_ensure_interface (DRoutePath *path,
+                       const char *name,
+                       DRouteInterfaceHandler handler)
+{
+    DRouteInterface *itf;
+
+    itf = name_table_lookup (path->interfaces, name);
+    if (itf)
+        return itf;
+
+    itf = g_new0 (DRouteInterface, 1);
+    itf->name = name;
+    itf->handler = handler;
+    itf->methods = name_table_new ();
+    itf->properties = name_table_new ();
+    if (path->n_interfaces < 64)
+        itf->bit = G_GUINT64_CONSTANT (1) << path->n_interfaces;
+    path->n_interfaces++;
+    interface_set_implements_bit (itf, path->interface_names);
+    name_table_insert (path->interfaces, itf->name, itf);
+    return itf;
+}
+
+static void
+introspection_free (gpointer data)
+{
+    g_string_free ((GString *) data, TRUE);
+}
+
+static void
+path_clear_introspection (DRoutePath *path)
+{
+    if (path->introspection)
+        g_hash_table_remove_all (path->introspection);
+}
+
 static DRoutePath *
 path_new (DRouteContext *cnx,
           void    *user_data,
@@ -89,19 +258,14 @@ path_new (DRouteContext *cnx,
 
     new_path = g_new0 (DRoutePath, 1);
     new_path->cnx = cnx;
-    new_path->chunks = g_string_chunk_new (CHUNKS_DEFAULT);
-    new_path->interfaces = g_ptr_array_new ();
-    new_path->introspection = g_ptr_array_new ();
-
-    new_path->methods = g_hash_table_new_full ((GHashFunc)str_pair_hash,
-                                               str_pair_equal,
-                                               g_free,
-                                               NULL);
+    new_path->interfaces = name_table_new ();
 
-    new_path->properties = g_hash_table_new_full ((GHashFunc)str_pair_hash,
-                                                  str_pair_equal,
-                                                  g_free,
-                                                  NULL);
+    path_ensure_interface (new_path, DBUS_INTERFACE_PROPERTIES,
+                           handle_properties);
+    path_ensure_interface (new_path, DBUS_INTERFACE_INTROSPECTABLE,
+                           handle_introspection);
+    path_ensure_interface (new_path, DROUTE_INTERFACE_BATCH,
+                           handle_batch);
 
     new_path->introspect_children_cb = introspect_children_cb;
     new_path->introspect_children_data = introspect_children_data;
@@ -114,11 +278,11 @@ path_new (DRouteContext *cnx,
 static void
 path_free (DRoutePath *path, gpointer user_data)
 {
-    g_string_chunk_free  (path->chunks);
-    g_ptr_array_free     (path->interfaces, TRUE);
-    g_ptr_array_free     (path->introspection, FALSE);
-    g_hash_table_destroy (path->methods);
-    g_hash_table_destroy (path->properties);
+    name_table_free      (path->interfaces, (GDestroyNotify) interface_free);
+    if (path->introspection)
+        g_hash_table_destroy (path->introspection);
+    g_free (path->name);
+    g_free (path);
 }
 
 static void *
@@ -147,6 +311,9 @@ droute_new (DBusConnection *bus)
 void
 droute_free (DRouteContext *cnx)
 {
+    droute_stop_io_thread (cnx);
+    if (cnx->stats)
+        g_hash_table_destroy (cnx->stats);
     g_ptr_array_foreach (cnx->registered_paths, (GFunc) path_free, NULL);
     g_free (cnx);
 }
@@ -177,6 +344,7 @@ droute_add_one (DRouteContext *cnx,
     gboolean registered;
 
     new_path = path_new (cnx, NULL, NULL, (void *) data, NULL);
+    new_path->name = g_strdup (path);
 
     registered = dbus_connection_register_object_path (cnx->bus, path, &droute_vtable, new_path);
     if (!registered)
@@ -200,6 +368,8 @@ droute_add_many (DRouteContext *cnx,
     DRoutePath *new_path;
 
     new_path = path_new (cnx, (void *) data, introspect_children_cb, introspect_children_data, get_datum);
+    new_path->name = g_strdup (path);
+    new_path->fallback = TRUE;
 
     if (!dbus_connection_register_fallback (cnx->bus, path, &droute_vtable, new_path))
         oom();
@@ -210,6 +380,11 @@ droute_add_many (DRouteContext *cnx,
 
 /*---------------------------------------------------------------------------*/
 
+/*
+ * The name, introspection data and method and property tables are used
+ * in place rather than copied, so must outlive the path. They are
+ * normally static.
+ */
 void
 droute_path_add_interface(DRoutePath *path,
                           const char *name,
@@ -217,52 +392,99 @@ droute_path_add_interface(DRoutePath *path,
                           const DRouteMethod   *methods,
                           const DRouteProperty *properties)
 {
-    gchar *itf;
+    DRouteInterface *itf;
 
     g_return_if_fail (name != NULL);
 
-    itf = g_string_chunk_insert (path->chunks, name);
-    g_ptr_array_add (path->interfaces, itf);
-    g_ptr_array_add (path->introspection, introspect);
+    itf = path_ensure_interface (path, name, handle_other);
+    itf->introspect = introspect;
+    path_clear_introspection (path);
 
     for (; methods != NULL && methods->name != NULL; methods++)
-      {
-        gchar *meth;
-
-        meth = g_string_chunk_insert (path->chunks, methods->name);
-        g_hash_table_insert (path->methods, str_pair_new (itf, meth), methods->func);
-      }
+        name_table_insert (itf->methods, methods->name, methods->func);
 
     for (; properties != NULL && properties->name != NULL; properties++)
       {
-        gchar *prop;
-        PropertyPair *pair;
-
-        prop = g_string_chunk_insert (path->chunks, properties->name);
-        pair = g_new (PropertyPair, 1);
-        pair->get = properties->get;
-        pair->set = properties->set;
-        g_hash_table_insert (path->properties, str_pair_new (itf, prop), pair);
+        name_table_insert (itf->properties, properties->name,
+                           (gpointer) properties);
+        if (properties->get)
+            itf->has_getters = TRUE;
       }
 }
 
+/*
+ * Sets a function that returns the interfaces the object behind a path
+ * implements, with names giving the interface of each bit. Calls to an
+ * interface the object does not implement are refused, and it is left
+ * out of Introspect. Interfaces not in names, and every interface if no
+ * function is set, are taken to be implemented.
+ *
+ * The names are used in place, so must outlive the path.
+ */
+void
+droute_path_set_interface_mask (DRoutePath                  *path,
+                                const char * const          *names,
+                                DRouteInterfaceMaskFunction  mask)
+{
+    gpointer value;
+    guint position = 0;
+
+    path->interface_names = names;
+    path->interface_mask = mask;
+    while (name_table_next (path->interfaces, &position, NULL, &value))
+        interface_set_implements_bit ((DRouteInterface *) value, names);
+    path_clear_introspection (path);
+}
+
 /*---------------------------------------------------------------------------*/
 
-/* The data structures don't support an efficient implementation of GetAll
- * and I don't really care.
+/*
+ * Appends the readable properties of an interface as an a{sv}, in the
+ * order they were added.
  */
+static void
+append_properties (DBusMessageIter *iter,
+                   DRouteInterface *itf,
+                   void            *datum)
+{
+    DBusMessageIter iter_dict, iter_dict_entry;
+    const gchar *key;
+    gpointer value;
+    guint position = 0;
+
+    if (!dbus_message_iter_open_container
+                (iter, DBUS_TYPE_ARRAY, "{sv}", &iter_dict))
+        oom ();
+
+    while (itf && name_table_next (itf->properties, &position, &key, &value))
+      {
+        const DRouteProperty *prop = (const DRouteProperty *) value;
+
+        if (!prop->get)
+           continue;
+        if (!dbus_message_iter_open_container
+                     (&iter_dict, DBUS_TYPE_DICT_ENTRY, NULL, &iter_dict_entry))
+           oom ();
+        dbus_message_iter_append_basic (&iter_dict_entry, DBUS_TYPE_STRING,
+                                        &key);
+        (prop->get) (&iter_dict_entry, datum);
+        if (!dbus_message_iter_close_container (&iter_dict, &iter_dict_entry))
+            oom ();
+      }
+
+    if (!dbus_message_iter_close_container (iter, &iter_dict))
+        oom ();
+}
+
 static DBusMessage *
 impl_prop_GetAll (DBusMessage *message,
                   DRoutePath  *path,
                   const char  *pathstr)
 {
-    DBusMessageIter iter, iter_dict, iter_dict_entry;
+    DBusMessageIter iter;
     DBusMessage *reply;
     DBusError error;
-    GHashTableIter prop_iter;
-
-    StrPair *key;
-    PropertyPair *value;
+    DRouteInterface *itf;
     gchar *iface;
 
     void  *datum = path_get_datum (path, pathstr);
@@ -274,31 +496,67 @@ impl_prop_GetAll (DBusMessage *message,
                 (message, &error, DBUS_TYPE_STRING, &iface, DBUS_TYPE_INVALID))
         return dbus_message_new_error (message, DBUS_ERROR_FAILED, error.message);
 
+    itf = (DRouteInterface *) name_table_lookup (path->interfaces, iface);
+    if (itf && !interface_implemented (itf, path_get_implemented (path, datum)))
+        return droute_not_implemented_error (message, iface);
+
+    reply = dbus_message_new_method_return (message);
+    if (!reply)
+        oom ();
+
+    dbus_message_iter_init_append (reply, &iter);
+    append_properties (&iter, itf, datum);
+    return reply;
+}
+
+/*
+ * An extension to the Properties interface that returns, as an a{sa{sv}},
+ * the properties of every interface the object implements, saving a
+ * client a GetAll round trip for each one. Interfaces without readable
+ * properties are left out.
+ */
+static DBusMessage *
+impl_prop_GetAllInterfaces (DBusMessage *message,
+                            DRoutePath  *path,
+                            const char  *pathstr)
+{
+    DBusMessageIter iter, iter_dict, iter_dict_entry;
+    DBusMessage *reply;
+    gpointer value;
+    guint position = 0;
+    guint64 implemented;
+
+    void  *datum = path_get_datum (path, pathstr);
+    if (!datum)
+	return droute_object_does_not_exist_error (message);
+    implemented = path_get_implemented (path, datum);
+
     reply = dbus_message_new_method_return (message);
     if (!reply)
         oom ();
 
     dbus_message_iter_init_append (reply, &iter);
     if (!dbus_message_iter_open_container
-                (&iter, DBUS_TYPE_ARRAY, "{sv}", &iter_dict))
+                (&iter, DBUS_TYPE_ARRAY, "{sa{sv}}", &iter_dict))
         oom ();
 
-    g_hash_table_iter_init (&prop_iter, path->properties);
-    while (g_hash_table_iter_next (&prop_iter, (gpointer*)&key, (gpointer*)&value))
+    while (name_table_next (path->interfaces, &position, NULL, &value))
       {
-        if (!g_strcmp0 (key->one, iface))
-         {
-           if (!value->get)
-              continue;
-           if (!dbus_message_iter_open_container
-                        (&iter_dict, DBUS_TYPE_DICT_ENTRY, NULL, &iter_dict_entry))
-              oom ();
-           dbus_message_iter_append_basic (&iter_dict_entry, DBUS_TYPE_STRING,
-                                           &key->two);
-           (value->get) (&iter_dict_entry, datum);
-           if (!dbus_message_iter_close_container (&iter_dict, &iter_dict_entry))
-               oom ();
-         }
+        DRouteInterface *itf = (DRouteInterface *) value;
+
+        if (!itf->has_getters)
+            continue;
+        if (!interface_implemented (itf, implemented))
+            continue;
+
+        if (!dbus_message_iter_open_container
+                     (&iter_dict, DBUS_TYPE_DICT_ENTRY, NULL, &iter_dict_entry))
+            oom ();
+        dbus_message_iter_append_basic (&iter_dict_entry, DBUS_TYPE_STRING,
+                                        &itf->name);
+        append_properties (&iter_dict_entry, itf, datum);
+        if (!dbus_message_iter_close_container (&iter_dict, &iter_dict_entry))
+            oom ();
       }
 
     if (!dbus_message_iter_close_container (&iter, &iter_dict))
@@ -315,8 +573,9 @@ impl_prop_GetSet (DBusMessage *message,
     DBusMessage *reply = NULL;
     DBusError error;
 
-    StrPair pair;
-    PropertyPair *prop_funcs = NULL;
+    const gchar *iface, *name;
+    DRouteInterface *itf;
+    const DRouteProperty *prop_funcs = NULL;
 
     void *datum;
 
@@ -324,28 +583,32 @@ impl_prop_GetSet (DBusMessage *message,
     if (!dbus_message_get_args (message,
                                 &error,
                                 DBUS_TYPE_STRING,
-                                &(pair.one),
+                                &iface,
                                 DBUS_TYPE_STRING,
-                                &(pair.two),
+                                &name,
                                 DBUS_TYPE_INVALID))
         return dbus_message_new_error (message, DBUS_ERROR_FAILED, error.message);
 
-    _DROUTE_DEBUG ("DRoute (handle prop): %s|%s on %s\n", pair.one, pair.two, pathstr);
+    _DROUTE_DEBUG ("DRoute (handle prop): %s|%s on %s\n", iface, name, pathstr);
 
-    prop_funcs = (PropertyPair *) g_hash_table_lookup (path->properties, &pair);
+    itf = (DRouteInterface *) name_table_lookup (path->interfaces, iface);
+    if (itf)
+        prop_funcs = (const DRouteProperty *) name_table_lookup (itf->properties, name);
     if (!prop_funcs)
         return dbus_message_new_error (message, DBUS_ERROR_FAILED, "Property unavailable");
 
     datum = path_get_datum (path, pathstr);
     if (!datum)
 	return droute_object_does_not_exist_error (message);
+    if (!interface_implemented (itf, path_get_implemented (path, datum)))
+        return droute_not_implemented_error (message, iface);
 
     if (get && prop_funcs->get)
       {
         
         DBusMessageIter iter;
 
-        _DROUTE_DEBUG ("DRoute (handle prop Get): %s|%s on %s\n", pair.one, pair.two, pathstr);
+        _DROUTE_DEBUG ("DRoute (handle prop Get): %s|%s on %s\n", iface, name, pathstr);
 
         reply = dbus_message_new_method_return (message);
         dbus_message_iter_init_append (reply, &iter);
@@ -359,7 +622,7 @@ impl_prop_GetSet (DBusMessage *message,
       {
         DBusMessageIter iter;
 
-        _DROUTE_DEBUG ("DRoute (handle prop Get): %s|%s on %s\n", pair.one, pair.two, pathstr);
+        _DROUTE_DEBUG ("DRoute (handle prop Get): %s|%s on %s\n", iface, name, pathstr);
 
         dbus_message_iter_init (message, &iter);
         /* Skip the interface and property name */
@@ -377,33 +640,119 @@ impl_prop_GetSet (DBusMessage *message,
     return reply;
 }
 
-static DBusHandlerResult
-handle_properties (DBusConnection *bus,
-                   DBusMessage    *message,
-                   DRoutePath     *path,
-                   const gchar    *iface,
-                   const gchar    *member,
-                   const gchar    *pathstr)
+/*
+ * Builds the standard PropertiesChanged signal for an object, carrying
+ * the new value of each named property that has a getter. Any other
+ * names are listed as invalidated, so that clients read them again.
+ * Returns NULL if the object does not have the interface.
+ */
+DBusMessage *
+droute_path_new_properties_changed (DRoutePath  *path,
+                                    const char  *pathstr,
+                                    const char  *interface,
+                                    const char **properties)
 {
-    DBusMessage *reply;
-    DBusHandlerResult result = DBUS_HANDLER_RESULT_HANDLED;
+    DBusMessage *signal;
+    DBusMessageIter iter, iter_dict, iter_dict_entry, iter_array;
+    DRouteInterface *itf;
+    void *datum;
+    gint i;
+
+    itf = (DRouteInterface *) name_table_lookup (path->interfaces, interface);
+    if (!itf)
+        return NULL;
+
+    datum = path_get_datum (path, pathstr);
+    if (!datum)
+        return NULL;
+    if (!interface_implemented (itf, path_get_implemented (path, datum)))
+        return NULL;
+
+    signal = dbus_message_new_signal (pathstr, DBUS_INTERFACE_PROPERTIES,
+                                      "PropertiesChanged");
+    if (!signal)
+        oom ();
+
+    dbus_message_iter_init_append (signal, &iter);
+    dbus_message_iter_append_basic (&iter, DBUS_TYPE_STRING, &itf->name);
+
+    if (!dbus_message_iter_open_container
+                (&iter, DBUS_TYPE_ARRAY, "{sv}", &iter_dict))
+        oom ();
+    for (i = 0; properties[i] != NULL; i++)
+      {
+        const DRouteProperty *prop;
+
+        prop = name_table_lookup (itf->properties, properties[i]);
+        if (!prop || !prop->get)
+            continue;
+        if (!dbus_message_iter_open_container
+                     (&iter_dict, DBUS_TYPE_DICT_ENTRY, NULL, &iter_dict_entry))
+            oom ();
+        dbus_message_iter_append_basic (&iter_dict_entry, DBUS_TYPE_STRING,
+                                        &prop->name);
+        (prop->get) (&iter_dict_entry, datum);
+        if (!dbus_message_iter_close_container (&iter_dict, &iter_dict_entry))
+            oom ();
+      }
+    if (!dbus_message_iter_close_container (&iter, &iter_dict))
+        oom ();
+
+    if (!dbus_message_iter_open_container
+                (&iter, DBUS_TYPE_ARRAY, DBUS_TYPE_STRING_AS_STRING, &iter_array))
+        oom ();
+    for (i = 0; properties[i] != NULL; i++)
+      {
+        const DRouteProperty *prop;
+
+        prop = name_table_lookup (itf->properties, properties[i]);
+        if (prop && prop->get)
+            continue;
+        dbus_message_iter_append_basic (&iter_array, DBUS_TYPE_STRING,
+                                        &properties[i]);
+      }
+    if (!dbus_message_iter_close_container (&iter, &iter_array))
+        oom ();
+    return signal;
+}
+
+/* Sends the signal droute_path_new_properties_changed () builds */
+void
+droute_path_emit_properties_changed (DRoutePath  *path,
+                                     const char  *pathstr,
+                                     const char  *interface,
+                                     const char **properties)
+{
+    DBusMessage *signal;
+
+    signal = droute_path_new_properties_changed (path, pathstr, interface,
+                                                 properties);
+    if (!signal)
+        return;
+    droute_send (path->cnx, signal);
+    dbus_message_unref (signal);
+}
+
+static DBusMessage *
+handle_properties (DBusConnection  *bus,
+                   DBusMessage     *message,
+                   DRoutePath      *path,
+                   DRouteInterface *itf,
+                   const gchar     *member,
+                   const gchar     *pathstr)
+{
+    DBusMessage *reply = NULL;
 
     if (!g_strcmp0(member, "GetAll"))
        reply = impl_prop_GetAll (message, path, pathstr);
+    else if (!g_strcmp0 (member, "GetAllInterfaces"))
+       reply = impl_prop_GetAllInterfaces (message, path, pathstr);
     else if (!g_strcmp0 (member, "Get"))
        reply = impl_prop_GetSet (message, path, pathstr, TRUE);
     else if (!g_strcmp0 (member, "Set"))
        reply = impl_prop_GetSet (message, path, pathstr, FALSE);
-    else
-       result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-    if (reply)
-      {
-        dbus_connection_send (bus, reply, NULL);
-        dbus_message_unref (reply);
-      }
-
-    return result;
+    return reply;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -417,46 +766,99 @@ static const char *introspection_node_element =
 static const char *introspection_footer =
 "</node>";
 
-static DBusHandlerResult
-handle_introspection (DBusConnection *bus,
-                      DBusMessage    *message,
-                      DRoutePath     *path,
-                      const gchar    *iface,
-                      const gchar    *member,
-                      const gchar    *pathstr)
+/*
+ * Returns the descriptions of the interfaces an object implements,
+ * rendered once for each distinct set of interfaces and then kept until
+ * the path changes. Interfaces past the 64th have no bit in the mask and
+ * are always described.
+ */
+static GString *
+path_get_introspection (DRoutePath *path, void *datum)
+{
+    guint64 implemented = path_get_implemented (path, datum);
+    guint64 mask = 0;
+    GString *rendered;
+    gpointer value;
+    guint position = 0;
+
+    while (name_table_next (path->interfaces, &position, NULL, &value))
+      {
+        DRouteInterface *itf = (DRouteInterface *) value;
+
+        if (itf->introspect && interface_implemented (itf, implemented))
+            mask |= itf->bit;
+      }
+
+    if (!path->introspection)
+        path->introspection = g_hash_table_new_full (g_int64_hash,
+                                                     g_int64_equal,
+                                                     g_free,
+                                                     introspection_free);
+
+    rendered = (GString *) g_hash_table_lookup (path->introspection, &mask);
+    if (rendered)
+        return rendered;
+
+    rendered = g_string_new (NULL);
+    position = 0;
+    while (name_table_next (path->interfaces, &position, NULL, &value))
+      {
+        DRouteInterface *itf = (DRouteInterface *) value;
+
+        if (itf->introspect && (!itf->bit || (mask & itf->bit)))
+            g_string_append (rendered, itf->introspect);
+      }
+    g_hash_table_insert (path->introspection, g_memdup (&mask, sizeof (mask)),
+                         rendered);
+    return rendered;
+}
+
+static DBusMessage *
+handle_introspection (DBusConnection  *bus,
+                      DBusMessage     *message,
+                      DRoutePath      *path,
+                      DRouteInterface *itf,
+                      const gchar     *member,
+                      const gchar     *pathstr)
 {
     GString *output;
+    GString *interfaces = NULL;
+    gchar *children = NULL;
     gchar *final;
-    gint i;
+    void *datum;
 
     DBusMessage *reply;
 
     _DROUTE_DEBUG ("DRoute (handle introspection): %s\n", pathstr);
 
     if (g_strcmp0 (member, "Introspect"))
-        return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+        return NULL;
 
-    output = g_string_new(introspection_header);
+    datum = path_get_datum (path, pathstr);
+    if (!path->get_datum || datum)
+        interfaces = path_get_introspection (path, datum);
+
+    if (path->introspect_children_cb)
+        children = (*path->introspect_children_cb) (pathstr, path->introspect_children_data);
 
+    /* Size the reply up front so the interfaces are copied only once */
+    output = g_string_sized_new (strlen (introspection_header) +
+                                 strlen (introspection_node_element) +
+                                 strlen (pathstr) +
+                                 (interfaces ? interfaces->len : 0) +
+                                 (children ? strlen (children) : 0) +
+                                 strlen (introspection_footer));
+
+    g_string_append(output, introspection_header);
     g_string_append_printf(output, introspection_node_element, pathstr);
 
-    if (!path->get_datum || path_get_datum (path, pathstr))
-      {
-        for (i=0; i < path->introspection->len; i++)
-          {
-            gchar *introspect = (gchar *) g_ptr_array_index (path->introspection, i);
-            g_string_append (output, introspect);
-          }
-      }
+    if (interfaces)
+        g_string_append_len (output, interfaces->str, interfaces->len);
 
-    if (path->introspect_children_cb)
+    if (children)
       {
-        gchar *children = (*path->introspect_children_cb) (pathstr, path->introspect_children_data);
-        if (children)
-          {
-            g_string_append (output, children);
-            g_free (children);
-          }
+        g_string_append (output, children);
+        g_free (children);
       }
 
     g_string_append(output, introspection_footer);
@@ -467,42 +869,36 @@ handle_introspection (DBusConnection *bus,
         oom ();
     dbus_message_append_args(reply, DBUS_TYPE_STRING, &final,
                              DBUS_TYPE_INVALID);
-    dbus_connection_send (bus, reply, NULL);
 
-    dbus_message_unref (reply);
     g_free(final);
-    return DBUS_HANDLER_RESULT_HANDLED;
+    return reply;
 }
 
 /*---------------------------------------------------------------------------*/
 
-static DBusHandlerResult
-handle_other (DBusConnection *bus,
-              DBusMessage    *message,
-              DRoutePath     *path,
-              const gchar    *iface,
-              const gchar    *member,
-              const gchar    *pathstr)
+static DBusMessage *
+handle_other (DBusConnection  *bus,
+              DBusMessage     *message,
+              DRoutePath      *path,
+              DRouteInterface *itf,
+              const gchar     *member,
+              const gchar     *pathstr)
 {
-    gint result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
-
-    StrPair pair;
     DRouteFunction func;
     DBusMessage *reply = NULL;
 
     void *datum;
 
-    pair.one = iface;
-    pair.two = member;
-
-    _DROUTE_DEBUG ("DRoute (handle other): %s|%s on %s\n", member, iface, pathstr);
+    _DROUTE_DEBUG ("DRoute (handle other): %s|%s on %s\n", member, itf->name, pathstr);
 
-    func = (DRouteFunction) g_hash_table_lookup (path->methods, &pair);
+    func = (DRouteFunction) name_table_lookup (itf->methods, member);
     if (func != NULL)
       {
         datum = path_get_datum (path, pathstr);
         if (!datum)
 	    reply = droute_object_does_not_exist_error (message);
+        else if (!interface_implemented (itf, path_get_implemented (path, datum)))
+            reply = droute_not_implemented_error (message, itf->name);
         else
             reply = (func) (bus, message, datum);
 
@@ -514,14 +910,405 @@ handle_other (DBusConnection *bus,
              */
             reply = dbus_message_new_method_return (message);
           }
-        dbus_connection_send (bus, reply, NULL);
-        dbus_message_unref (reply);
-        result = DBUS_HANDLER_RESULT_HANDLED;
+        _DROUTE_DEBUG ("DRoute (handle other) (reply): type %d\n",
+                       dbus_message_get_type(reply));
       }
 
-    _DROUTE_DEBUG ("DRoute (handle other) (reply): type %d\n",
-                   dbus_message_get_type(reply));
-    return result;
+    return reply;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Call counts, error counts and latency histograms for each interface and
+ * member, kept while enabled. They are only touched where handlers run,
+ * on the main context.
+ *
+ * Only members that a handler served get their own entry. Any other name
+ * a client sends is counted in a single DROUTE_STATS_UNKNOWN entry, so
+ * that the table can not be grown without bound.
+ */
+
+static void
+member_stats_free (gpointer data)
+{
+    g_hash_table_destroy ((GHashTable *) data);
+}
+
+static void
+stats_record (DRouteContext *cnx,
+              const gchar   *iface,
+              const gchar   *member,
+              glong          usec,
+              gboolean       error)
+{
+    GHashTable *members;
+    DRouteStats *stats;
+    guint bucket = 0;
+
+    if (!cnx->stats)
+        cnx->stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, member_stats_free);
+
+    members = g_hash_table_lookup (cnx->stats, iface);
+    if (!members)
+      {
+        members = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, g_free);
+        g_hash_table_insert (cnx->stats, g_strdup (iface), members);
+      }
+
+    stats = g_hash_table_lookup (members, member);
+    if (!stats)
+      {
+        /* The strings are kept in the same block as the counts */
+        gsize iface_len = strlen (iface) + 1;
+        gchar *strings;
+
+        stats = g_malloc0 (sizeof (DRouteStats) + iface_len + strlen (member) + 1);
+        strings = (gchar *) (stats + 1);
+        strcpy (strings, iface);
+        strcpy (strings + iface_len, member);
+        stats->interface = strings;
+        stats->member = strings + iface_len;
+        g_hash_table_insert (members, (gpointer) stats->member, stats);
+      }
+
+    if (usec > 0)
+        bucket = MIN (g_bit_storage (usec), DROUTE_STATS_BUCKETS - 1);
+    stats->calls++;
+    stats->buckets[bucket]++;
+    if (error)
+        stats->errors++;
+}
+
+/* Runs a handler, timing it if statistics are enabled */
+static DBusMessage *
+path_call (DBusConnection  *bus,
+           DBusMessage     *message,
+           DRoutePath      *path,
+           DRouteInterface *itf,
+           const gchar     *member,
+           const gchar     *pathstr)
+{
+    DBusMessage *reply;
+    GTimeVal start, end;
+    glong usec;
+
+    if (G_LIKELY (!path->cnx->stats_enabled))
+        return (itf->handler) (bus, message, path, itf, member, pathstr);
+
+    g_get_current_time (&start);
+    reply = (itf->handler) (bus, message, path, itf, member, pathstr);
+    g_get_current_time (&end);
+
+    usec = (end.tv_sec - start.tv_sec) * G_USEC_PER_SEC +
+           (end.tv_usec - start.tv_usec);
+
+    if (reply)
+        stats_record (path->cnx, itf->name, member, usec,
+                      dbus_message_get_type (reply) == DBUS_MESSAGE_TYPE_ERROR);
+    else
+        stats_record (path->cnx, DROUTE_STATS_UNKNOWN, DROUTE_STATS_UNKNOWN,
+                      usec, TRUE);
+    return reply;
+}
+
+/* Counts already gathered are kept while disabled */
+void
+droute_set_stats_enabled (DRouteContext *cnx, gboolean enabled)
+{
+    cnx->stats_enabled = enabled;
+}
+
+gboolean
+droute_get_stats_enabled (DRouteContext *cnx)
+{
+    return cnx->stats_enabled;
+}
+
+void
+droute_stats_foreach (DRouteContext       *cnx,
+                      DRouteStatsFunction  func,
+                      void                *data)
+{
+    GHashTableIter iter, member_iter;
+    gpointer members, stats;
+
+    if (!cnx->stats)
+        return;
+
+    g_hash_table_iter_init (&iter, cnx->stats);
+    while (g_hash_table_iter_next (&iter, NULL, &members))
+      {
+        g_hash_table_iter_init (&member_iter, (GHashTable *) members);
+        while (g_hash_table_iter_next (&member_iter, NULL, &stats))
+            (func) ((DRouteStats *) stats, data);
+      }
+}
+
+void
+droute_reset_stats (DRouteContext *cnx)
+{
+    if (cnx->stats)
+        g_hash_table_remove_all (cnx->stats);
+}
+
+/*---------------------------------------------------------------------------*/
+
+/*
+ * Batch.Call runs a list of method calls carried in one message, so that
+ * a client reading many values from many objects pays for one round trip.
+ *
+ * Each call is a (path, interface, member, args) tuple with every argument
+ * wrapped in a variant, so the whole list is an a(ossav). Each call is
+ * dispatched as if it had arrived on its own from the same sender. The
+ * replies come back in order as an a(sav): an empty string and the reply's
+ * arguments, or an error name and the error's arguments.
+ */
+
+/* The registered path a call to pathstr would be routed to */
+static DRoutePath *
+context_find_path (DRouteContext *cnx, const gchar *pathstr)
+{
+    DRoutePath *found = NULL;
+    gsize found_len = 0;
+    guint i;
+
+    for (i = 0; i < cnx->registered_paths->len; i++)
+      {
+        DRoutePath *path = g_ptr_array_index (cnx->registered_paths, i);
+        gsize len = strlen (path->name);
+
+        if (strncmp (pathstr, path->name, len))
+            continue;
+        if (pathstr[len] != '\0' &&
+            !(path->fallback && (pathstr[len] == '/' || path->name[len - 1] == '/')))
+            continue;
+        if (!found || len > found_len)
+          {
+            found = path;
+            found_len = len;
+          }
+      }
+    return found;
+}
+
+/* Checks interface (dotted) and member names before they reach libdbus */
+static gboolean
+name_is_valid (const gchar *name, gboolean dotted)
+{
+    gboolean element_start = TRUE;
+    gint elements = 1;
+    const gchar *p;
+
+    if (*name == '\0' || strlen (name) > 255)
+        return FALSE;
+
+    for (p = name; *p; p++)
+      {
+        if (dotted && *p == '.' && !element_start)
+          {
+            element_start = TRUE;
+            elements++;
+            continue;
+          }
+        if (!g_ascii_isalnum (*p) && *p != '_')
+            return FALSE;
+        if (element_start && g_ascii_isdigit (*p))
+            return FALSE;
+        element_start = FALSE;
+      }
+
+    return !element_start && (!dotted || elements > 1);
+}
+
+static dbus_bool_t
+iter_copy_value (DBusMessageIter *from, DBusMessageIter *to)
+{
+    int type = dbus_message_iter_get_arg_type (from);
+    DBusMessageIter from_sub, to_sub;
+    char *signature = NULL;
+    const char *contained = NULL;
+    dbus_bool_t ok = TRUE;
+
+    if (dbus_type_is_basic (type))
+      {
+        union { dbus_uint64_t u64; double d; const char *str; } value;
+
+        dbus_message_iter_get_basic (from, &value);
+        return dbus_message_iter_append_basic (to, type, &value);
+      }
+
+    dbus_message_iter_recurse (from, &from_sub);
+    if (type == DBUS_TYPE_VARIANT)
+      {
+        signature = dbus_message_iter_get_signature (&from_sub);
+        contained = signature;
+      }
+    else if (type == DBUS_TYPE_ARRAY)
+      {
+        signature = dbus_message_iter_get_signature (from);
+        contained = signature + 1;
+      }
+
+    if (!dbus_message_iter_open_container (to, type, contained, &to_sub))
+      {
+        dbus_free (signature);
+        return FALSE;
+      }
+    while (ok && dbus_message_iter_get_arg_type (&from_sub) != DBUS_TYPE_INVALID)
+      {
+        ok = iter_copy_value (&from_sub, &to_sub);
+        dbus_message_iter_next (&from_sub);
+      }
+    dbus_free (signature);
+
+    return dbus_message_iter_close_container (to, &to_sub) && ok;
+}
+
+static void
+append_args_as_variants (DBusMessageIter *iter, DBusMessage *message)
+{
+    DBusMessageIter args, iter_array, iter_variant;
+
+    if (!dbus_message_iter_open_container (iter, DBUS_TYPE_ARRAY, "v", &iter_array))
+        oom ();
+
+    if (dbus_message_iter_init (message, &args))
+      {
+        do
+          {
+            char *signature = dbus_message_iter_get_signature (&args);
+
+            if (!dbus_message_iter_open_container
+                        (&iter_array, DBUS_TYPE_VARIANT, signature, &iter_variant))
+                oom ();
+            if (!iter_copy_value (&args, &iter_variant))
+                oom ();
+            if (!dbus_message_iter_close_container (&iter_array, &iter_variant))
+                oom ();
+            dbus_free (signature);
+          }
+        while (dbus_message_iter_next (&args));
+      }
+
+    if (!dbus_message_iter_close_container (iter, &iter_array))
+        oom ();
+}
+
+/* Runs one (path, interface, member, args) call, returning its reply */
+static DBusMessage *
+batch_call (DBusConnection  *bus,
+            DBusMessage     *message,
+            DRouteContext   *cnx,
+            DBusMessageIter *call)
+{
+    DBusMessageIter fields, args, arg, iter_sub;
+    const char *pathstr, *iface, *member;
+    DRoutePath *path;
+    DRouteInterface *itf = NULL;
+    DBusMessage *sub, *reply = NULL;
+
+    dbus_message_iter_recurse (call, &fields);
+    dbus_message_iter_get_basic (&fields, &pathstr);
+    dbus_message_iter_next (&fields);
+    dbus_message_iter_get_basic (&fields, &iface);
+    dbus_message_iter_next (&fields);
+    dbus_message_iter_get_basic (&fields, &member);
+    dbus_message_iter_next (&fields);
+    dbus_message_iter_recurse (&fields, &args);
+
+    if (!name_is_valid (iface, TRUE) || !name_is_valid (member, FALSE))
+        return dbus_message_new_error (message, DBUS_ERROR_INVALID_ARGS,
+                                       "Invalid interface or member name");
+
+    path = context_find_path (cnx, pathstr);
+    if (path)
+        itf = (DRouteInterface *) name_table_lookup (path->interfaces, iface);
+    if (itf && itf->handler == handle_batch)
+        return dbus_message_new_error (message, DBUS_ERROR_FAILED,
+                                       "Batches may not be nested");
+
+    sub = dbus_message_new_method_call (NULL, pathstr, iface, member);
+    if (!sub)
+        oom ();
+    /* Replies are matched to the call by serial, which must not be 0 */
+    dbus_message_set_serial (sub, dbus_message_get_serial (message));
+    dbus_message_set_sender (sub, dbus_message_get_sender (message));
+
+    dbus_message_iter_init_append (sub, &iter_sub);
+    while (dbus_message_iter_get_arg_type (&args) != DBUS_TYPE_INVALID)
+      {
+        dbus_message_iter_recurse (&args, &arg);
+        if (!iter_copy_value (&arg, &iter_sub))
+            oom ();
+        dbus_message_iter_next (&args);
+      }
+
+    _DROUTE_DEBUG ("DRoute (batch call): %s|%s on %s\n", member, iface, pathstr);
+
+    if (itf)
+        reply = path_call (bus, sub, path, itf, member, pathstr);
+    if (!reply)
+        reply = droute_not_yet_handled_error (sub);
+
+    dbus_message_unref (sub);
+    return reply;
+}
+
+static DBusMessage *
+handle_batch (DBusConnection  *bus,
+              DBusMessage     *message,
+              DRoutePath      *path,
+              DRouteInterface *itf,
+              const gchar     *member,
+              const gchar     *pathstr)
+{
+    DBusMessageIter iter, iter_calls, iter_results, iter_struct;
+    DBusMessage *reply;
+
+    if (g_strcmp0 (member, "Call"))
+        return NULL;
+
+    if (!dbus_message_has_signature (message, "a(ossav)"))
+        return droute_invalid_arguments_error (message);
+
+    reply = dbus_message_new_method_return (message);
+    if (!reply)
+        oom ();
+
+    dbus_message_iter_init (message, &iter);
+    dbus_message_iter_recurse (&iter, &iter_calls);
+
+    dbus_message_iter_init_append (reply, &iter);
+    if (!dbus_message_iter_open_container (&iter, DBUS_TYPE_ARRAY, "(sav)",
+                                           &iter_results))
+        oom ();
+
+    while (dbus_message_iter_get_arg_type (&iter_calls) != DBUS_TYPE_INVALID)
+      {
+        DBusMessage *call_reply;
+        const char *error = "";
+
+        call_reply = batch_call (bus, message, path->cnx, &iter_calls);
+        if (dbus_message_get_type (call_reply) == DBUS_MESSAGE_TYPE_ERROR)
+            error = dbus_message_get_error_name (call_reply);
+
+        if (!dbus_message_iter_open_container (&iter_results, DBUS_TYPE_STRUCT,
+                                               NULL, &iter_struct))
+            oom ();
+        dbus_message_iter_append_basic (&iter_struct, DBUS_TYPE_STRING, &error);
+        append_args_as_variants (&iter_struct, call_reply);
+        if (!dbus_message_iter_close_container (&iter_results, &iter_struct))
+            oom ();
+
+        dbus_message_unref (call_reply);
+        dbus_message_iter_next (&iter_calls);
+      }
+
+    if (!dbus_message_iter_close_container (&iter, &iter_results))
+        oom ();
+    return reply;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -536,6 +1323,8 @@ handle_message (DBusConnection *bus, DBusMessage *message, void *user_data)
     const gchar *pathstr = dbus_message_get_path (message);
 
     DBusHandlerResult result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    DRouteInterface *itf;
+    DBusMessage *reply = NULL;
 
     _DROUTE_DEBUG ("DRoute (handle message): %s|%s of type %d on %s\n", member, iface, type, pathstr);
 
@@ -545,12 +1334,35 @@ handle_message (DBusConnection *bus, DBusMessage *message, void *user_data)
         iface  == NULL)
         return result;
 
-    if (!strcmp (iface, "org.freedesktop.DBus.Properties"))
-        result = handle_properties (bus, message, path, iface, member, pathstr);
-    else if (!strcmp (iface, "org.freedesktop.DBus.Introspectable"))
-        result = handle_introspection (bus, message, path, iface, member, pathstr);
-    else
-        result = handle_other (bus, message, path, iface, member, pathstr);
+    itf = (DRouteInterface *) name_table_lookup (path->interfaces, iface);
+    if (!itf)
+        return result;
+
+    /*
+     * On the I/O thread only the interface is resolved. Everything else may
+     * touch the objects behind the path, so is left to the main context,
+     * which always replies to a call handed to it.
+     */
+    if (path->cnx->io_context && g_main_context_is_owner (path->cnx->io_context))
+      {
+        DRouteCall *call = g_slice_new (DRouteCall);
+
+        call->path = path;
+        call->itf = itf;
+        call->message = dbus_message_ref (message);
+        call->reply = NULL;
+        handoff_queue_push (path->cnx->calls, &call->node);
+        return DBUS_HANDLER_RESULT_HANDLED;
+      }
+
+    reply = path_call (bus, message, path, itf, member, pathstr);
+
+    if (reply)
+      {
+        dbus_connection_send (bus, reply, NULL);
+        dbus_message_unref (reply);
+        result = DBUS_HANDLER_RESULT_HANDLED;
+      }
 #if 0
     if (result == DBUS_HANDLER_RESULT_NOT_YET_HANDLED)
         g_print ("DRoute | Unhandled message: %s|%s of type %d on %s\n", member, iface, type, pathstr);
@@ -561,6 +1373,156 @@ handle_message (DBusConnection *bus, DBusMessage *message, void *user_data)
 
 /*---------------------------------------------------------------------------*/
 
+/*
+ * Calls taken off the bus by the I/O thread are run on the main context,
+ * and their replies handed back for the I/O thread to send. The main
+ * thread then only spends time in the handlers themselves.
+ */
+
+static void
+run_call (HandoffNode *node, gpointer data)
+{
+    DRouteContext *cnx = (DRouteContext *) data;
+    DRouteCall *call = (DRouteCall *) node;
+    DBusMessage *message = call->message;
+
+    call->reply = path_call (cnx->bus,
+                             message,
+                             call->path,
+                             call->itf,
+                             dbus_message_get_member (message),
+                             dbus_message_get_path (message));
+    if (!call->reply)
+        call->reply = droute_not_yet_handled_error (message);
+
+    handoff_queue_push (cnx->replies, node);
+}
+
+static void
+send_reply (HandoffNode *node, gpointer data)
+{
+    DRouteContext *cnx = (DRouteContext *) data;
+    DRouteCall *call = (DRouteCall *) node;
+
+    dbus_connection_send (cnx->bus, call->reply, NULL);
+    dbus_message_unref (call->reply);
+    if (call->message)
+        dbus_message_unref (call->message);
+    g_slice_free (DRouteCall, call);
+}
+
+static gpointer
+io_thread_run (gpointer data)
+{
+    DRouteContext *cnx = (DRouteContext *) data;
+
+    g_main_loop_run (cnx->io_loop);
+    return NULL;
+}
+
+/*
+ * Moves reading and writing of the connection to a new thread, leaving
+ * only the method handlers to run on the default main context.
+ *
+ * Threads must have been initialised in both GLib and libdbus before the
+ * connection was opened, and every path and interface must already have
+ * been added. Pending call notifications will also run on the I/O thread.
+ *
+ * Returns FALSE, with the connection left on the main context, if the
+ * thread could not be started.
+ */
+gboolean
+droute_start_io_thread (DRouteContext *cnx)
+{
+    GError *error = NULL;
+    guint i;
+
+    if (cnx->io_thread)
+        return TRUE;
+    if (!g_thread_supported ())
+        return FALSE;
+
+    /* Built now, the tables are only read from either thread */
+    for (i = 0; i < cnx->registered_paths->len; i++)
+      {
+        DRoutePath *path = g_ptr_array_index (cnx->registered_paths, i);
+        gpointer value;
+        guint position = 0;
+
+        name_table_prepare (path->interfaces);
+        while (name_table_next (path->interfaces, &position, NULL, &value))
+          {
+            name_table_prepare (((DRouteInterface *) value)->methods);
+            name_table_prepare (((DRouteInterface *) value)->properties);
+          }
+      }
+
+    cnx->io_context = g_main_context_new ();
+    cnx->io_loop = g_main_loop_new (cnx->io_context, FALSE);
+    cnx->calls = handoff_queue_new (NULL, run_call, cnx);
+    cnx->replies = handoff_queue_new (cnx->io_context, send_reply, cnx);
+    dbus_connection_setup_with_g_main (cnx->bus, cnx->io_context);
+
+    cnx->io_thread = g_thread_create (io_thread_run, cnx, TRUE, &error);
+    if (!cnx->io_thread)
+      {
+        g_warning ("DRoute: Could not start I/O thread: %s", error->message);
+        g_error_free (error);
+        droute_stop_io_thread (cnx);
+        return FALSE;
+      }
+    return TRUE;
+}
+
+/*
+ * Sends a message that the application itself starts, such as a signal.
+ * While an I/O thread runs, messages from other threads are queued
+ * behind the replies already handed to it, so that a signal never
+ * overtakes the reply to the call that caused it.
+ */
+void
+droute_send (DRouteContext *cnx, DBusMessage *message)
+{
+    DRouteCall *call;
+
+    if (!cnx->io_context || g_main_context_is_owner (cnx->io_context))
+      {
+        dbus_connection_send (cnx->bus, message, NULL);
+        return;
+      }
+
+    call = g_slice_new0 (DRouteCall);
+    call->reply = dbus_message_ref (message);
+    handoff_queue_push (cnx->replies, &call->node);
+}
+
+/*
+ * Returns the connection to the default main context. Calls already read
+ * are run, and their replies sent, before this returns.
+ */
+void
+droute_stop_io_thread (DRouteContext *cnx)
+{
+    if (!cnx->io_context)
+        return;
+
+    if (cnx->io_thread)
+      {
+        g_main_loop_quit (cnx->io_loop);
+        g_thread_join (cnx->io_thread);
+        cnx->io_thread = NULL;
+      }
+    dbus_connection_setup_with_g_main (cnx->bus, NULL);
+
+    handoff_queue_free (cnx->calls);
+    handoff_queue_free (cnx->replies);
+    g_main_loop_unref (cnx->io_loop);
+    g_main_context_unref (cnx->io_context);
+    cnx->io_context = NULL;
+}
+
+/*---------------------------------------------------------------------------*/
+
 static DBusMessage *
 droute_object_does_not_exist_error (DBusMessage *message)
 {
@@ -580,6 +1542,23 @@ droute_object_does_not_exist_error (DBusMessage *message)
     return reply;
 }
 
+static DBusMessage *
+droute_not_implemented_error (DBusMessage *message, const char *interface)
+{
+    DBusMessage *reply;
+    gchar       *errmsg;
+
+    errmsg= g_strdup_printf (
+            "Object %s does not implement interface \"%s\"\n",
+            dbus_message_get_path (message),
+            interface);
+    reply = dbus_message_new_error (message,
+                                    DBUS_ERROR_UNKNOWN_INTERFACE,
+                                    errmsg);
+    g_free (errmsg);
+    return reply;
+}
+
 /*---------------------------------------------------------------------------*/
 
 DBusMessage *
@@ -28,6 +28,13 @@
 
 #include <droute/droute-variant.h>
 
+/*
+ * Every path also answers Call on this interface, which runs a list of
+ * method calls on any registered paths and returns all of their replies.
+ * The calls are an a(ossav) of path, interface, member and arguments, and
+ * the replies an a(sav) of error name, empty on success, and arguments.
+ */
+#define DROUTE_INTERFACE_BATCH "org.a11y.atspi.Batch"
 
 typedef DBusMessage *(*DRouteFunction)         (DBusConnection *, DBusMessage *, void *);
 typedef dbus_bool_t  (*DRoutePropertyFunction) (DBusMessageIter *, void *);
@@ -35,6 +42,12 @@ typedef gchar *(*DRouteIntrospectChildrenFunction) (const char *, void *);
 
 typedef void        *(*DRouteGetDatumFunction) (const char *, void *);
 
+/*
+ * Returns the interfaces the object behind a path implements, as a mask
+ * in which bit i stands for the ith name given along with the function.
+ */
+typedef guint64      (*DRouteInterfaceMaskFunction) (void *);
+
 typedef struct _DRouteMethod DRouteMethod;
 struct _DRouteMethod
 {
@@ -42,6 +55,30 @@ struct _DRouteMethod
     const char *name;
 };
 
+/*
+ * Calls taking from 2^(i-1) up to 2^i microseconds are counted in bucket
+ * i, with anything quicker in bucket 0 and anything slower in the last.
+ */
+#define DROUTE_STATS_BUCKETS 24
+
+/*
+ * Calls to members that no handler serves are all counted under this
+ * interface and member name.
+ */
+#define DROUTE_STATS_UNKNOWN "(unknown)"
+
+typedef struct _DRouteStats DRouteStats;
+struct _DRouteStats
+{
+    const char *interface;
+    const char *member;
+    guint calls;
+    guint errors;
+    guint buckets[DROUTE_STATS_BUCKETS];
+};
+
+typedef void (*DRouteStatsFunction) (const DRouteStats *, void *);
+
 typedef struct _DRouteProperty DRouteProperty;
 struct _DRouteProperty
 {
@@ -84,6 +121,48 @@ droute_path_add_interface (DRoutePath *path,
                            const DRouteMethod   *methods,
                            const DRouteProperty *properties);
 
+void
+droute_path_set_interface_mask (DRoutePath                  *path,
+                                const char * const          *names,
+                                DRouteInterfaceMaskFunction  mask);
+
+DBusMessage *
+droute_path_new_properties_changed  (DRoutePath  *path,
+                                     const char  *pathstr,
+                                     const char  *interface,
+                                     const char **properties);
+
+void
+droute_path_emit_properties_changed (DRoutePath  *path,
+                                     const char  *pathstr,
+                                     const char  *interface,
+                                     const char **properties);
+
+void
+droute_send (DRouteContext *cnx,
+             DBusMessage   *message);
+
+gboolean
+droute_start_io_thread (DRouteContext *cnx);
+
+void
+droute_stop_io_thread  (DRouteContext *cnx);
+
+void
+droute_set_stats_enabled (DRouteContext *cnx,
+                          gboolean       enabled);
+
+gboolean
+droute_get_stats_enabled (DRouteContext *cnx);
+
+void
+droute_stats_foreach     (DRouteContext       *cnx,
+                          DRouteStatsFunction  func,
+                          void                *data);
+
+void
+droute_reset_stats       (DRouteContext *cnx);
+
 DBusMessage *
 droute_not_yet_handled_error   (DBusMessage *message);
 